@@ -0,0 +1,79 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "avlaggregate.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: aggregate-bench [keys] [queries]
+//
+// Sums the values over random key ranges of several widths in an
+// AggregateAVLTree<uint64_t, int64_t> with aggregate(lo, hi), and with the
+// loop it replaces: iterate from lowerBound(lo) while the key is <= hi.
+// Also times inserting the keys into the aggregate tree and into a plain
+// AVLTree, which is what keeping the sums up to date costs.
+
+typedef AggregateAVLTree<uint64_t, int64_t, SumAggregate<int64_t> > Tree;
+
+static double nsPerOp(uint64_t start, size_t ops)
+{
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t queries = benchArg(argc, argv, 2, 100000);
+    vector<uint64_t> keys = benchShuffledKeys(n, 1);
+
+    AVLTree<uint64_t, int64_t> plain;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < n; i++){
+        plain.insert(make_pair(keys[i], static_cast<int64_t>(keys[i] % 1000)));
+    }
+    double plainNs = nsPerOp(start, n);
+
+    Tree tree;
+    start = benchNowNs();
+    for(size_t i = 0; i < n; i++){
+        tree.insert(make_pair(keys[i], static_cast<int64_t>(keys[i] % 1000)));
+    }
+    double treeNs = nsPerOp(start, n);
+    cout << "insert ns/op: AVLTree " << fixed << setprecision(1) << plainNs
+         << ", AggregateAVLTree " << treeNs << endl;
+
+    cout << left << setw(10) << "width" << right << setw(14) << "aggregate" << setw(14) << "loop" << endl;
+    const size_t widths[] = { 10, 1000, 100000 };
+    for(size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++){
+        size_t width = widths[w];
+        BenchRng rng(7);
+        vector<uint64_t> los(queries);
+        for(size_t i = 0; i < queries; i++){
+            los[i] = rng.below(n);
+        }
+
+        int64_t sum = 0;
+        start = benchNowNs();
+        for(size_t i = 0; i < queries; i++){
+            sum += tree.aggregate(los[i], los[i] + width - 1);
+        }
+        double aggNs = nsPerOp(start, queries);
+
+        // the loop gets fewer queries on wide ranges, or it would run for minutes
+        size_t loopQueries = max<size_t>(1, min(queries, 100000000 / (width * 100)));
+        int64_t loopSum = 0;
+        start = benchNowNs();
+        for(size_t i = 0; i < loopQueries; i++){
+            for(Tree::iterator it = tree.lowerBound(los[i]); it != tree.end() && it->first <= los[i] + width - 1; ++it){
+                loopSum += it->second;
+            }
+        }
+        double loopNs = nsPerOp(start, loopQueries);
+        benchKeep(sum + loopSum);
+
+        cout << left << setw(10) << width << right << setw(14) << aggNs << setw(14) << loopNs << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include "avlbst.h"
+#include "avltopdown.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: avl-latency-bench [keys]
+//
+// Times every single insert and remove (random key order) for AVLTree and
+// TopDownAVLTree and prints the latency distribution. Each sample includes
+// the ~20ns cost of reading the clock. Built with -DAVL_TRACE, the
+// tree's own trace (see avl-trace.h) is printed after each tree as well.
+
+static void printRow(const string& name, vector<uint64_t>& samples)
+{
+    sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    cout << left << setw(22) << name << right
+         << setw(10) << samples[n / 2]
+         << setw(10) << samples[n * 90 / 100]
+         << setw(10) << samples[n * 99 / 100]
+         << setw(10) << samples[n * 999 / 1000]
+         << setw(10) << samples[n - 1] << endl;
+}
+
+template<typename Tree>
+static void run(const string& name, const vector<uint64_t>& keys, const vector<uint64_t>& removeOrder)
+{
+    Tree tree;
+    vector<uint64_t> samples(keys.size());
+    for(size_t i = 0; i < keys.size(); i++){
+        uint64_t start = benchNowNs();
+        tree.insert(make_pair(keys[i], keys[i]));
+        samples[i] = benchNowNs() - start;
+    }
+    printRow(name + " insert", samples);
+    for(size_t i = 0; i < removeOrder.size(); i++){
+        uint64_t start = benchNowNs();
+        tree.remove(removeOrder[i]);
+        samples[i] = benchNowNs() - start;
+    }
+    printRow(name + " remove", samples);
+#ifdef AVL_TRACE
+    avlTraceReport(cout);
+    avlTraceReset();
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    vector<uint64_t> keys = benchShuffledKeys(n, 5);
+    vector<uint64_t> removeOrder = benchShuffledKeys(n, 6);
+
+    cout << left << setw(22) << "ns" << right << setw(10) << "p50" << setw(10) << "p90"
+         << setw(10) << "p99" << setw(10) << "p99.9" << setw(10) << "max" << endl;
+    run<AVLTree<uint64_t, uint64_t> >("avl", keys, removeOrder);
+    run<TopDownAVLTree<uint64_t, uint64_t> >("avl-topdown", keys, removeOrder);
+    return 0;
+}
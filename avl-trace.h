@@ -0,0 +1,352 @@
+#ifndef AVL_TRACE_H
+#define AVL_TRACE_H
+
+/**
+* Latency and shape tracing for AVLTree, compiled in with -DAVL_TRACE (see
+* the Makefile). Traced per thread:
+*   - latency histograms of insert, remove, find and iterator increments
+*     (the last two live in BinarySearchTree, which AVLTree inherits them
+*     from, so every tree gets them)
+*   - the number of nodes visited on the search path of each insert,
+*     remove and find
+*   - rotations done by insert_fix / remove_fix, per operation
+*
+* Latency histograms are log-linear (8 sub-buckets per power of two, so any
+* quantile is within 12.5%) and count timestamp-counter ticks; the export
+* converts them to ns. Each thread only writes its own counters, with
+* relaxed atomic loads/stores (no locked instructions), so recording costs
+* two timestamp reads and a few increments. avlTraceReport() can be called
+* from any thread at any time.
+*
+* Without AVL_TRACE the macros expand to nothing.
+*/
+
+enum AvlTraceOp { AVL_TRACE_INSERT, AVL_TRACE_REMOVE, AVL_TRACE_FIND, AVL_TRACE_NEXT, AVL_TRACE_OPS };
+
+#ifdef AVL_TRACE
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define AVL_TRACE_SCOPE(op) AvlTraceScope avl_trace_scope_(op)
+#define AVL_TRACE_STEP() (avlTraceThread().steps++)
+#define AVL_TRACE_ROTATION() avlTraceThread().rotation()
+
+/**
+* Ticks of the fastest clock available: the TSC on x86, else ns.
+*/
+inline uint64_t avlTraceTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline uint64_t avlTraceNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* A counter written by one thread and read by any: plain relaxed load and
+* store instead of an atomic add.
+*/
+inline void avlTraceBump(std::atomic<uint64_t>& counter, uint64_t by = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+struct AvlTraceHistogram {
+    static const int SUB_BITS = 3;
+    static const int SUB = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    AvlTraceHistogram() : sum(0), max(0)
+    {
+        for(int b = 0; b < BUCKETS; b++){
+            buckets[b].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static int bucketOf(uint64_t value)
+    {
+        if(value < SUB) return static_cast<int>(value);
+        int msb = 63 - __builtin_clzll(value);
+        return (msb - SUB_BITS + 1) * SUB + static_cast<int>((value >> (msb - SUB_BITS)) & (SUB - 1));
+    }
+
+    // Smallest value that falls into bucket
+    static uint64_t bucketLow(int bucket)
+    {
+        if(bucket < SUB) return bucket;
+        return static_cast<uint64_t>(SUB + bucket % SUB) << (bucket / SUB - 1);
+    }
+
+    void record(uint64_t value)
+    {
+        avlTraceBump(buckets[bucketOf(value)]);
+        avlTraceBump(sum, value);
+        if(value > max.load(std::memory_order_relaxed)){
+            max.store(value, std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+* Everything one thread records. Threads register theirs once and they are
+* never freed, so a report still sees threads that exited.
+*/
+struct AvlTraceThread {
+    static const int MAX_PATH = 128;
+
+    AvlTraceHistogram latency[AVL_TRACE_OPS];
+    std::atomic<uint64_t> pathLengths[AVL_TRACE_OPS][MAX_PATH];
+    std::atomic<uint64_t> rotations[AVL_TRACE_OPS];
+
+    // search path length and kind of the operation in progress
+    unsigned int steps;
+    int op;
+
+    AvlTraceThread() : steps(0), op(AVL_TRACE_FIND)
+    {
+        for(int o = 0; o < AVL_TRACE_OPS; o++){
+            rotations[o].store(0, std::memory_order_relaxed);
+            for(int p = 0; p < MAX_PATH; p++){
+                pathLengths[o][p].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void rotation()
+    {
+        avlTraceBump(rotations[op]);
+    }
+};
+
+struct AvlTraceRegistry {
+    std::mutex lock;
+    std::vector<AvlTraceThread*> threads;
+    uint64_t startTicks;
+    uint64_t startNs;
+
+    AvlTraceRegistry() : startTicks(avlTraceTicks()), startNs(avlTraceNowNs()) {}
+};
+
+inline AvlTraceRegistry& avlTraceRegistry()
+{
+    static AvlTraceRegistry registry;
+    return registry;
+}
+
+inline AvlTraceThread& avlTraceThread()
+{
+    static thread_local AvlTraceThread* self = nullptr;
+    if(self == nullptr){
+        self = new AvlTraceThread();
+        AvlTraceRegistry& registry = avlTraceRegistry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.threads.push_back(self);
+    }
+    return *self;
+}
+
+/**
+* Times the enclosing block as one operation and records its search path
+* length (the AVL_TRACE_STEPs taken inside it).
+*/
+class AvlTraceScope
+{
+public:
+    explicit AvlTraceScope(AvlTraceOp op) : thread_(avlTraceThread())
+    {
+        outer_op_ = thread_.op;
+        outer_steps_ = thread_.steps;
+        thread_.op = op;
+        thread_.steps = 0;
+        start_ = avlTraceTicks();
+    }
+
+    ~AvlTraceScope()
+    {
+        uint64_t ticks = avlTraceTicks() - start_;
+        int op = thread_.op;
+        thread_.latency[op].record(ticks);
+        unsigned int steps = thread_.steps < AvlTraceThread::MAX_PATH ? thread_.steps : AvlTraceThread::MAX_PATH - 1;
+        if(op != AVL_TRACE_NEXT){
+            avlTraceBump(thread_.pathLengths[op][steps]);
+        }
+        thread_.op = outer_op_;
+        thread_.steps = outer_steps_;
+    }
+
+private:
+    AvlTraceScope(const AvlTraceScope&);
+    AvlTraceScope& operator=(const AvlTraceScope&);
+
+    AvlTraceThread& thread_;
+    uint64_t start_;
+    int outer_op_;
+    unsigned int outer_steps_;
+};
+
+/**
+* Zeroes the counters of all threads. Operations running at the same time
+* may be partly lost.
+*/
+inline void avlTraceReset()
+{
+    AvlTraceRegistry& registry = avlTraceRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for(size_t t = 0; t < registry.threads.size(); t++){
+        AvlTraceThread& thread = *registry.threads[t];
+        for(int op = 0; op < AVL_TRACE_OPS; op++){
+            for(int b = 0; b < AvlTraceHistogram::BUCKETS; b++){
+                thread.latency[op].buckets[b].store(0, std::memory_order_relaxed);
+            }
+            thread.latency[op].sum.store(0, std::memory_order_relaxed);
+            thread.latency[op].max.store(0, std::memory_order_relaxed);
+            thread.rotations[op].store(0, std::memory_order_relaxed);
+            for(int p = 0; p < AvlTraceThread::MAX_PATH; p++){
+                thread.pathLengths[op][p].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/**
+* Merged view of all threads, in ns.
+*/
+struct AvlTraceSummary {
+    uint64_t count;
+    double meanNs;
+    double p50Ns, p90Ns, p99Ns, p999Ns, maxNs;
+    double meanPath;
+    unsigned int maxPath;
+    uint64_t rotations;
+};
+
+inline void avlTraceSummarize(AvlTraceSummary summary[AVL_TRACE_OPS])
+{
+    std::vector<uint64_t> buckets(AvlTraceHistogram::BUCKETS);
+    AvlTraceRegistry& registry = avlTraceRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+
+    uint64_t ticks = avlTraceTicks() - registry.startTicks;
+    uint64_t ns = avlTraceNowNs() - registry.startNs;
+    double nsPerTick = ticks ? static_cast<double>(ns) / ticks : 1.0;
+
+    for(int op = 0; op < AVL_TRACE_OPS; op++){
+        AvlTraceSummary& s = summary[op];
+        std::fill(buckets.begin(), buckets.end(), 0);
+        uint64_t maxTicks = 0, sumTicks = 0, pathCount = 0, pathSum = 0;
+        s.rotations = 0;
+        s.maxPath = 0;
+        for(size_t t = 0; t < registry.threads.size(); t++){
+            AvlTraceThread& thread = *registry.threads[t];
+            for(int b = 0; b < AvlTraceHistogram::BUCKETS; b++){
+                buckets[b] += thread.latency[op].buckets[b].load(std::memory_order_relaxed);
+            }
+            sumTicks += thread.latency[op].sum.load(std::memory_order_relaxed);
+            maxTicks = std::max(maxTicks, thread.latency[op].max.load(std::memory_order_relaxed));
+            for(unsigned int p = 0; p < AvlTraceThread::MAX_PATH; p++){
+                uint64_t c = thread.pathLengths[op][p].load(std::memory_order_relaxed);
+                pathCount += c;
+                pathSum += c * p;
+                if(c != 0 && p > s.maxPath) s.maxPath = p;
+            }
+            s.rotations += thread.rotations[op].load(std::memory_order_relaxed);
+        }
+
+        s.count = 0;
+        for(int b = 0; b < AvlTraceHistogram::BUCKETS; b++){
+            s.count += buckets[b];
+        }
+        s.meanNs = s.count ? static_cast<double>(sumTicks) / s.count * nsPerTick : 0;
+        s.meanPath = pathCount ? static_cast<double>(pathSum) / pathCount : 0;
+        s.maxNs = maxTicks * nsPerTick;
+
+        const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+        double* out[] = { &s.p50Ns, &s.p90Ns, &s.p99Ns, &s.p999Ns };
+        for(int q = 0; q < 4; q++){
+            uint64_t rank = static_cast<uint64_t>(qs[q] * s.count);
+            uint64_t seen = 0;
+            *out[q] = 0;
+            for(int b = 0; b < AvlTraceHistogram::BUCKETS; b++){
+                seen += buckets[b];
+                if(seen > rank){
+                    *out[q] = AvlTraceHistogram::bucketLow(b) * nsPerTick;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+* Writes the merged summary as a table, or as a JSON object keyed by
+* operation when json is true.
+*/
+inline void avlTraceReport(std::ostream& out, bool json = false)
+{
+    static const char* names[AVL_TRACE_OPS] = { "insert", "remove", "find", "next" };
+    AvlTraceSummary summary[AVL_TRACE_OPS];
+    avlTraceSummarize(summary);
+
+    out << std::fixed << std::setprecision(1);
+    if(json){
+        out << "{";
+        for(int op = 0; op < AVL_TRACE_OPS; op++){
+            const AvlTraceSummary& s = summary[op];
+            out << (op ? ", " : "") << "\"" << names[op] << "\": {\"count\": " << s.count
+                << ", \"mean_ns\": " << s.meanNs << ", \"p50_ns\": " << s.p50Ns
+                << ", \"p90_ns\": " << s.p90Ns << ", \"p99_ns\": " << s.p99Ns
+                << ", \"p999_ns\": " << s.p999Ns << ", \"max_ns\": " << s.maxNs
+                << ", \"mean_path\": " << s.meanPath << ", \"max_path\": " << s.maxPath
+                << ", \"rotations\": " << s.rotations << "}";
+        }
+        out << "}" << std::endl;
+        return;
+    }
+
+    out << std::left << std::setw(8) << "op" << std::right << std::setw(12) << "count"
+        << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+        << std::setw(10) << "p99" << std::setw(10) << "p999" << std::setw(12) << "max"
+        << std::setw(8) << "path" << std::setw(8) << "maxpath" << std::setw(12) << "rotations"
+        << "   (ns)" << std::endl;
+    for(int op = 0; op < AVL_TRACE_OPS; op++){
+        const AvlTraceSummary& s = summary[op];
+        if(s.count == 0) continue;
+        out << std::left << std::setw(8) << names[op] << std::right << std::setw(12) << s.count
+            << std::setw(10) << s.meanNs << std::setw(10) << s.p50Ns << std::setw(10) << s.p90Ns
+            << std::setw(10) << s.p99Ns << std::setw(10) << s.p999Ns << std::setw(12) << s.maxNs
+            << std::setw(8) << s.meanPath << std::setw(8) << s.maxPath << std::setw(12) << s.rotations
+            << std::endl;
+    }
+}
+
+#else
+
+#define AVL_TRACE_SCOPE(op) ((void)0)
+#define AVL_TRACE_STEP() ((void)0)
+#define AVL_TRACE_ROTATION() ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef AVLAGGREGATE_H
+#define AVLAGGREGATE_H
+
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "avlbst.h"
+
+/**
+* Aggregate policies for AggregateAVLTree. A policy is a monoid: a type,
+* its identity, an associative combine, and lift, which turns one Value
+* into the type. combine need not be commutative; items are always
+* combined in key order.
+*/
+template <typename V>
+struct SumAggregate {
+    typedef V type;
+
+    static type identity() { return V(); }
+    static type lift(const V& value) { return value; }
+    static type combine(const type& a, const type& b) { return a + b; }
+};
+
+template <typename V>
+struct MinAggregate {
+    typedef V type;
+
+    static type identity() { return std::numeric_limits<V>::max(); }
+    static type lift(const V& value) { return value; }
+    static type combine(const type& a, const type& b) { return std::min(a, b); }
+};
+
+template <typename V>
+struct MaxAggregate {
+    typedef V type;
+
+    static type identity() { return std::numeric_limits<V>::lowest(); }
+    static type lift(const V& value) { return value; }
+    static type combine(const type& a, const type& b) { return std::max(a, b); }
+};
+
+/**
+* An AVLNode that also stores the aggregate of the values in its subtree.
+*/
+template <typename Key, typename Value, typename Aggregate>
+class AggregateAVLNode : public AVLNode<Key, Value>
+{
+public:
+    typedef typename Aggregate::type Summary;
+
+    AggregateAVLNode(const Key& key, const Value& value, AggregateAVLNode<Key, Value, Aggregate>* parent);
+    virtual ~AggregateAVLNode();
+
+    const Summary& getSummary() const;
+    void setSummary(const Summary& summary);
+
+    virtual AggregateAVLNode<Key, Value, Aggregate>* getParent() const override;
+    virtual AggregateAVLNode<Key, Value, Aggregate>* getLeft() const override;
+    virtual AggregateAVLNode<Key, Value, Aggregate>* getRight() const override;
+    virtual size_t footprint() const override;
+    virtual Node<Key, Value>* cloneInto(void* where) const override;
+
+protected:
+    Summary summary_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AggregateAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Aggregate>
+AggregateAVLNode<Key, Value, Aggregate>::AggregateAVLNode(const Key& key, const Value& value, AggregateAVLNode<Key, Value, Aggregate> *parent) :
+    AVLNode<Key, Value>(key, value, parent), summary_(Aggregate::lift(value))
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+AggregateAVLNode<Key, Value, Aggregate>::~AggregateAVLNode()
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+const typename AggregateAVLNode<Key, Value, Aggregate>::Summary& AggregateAVLNode<Key, Value, Aggregate>::getSummary() const
+{
+    return summary_;
+}
+
+template<class Key, class Value, class Aggregate>
+void AggregateAVLNode<Key, Value, Aggregate>::setSummary(const Summary& summary)
+{
+    summary_ = summary;
+}
+
+template<class Key, class Value, class Aggregate>
+AggregateAVLNode<Key, Value, Aggregate> *AggregateAVLNode<Key, Value, Aggregate>::getParent() const
+{
+    return static_cast<AggregateAVLNode<Key, Value, Aggregate>*>(this->parent_);
+}
+
+template<class Key, class Value, class Aggregate>
+AggregateAVLNode<Key, Value, Aggregate> *AggregateAVLNode<Key, Value, Aggregate>::getLeft() const
+{
+    return static_cast<AggregateAVLNode<Key, Value, Aggregate>*>(this->left_);
+}
+
+template<class Key, class Value, class Aggregate>
+AggregateAVLNode<Key, Value, Aggregate> *AggregateAVLNode<Key, Value, Aggregate>::getRight() const
+{
+    return static_cast<AggregateAVLNode<Key, Value, Aggregate>*>(this->right_);
+}
+
+template<class Key, class Value, class Aggregate>
+size_t AggregateAVLNode<Key, Value, Aggregate>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value, class Aggregate>
+Node<Key, Value>* AggregateAVLNode<Key, Value, Aggregate>::cloneInto(void* where) const
+{
+    return new (where) AggregateAVLNode<Key, Value, Aggregate>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AggregateAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree whose nodes keep the aggregate (see SumAggregate etc.) of the
+* values in their subtree, so the aggregate over any key range takes
+* O(log n) instead of a walk over the range:
+*
+*   AggregateAVLTree<uint64_t, int64_t, SumAggregate<int64_t> > tree;
+*   int64_t total = tree.aggregate(lo, hi);   // sum over lo <= key <= hi
+*
+* The summaries are kept through AVLTree's pullUp hooks, after every
+* rotation and along the changed path of each insert and remove.
+* Overwriting a value with insert updates them too, but writing through
+* an iterator does not, so the non-const operator[] is not offered.
+*/
+template <class Key, class Value, class Aggregate = SumAggregate<Value> >
+class AggregateAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename Aggregate::type Summary;
+
+    Summary aggregate(const Key& lo, const Key& hi) const;
+    Summary aggregate() const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef AggregateAVLNode<Key, Value, Aggregate> ANode;
+
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void pullUp(AVLNode<Key, Value>* node);
+    virtual void pullUpPath(AVLNode<Key, Value>* node);
+
+    static const Summary& summaryOf(const Node<Key, Value>* node);
+    static void resummarize(Node<Key, Value>* node);
+    static Summary atLeast(const Node<Key, Value>* current, const Key& lo);
+    static Summary atMost(const Node<Key, Value>* current, const Key& hi);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the AggregateAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value, class Aggregate>
+AVLNode<Key, Value>* AggregateAVLTree<Key, Value, Aggregate>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new ANode(key, value, static_cast<ANode*>(parent));
+}
+
+/**
+* The summary of node's subtree; the identity for an empty one.
+*/
+template<class Key, class Value, class Aggregate>
+const typename AggregateAVLTree<Key, Value, Aggregate>::Summary& AggregateAVLTree<Key, Value, Aggregate>::summaryOf(const Node<Key, Value>* node)
+{
+    static const Summary empty = Aggregate::identity();
+    return node == nullptr ? empty : static_cast<const ANode*>(node)->getSummary();
+}
+
+template<class Key, class Value, class Aggregate>
+void AggregateAVLTree<Key, Value, Aggregate>::resummarize(Node<Key, Value>* node)
+{
+    static_cast<ANode*>(node)->setSummary(Aggregate::combine(
+        Aggregate::combine(summaryOf(node->child(false)), Aggregate::lift(node->getValue())),
+        summaryOf(node->child(true))));
+}
+
+template<class Key, class Value, class Aggregate>
+void AggregateAVLTree<Key, Value, Aggregate>::pullUp(AVLNode<Key, Value>* node)
+{
+    resummarize(node);
+}
+
+template<class Key, class Value, class Aggregate>
+void AggregateAVLTree<Key, Value, Aggregate>::pullUpPath(AVLNode<Key, Value>* node)
+{
+    for(Node<Key, Value>* curr = node; curr != nullptr; curr = curr->parent()){
+        resummarize(curr);
+    }
+}
+
+/**
+* The aggregate of the values in current's subtree with a key not less
+* than lo. Follows one path down, taking whole right subtrees on the way.
+*/
+template<class Key, class Value, class Aggregate>
+typename AggregateAVLTree<Key, Value, Aggregate>::Summary
+AggregateAVLTree<Key, Value, Aggregate>::atLeast(const Node<Key, Value>* current, const Key& lo)
+{
+    if(current == nullptr){
+        return Aggregate::identity();
+    }
+    if(current->getKey() < lo){
+        return atLeast(current->child(true), lo);
+    }
+    return Aggregate::combine(
+        Aggregate::combine(atLeast(current->child(false), lo), Aggregate::lift(current->getValue())),
+        summaryOf(current->child(true)));
+}
+
+/**
+* The aggregate of the values in current's subtree with a key not greater
+* than hi.
+*/
+template<class Key, class Value, class Aggregate>
+typename AggregateAVLTree<Key, Value, Aggregate>::Summary
+AggregateAVLTree<Key, Value, Aggregate>::atMost(const Node<Key, Value>* current, const Key& hi)
+{
+    if(current == nullptr){
+        return Aggregate::identity();
+    }
+    if(hi < current->getKey()){
+        return atMost(current->child(false), hi);
+    }
+    return Aggregate::combine(
+        Aggregate::combine(summaryOf(current->child(false)), Aggregate::lift(current->getValue())),
+        atMost(current->child(true), hi));
+}
+
+/**
+* The aggregate, in key order, of the values with lo <= key <= hi (the
+* identity if there are none). Searches down to the first node inside
+* the range, then follows the lo and hi boundaries below it: O(log n).
+*/
+template<class Key, class Value, class Aggregate>
+typename AggregateAVLTree<Key, Value, Aggregate>::Summary
+AggregateAVLTree<Key, Value, Aggregate>::aggregate(const Key& lo, const Key& hi) const
+{
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    const Node<Key, Value>* curr = this->root_;
+    while(curr != nullptr){
+        if(curr->getKey() < lo){
+            curr = curr->child(true);
+        } else if(hi < curr->getKey()){
+            curr = curr->child(false);
+        } else {
+            return Aggregate::combine(
+                Aggregate::combine(atLeast(curr->child(false), lo), Aggregate::lift(curr->getValue())),
+                atMost(curr->child(true), hi));
+        }
+    }
+    return Aggregate::identity();
+}
+
+/**
+* The aggregate of every value in the tree. O(1).
+*/
+template<class Key, class Value, class Aggregate>
+typename AggregateAVLTree<Key, Value, Aggregate>::Summary
+AggregateAVLTree<Key, Value, Aggregate>::aggregate() const
+{
+    return summaryOf(this->root_);
+}
+
+template<class Key, class Value, class Aggregate>
+Value const & AggregateAVLTree<Key, Value, Aggregate>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value>::operator[](key);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the AggregateAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
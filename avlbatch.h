@@ -0,0 +1,325 @@
+#ifndef AVLBATCH_H
+#define AVLBATCH_H
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include "avlbst.h"
+
+/**
+* One update in a batch: an insert (or overwrite) of key with value, or a
+* remove of key.
+*/
+template <typename Key, typename Value>
+struct BatchUpdate {
+    enum Op { PUT, ERASE };
+
+    Key key;
+    Value value;
+    Op op;
+
+    static BatchUpdate put(const Key& key, const Value& value)
+    {
+        BatchUpdate update = { key, value, PUT };
+        return update;
+    }
+
+    static BatchUpdate erase(const Key& key)
+    {
+        BatchUpdate update = { key, Value(), ERASE };
+        return update;
+    }
+};
+
+/**
+* An AVLTree that applies bursts of updates as one batch.
+*
+* applyBatch sorts the batch by key and keeps only the last update per key
+* (last writer wins), then applies it in key order with a finger: each
+* search starts from the node the previous update touched and climbs only
+* as far as needed, so m sorted updates on n items cost O(m log(n/m))
+* rather than O(m log n), and stay on the same few root-to-leaf paths.
+*
+* Given threads > 1 and a batch about as large as the tree, it instead
+* merges the batch into the tree's nodes in key order and relinks them
+* balanced, rebalancing once instead of per update and reusing every
+* surviving node. The merge is split over disjoint key ranges and disjoint
+* subtrees are relinked on separate threads. On one thread the finger
+* path is faster at every batch size we measured (the relink touches
+* every node), so it is only worth it when the work can be spread out.
+*/
+template <class Key, class Value>
+class BatchedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    static const size_t PARALLEL_MIN = 1 << 14;
+    static const size_t FINGER_SPACING = 64;
+
+    void applyBatch(std::vector<BatchUpdate<Key, Value> > batch, unsigned int threads = 1);
+
+protected:
+    static bool updateLess(const BatchUpdate<Key, Value>& a, const BatchUpdate<Key, Value>& b);
+    static bool nodeLess(const AVLNode<Key, Value>* node, const Key& key);
+    static AVLNode<Key, Value>* nextNode(AVLNode<Key, Value>* current);
+
+    void mergeRange(const std::vector<AVLNode<Key, Value>*>& nodes, size_t nodeLo, size_t nodeHi,
+                    const std::vector<BatchUpdate<Key, Value> >& batch, size_t lo, size_t hi,
+                    std::vector<AVLNode<Key, Value>*>& out, std::vector<AVLNode<Key, Value>*>& dead);
+    void applyWithFinger(const std::vector<BatchUpdate<Key, Value> >& batch, bool climb);
+    void mergeRebuild(const std::vector<BatchUpdate<Key, Value> >& batch, unsigned int threads);
+    AVLNode<Key, Value>* relink(const std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi,
+                                AVLNode<Key, Value>* parent, int& height, unsigned int threads);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BatchedAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+void BatchedAVLTree<Key, Value>::applyBatch(std::vector<BatchUpdate<Key, Value> > batch, unsigned int threads)
+{
+    // keep the last update for each key (stable sort preserves batch order)
+    std::stable_sort(batch.begin(), batch.end(), updateLess);
+    size_t kept = 0;
+    for(size_t i = 0; i < batch.size(); i++){
+        if(i + 1 < batch.size() && !(batch[i].key < batch[i + 1].key)){
+            continue;
+        }
+        batch[kept++] = batch[i];
+    }
+    batch.resize(kept);
+    if(batch.empty()){
+        return;
+    }
+
+    // an AVL tree of height h holds between about 1.618^h and 2^h - 1
+    // items; 2^(h-1) estimates its size without walking it
+    size_t height = this->checkedHeight(static_cast<AVLNode<Key, Value>*>(this->root_));
+    size_t size = height >= 64 ? SIZE_MAX : (size_t(1) << height) / 2;
+    if(threads > 1 && batch.size() >= size){
+        mergeRebuild(batch, threads);
+    } else {
+        // with updates more than ~64 keys apart the climb from the finger
+        // goes most of the way to the root anyway, so start from there
+        applyWithFinger(batch, batch.size() * FINGER_SPACING >= size);
+    }
+}
+
+template<class Key, class Value>
+bool BatchedAVLTree<Key, Value>::updateLess(const BatchUpdate<Key, Value>& a, const BatchUpdate<Key, Value>& b)
+{
+    return a.key < b.key;
+}
+
+template<class Key, class Value>
+bool BatchedAVLTree<Key, Value>::nodeLess(const AVLNode<Key, Value>* node, const Key& key)
+{
+    return node->getKey() < key;
+}
+
+/**
+* Applies a sorted, deduplicated batch one update at a time, each search
+* starting from the node the previous update left behind: the node it
+* inserted or overwrote, the predecessor of the node it removed, or where
+* the search for a missing key ended. Without climb every search starts
+* from the root.
+*/
+template<class Key, class Value>
+void BatchedAVLTree<Key, Value>::applyWithFinger(const std::vector<BatchUpdate<Key, Value> >& batch, bool climb)
+{
+    AVLNode<Key, Value>* finger = nullptr;
+    for(size_t i = 0; i < batch.size(); i++){
+        const BatchUpdate<Key, Value>& update = batch[i];
+        if(this->root_ == nullptr){
+            if(update.op == BatchUpdate<Key, Value>::PUT){
+                AVLTree<Key, Value>::insert(std::make_pair(update.key, update.value));
+                finger = static_cast<AVLNode<Key, Value>*>(this->root_);
+            }
+            continue;
+        }
+        AVLNode<Key, Value>* found = static_cast<AVLNode<Key, Value>*>(this->fingerSearch(climb ? finger : nullptr, update.key));
+        if(update.op == BatchUpdate<Key, Value>::PUT){
+            finger = this->insert_at(found, std::make_pair(update.key, update.value));
+        } else if(found->getKey() == update.key){
+            finger = static_cast<AVLNode<Key, Value>*>(this->predecessor(found));
+            this->remove_at(found);
+        } else {
+            finger = found;
+        }
+    }
+}
+
+/**
+* The next node in key order, or null after the last one.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* BatchedAVLTree<Key, Value>::nextNode(AVLNode<Key, Value>* current)
+{
+    if(current->getRight() != nullptr){
+        current = current->getRight();
+        while(current->getLeft() != nullptr){
+            current = current->getLeft();
+        }
+        return current;
+    }
+    AVLNode<Key, Value>* parent = current->getParent();
+    while(parent != nullptr && parent->getRight() == current){
+        current = parent;
+        parent = current->getParent();
+    }
+    return parent;
+}
+
+/**
+* Merges nodes[nodeLo, nodeHi) with batch[lo, hi) into out: nodes the
+* batch does not touch are kept, puts overwrite the value in place or add
+* a new node (made by createNode), and erased nodes go to dead. Runs on
+* several threads at once, over disjoint ranges.
+*/
+template<class Key, class Value>
+void BatchedAVLTree<Key, Value>::mergeRange(const std::vector<AVLNode<Key, Value>*>& nodes, size_t nodeLo, size_t nodeHi,
+                                            const std::vector<BatchUpdate<Key, Value> >& batch, size_t lo, size_t hi,
+                                            std::vector<AVLNode<Key, Value>*>& out, std::vector<AVLNode<Key, Value>*>& dead)
+{
+    out.reserve(out.size() + (nodeHi - nodeLo) + (hi - lo));
+    size_t i = nodeLo;
+    size_t j = lo;
+    while(i < nodeHi || j < hi){
+        if(j == hi || (i < nodeHi && nodes[i]->getKey() < batch[j].key)){
+            out.push_back(nodes[i]);
+            i++;
+            continue;
+        }
+        bool exists = i < nodeHi && !(batch[j].key < nodes[i]->getKey());
+        if(batch[j].op == BatchUpdate<Key, Value>::PUT){
+            if(exists){
+                nodes[i]->setValue(batch[j].value);
+                out.push_back(nodes[i]);
+            } else {
+                out.push_back(this->createNode(batch[j].key, batch[j].value, nullptr));
+            }
+        } else if(exists){
+            dead.push_back(nodes[i]);
+        }
+        if(exists){
+            i++;
+        }
+        j++;
+    }
+}
+
+/**
+* Merges the batch into the tree's nodes in key order and relinks them
+* into a balanced tree, reusing every surviving node. With several threads
+* the batch is cut into equal parts, each merged with the nodes in its key
+* range on its own thread.
+*/
+template<class Key, class Value>
+void BatchedAVLTree<Key, Value>::mergeRebuild(const std::vector<BatchUpdate<Key, Value> >& batch, unsigned int threads)
+{
+    std::vector<AVLNode<Key, Value>*> nodes;
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while(current != nullptr && current->getLeft() != nullptr){
+        current = current->getLeft();
+    }
+    for(; current != nullptr; current = nextNode(current)){
+        nodes.push_back(current);
+    }
+
+    size_t parts = std::min<size_t>(threads, std::max<size_t>(1, (nodes.size() + batch.size()) / PARALLEL_MIN));
+    // part p takes batch[batchLo[p], batchLo[p+1]) and the nodes below batch[batchLo[p+1]]
+    std::vector<size_t> batchLo(parts + 1);
+    std::vector<size_t> nodeLo(parts + 1);
+    for(size_t p = 0; p <= parts; p++){
+        batchLo[p] = batch.size() * p / parts;
+    }
+    nodeLo[0] = 0;
+    nodeLo[parts] = nodes.size();
+    for(size_t p = 1; p < parts; p++){
+        nodeLo[p] = std::lower_bound(nodes.begin(), nodes.end(), batch[batchLo[p]].key, nodeLess) - nodes.begin();
+    }
+    std::vector<std::vector<AVLNode<Key, Value>*> > outs(parts);
+    std::vector<std::vector<AVLNode<Key, Value>*> > dead(parts);
+    std::vector<std::thread> workers;
+    for(size_t p = 1; p < parts; p++){
+        workers.push_back(std::thread(&BatchedAVLTree<Key, Value>::mergeRange, this, std::cref(nodes), nodeLo[p], nodeLo[p + 1],
+                                      std::cref(batch), batchLo[p], batchLo[p + 1], std::ref(outs[p]), std::ref(dead[p])));
+    }
+    mergeRange(nodes, nodeLo[0], nodeLo[1], batch, batchLo[0], batchLo[1], outs[0], dead[0]);
+    for(size_t t = 0; t < workers.size(); t++){
+        workers[t].join();
+    }
+
+    std::vector<AVLNode<Key, Value>*> merged;
+    if(parts == 1){
+        merged.swap(outs[0]);
+    } else {
+        size_t total = 0;
+        for(size_t p = 0; p < parts; p++){
+            total += outs[p].size();
+        }
+        merged.reserve(total);
+        for(size_t p = 0; p < parts; p++){
+            merged.insert(merged.end(), outs[p].begin(), outs[p].end());
+        }
+    }
+    for(size_t p = 0; p < parts; p++){
+        for(size_t i = 0; i < dead[p].size(); i++){
+            this->destroyNode(dead[p][i]);
+        }
+    }
+
+    int height = 0;
+    this->setRoot(relink(merged, 0, merged.size(), nullptr, height, threads));
+}
+
+/**
+* Links nodes[lo, hi) into a balanced subtree under parent (the shape
+* build_helper gives) and returns its root. Each node is pulled up once
+* its children are linked, so augmented subclasses get fresh summaries. The subtrees of the top levels
+* are linked on separate threads until threads runs out.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* BatchedAVLTree<Key, Value>::relink(const std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi,
+                                                        AVLNode<Key, Value>* parent, int& height, unsigned int threads)
+{
+    if(lo >= hi){
+        height = 0;
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key, Value>* current = nodes[mid];
+    int left_height = 0;
+    int right_height = 0;
+    AVLNode<Key, Value>* left = nullptr;
+    AVLNode<Key, Value>* right = nullptr;
+    if(threads > 1 && hi - lo >= PARALLEL_MIN){
+        std::thread worker([&]() {
+            left = relink(nodes, lo, mid, current, left_height, threads / 2);
+        });
+        right = relink(nodes, mid + 1, hi, current, right_height, threads - threads / 2);
+        worker.join();
+    } else {
+        left = relink(nodes, lo, mid, current, left_height, 1);
+        right = relink(nodes, mid + 1, hi, current, right_height, 1);
+    }
+    current->setParent(parent);
+    current->setLeft(left);
+    current->setRight(right);
+    current->setBalance(static_cast<int8_t>(right_height - left_height));
+    this->pullUp(current);
+    height = 1 + std::max(left_height, right_height);
+    return current;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BatchedAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -10,6 +10,16 @@
 
 struct KeyError { };
 
+/**
+* With -DBST_VALIDATE, AVLTree also checks the balances on the touched path
+* after every insert/remove (see checkBalancePath).
+*/
+#ifdef BST_VALIDATE
+#define AVL_CHECK_PATH(tree, node) (tree)->checkBalancePath(node)
+#else
+#define AVL_CHECK_PATH(tree, node) ((void)0)
+#endif
+
 /**
 * A special kind of node for an AVL tree, which adds the balance as a data member, plus
 * other additional helper functions. You do NOT need to implement any functionality or
@@ -34,6 +44,8 @@ public:
     virtual AVLNode<Key, Value>* getParent() const override;
     virtual AVLNode<Key, Value>* getLeft() const override;
     virtual AVLNode<Key, Value>* getRight() const override;
+    virtual size_t footprint() const override;
+    virtual Node<Key, Value>* cloneInto(void* where) const override;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -119,6 +131,18 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
     return static_cast<AVLNode<Key, Value>*>(this->right_);
 }
 
+template<class Key, class Value>
+size_t AVLNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* AVLNode<Key, Value>::cloneInto(void* where) const
+{
+    return new (where) AVLNode<Key, Value>(*this);
+}
+
 
 /*
   -----------------------------------------------
@@ -133,17 +157,33 @@ class AVLTree : public BinarySearchTree<Key, Value>
 public:
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key &key); // TODO
+    virtual void buildFromSorted(const std::vector<std::pair<Key, Value> >& items);
 
 
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual Node<Key, Value>* insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item);
+    virtual void eraseNode(Node<Key, Value>* node);
+
+    // Augmentation hooks: trees that keep per-subtree data in their nodes
+    // (subtree sizes, say) create their own AVLNode subclass and recompute
+    // that data in pullUp, from the node's item and its children's data.
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void pullUp(AVLNode<Key, Value>* node);
+    virtual void pullUpPath(AVLNode<Key, Value>* node);
 
     // Add helper functions here
     void insert_fix(AVLNode<Key, Value> *parent, AVLNode<Key, Value> *current);
     void rotate_left(AVLNode<Key, Value> *current);
     void rotate_right(AVLNode<Key, Value> *current);
     AVLNode<Key, Value> *insert_traverse(AVLNode<Key, Value> *curr, const std::pair<const Key, Value> &keyValuePair); 
+    AVLNode<Key, Value> *insert_at(AVLNode<Key, Value> *curr_node, const std::pair<const Key, Value> &new_item);
+    AVLNode<Key, Value> *insert_child(AVLNode<Key, Value> *parent, bool right, const std::pair<const Key, Value> &new_item);
+    void remove_at(AVLNode<Key, Value> *remove_node);
     void remove_fix(AVLNode<Key, Value> *current, int diff);
+    void checkBalancePath(const AVLNode<Key, Value> *target) const;
+    static int checkedHeight(const AVLNode<Key, Value> *current);
+    AVLNode<Key, Value> *build_helper(const std::vector<std::pair<Key, Value> >& items, size_t lo, size_t hi, AVLNode<Key, Value> *parent, int& height);
 };
 
 /*
@@ -153,55 +193,106 @@ protected:
 template<class Key, class Value>
 void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
 {
+    AVL_TRACE_SCOPE(AVL_TRACE_INSERT);
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
     // TODO
 
     //first insert 
     if(this->root_ ==nullptr){
-        AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr); 
-        this->root_ = new_node;
+        AVLNode<Key, Value>* new_node = createNode(new_item.first, new_item.second, nullptr); 
+        this->setRoot(new_node);
         return;
     }
     
-    AVLNode<Key, Value>* curr_node = insert_traverse(static_cast<AVLNode<Key,Value>*>(this->root_), new_item);
+    AVLNode<Key, Value>* curr_node = BstSmallType<Key>::value
+        ? static_cast<AVLNode<Key, Value>*>(this->searchPath(new_item.first))
+        : insert_traverse(static_cast<AVLNode<Key,Value>*>(this->root_), new_item);
+    insert_at(curr_node, new_item);
+}
 
+/**
+* insertNear's hook: insert_at, or a plain insert into an empty tree.
+*/
+template<class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item)
+{
+    if(at == nullptr){
+        AVLTree<Key, Value>::insert(new_item);
+        return this->root_;
+    }
+    return insert_at(static_cast<AVLNode<Key, Value>*>(at), new_item);
+}
+
+/**
+* Finishes an insert once the search for new_item's key has ended at
+* curr_node: overwrites its value if the keys match, else hangs a new leaf
+* off it and rebalances. Returns the node holding new_item.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::insert_at(AVLNode<Key, Value> *curr_node, const std::pair<const Key, Value> &new_item)
+{
     if(curr_node->getKey() == new_item.first){
         curr_node->setValue(new_item.second);
-    }else if(curr_node->getKey() > new_item.first){
-        AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_item.first, new_item.second, curr_node); 
-        curr_node->setLeft(new_node);
+        pullUpPath(curr_node);
+        AVL_CHECK_PATH(this, curr_node);
+        return curr_node;
+    }
+    return insert_child(curr_node, curr_node->getKey() < new_item.first, new_item);
+}
 
-        AVLNode<Key, Value>* parent = curr_node;
-        parent->updateBalance(-1);
-        if(parent->getBalance() != 0){
-            insert_fix(parent, new_node);
-        }
-        // if(parent->getBalance() == 1){
-        //     parent->setBalance(0);
-        // } else if(parent->getBalance() == -1){
-        //     parent->setBalance(0);
-        // } else if(parent->getBalance() == 0){
-        //     parent->setBalance(-1);
-        //     insert_fix(parent, new_node);
-        // }
-
-    }else if(curr_node->getKey() < new_item.first){
-        AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_item.first, new_item.second, curr_node); 
-        curr_node->setRight(new_node);
-
-        AVLNode<Key, Value>* parent = curr_node;
+/**
+* Hangs a new node for new_item off parent's empty right (or left) side
+* and rebalances. Returns the new node.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::insert_child(AVLNode<Key, Value> *parent, bool right, const std::pair<const Key, Value> &new_item)
+{
+    AVLNode<Key, Value>* new_node = createNode(new_item.first, new_item.second, parent);
+    if(right){
+        parent->setRight(new_node);
         parent->updateBalance(1);
-        if(parent->getBalance() != 0){
-            insert_fix(parent, new_node);
-        }
-        // if(parent->getBalance() == -1){
-        //     parent->setBalance(0);
-        // } else if(parent->getBalance() == 1){
-        //     parent->setBalance(0);
-        // } else if(parent->getBalance() == 0){
-        //     parent->setBalance(1);
-        //     insert_fix(parent, new_node);
-        // }
+    } else {
+        parent->setLeft(new_node);
+        parent->updateBalance(-1);
+    }
+    if(parent->getBalance() != 0){
+        insert_fix(parent, new_node);
     }
+    pullUpPath(new_node);
+    AVL_CHECK_PATH(this, parent);
+    return new_node;
+}
+
+/**
+* Allocates the nodes for insert and buildFromSorted.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new AVLNode<Key, Value>(key, value, parent);
+}
+
+/**
+* Recomputes node's augmented data from its item and children. Called
+* for each node a rotation moves (children first), and by pullUpPath.
+* Plain AVL nodes have nothing to recompute.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::pullUp(AVLNode<Key, Value>* node)
+{
+
+}
+
+/**
+* Called once an insert or remove has finished rebalancing, with the
+* lowest node whose subtree changed; augmented trees pullUp every node
+* from there to the root. Rotations already pulled up the nodes they
+* moved off that path. A no-op for the plain AVLTree, so it pays nothing.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::pullUpPath(AVLNode<Key, Value>* node)
+{
+
 }
 
 template<class Key, class Value>
@@ -209,6 +300,7 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::insert_traverse(AVLNode<Key, Value> *c
     if(curr == nullptr){
         return curr;
     }
+    AVL_TRACE_STEP();
 
     if(curr->getKey() == keyValuePair.first){
         return curr;
@@ -311,58 +403,18 @@ void AVLTree<Key, Value>::insert_fix(AVLNode<Key, Value> *parent, AVLNode<Key, V
 
 template<class Key, class Value>
 void AVLTree<Key, Value>::rotate_left(AVLNode<Key, Value> *current){
-    AVLNode<Key, Value>* child = current->getRight();
-    AVLNode<Key, Value>* temp = child->getLeft();
-    AVLNode<Key, Value>* grand_parent = current->getParent();
-
-    //set child
-    if(grand_parent == nullptr){
-        this->root_ = child;
-        child->setParent(nullptr);
-    } else if(grand_parent->getLeft() == current){
-        child->setParent(grand_parent);
-        grand_parent->setLeft(child);
-    } else if(grand_parent->getRight() == current){
-        child->setParent(grand_parent);
-        grand_parent->setRight(child);
-    }
-
-    //set parent
-    child->setLeft(current);
-    current->setParent(child);
-    current->setRight(temp);
-    if(temp != nullptr){
-        temp->setParent(current);
-    }
+    AVL_TRACE_ROTATION();
+    BinarySearchTree<Key, Value>::rotate_left(current);
+    pullUp(current);
+    pullUp(current->getParent());
 }
 
 template<class Key, class Value>
 void AVLTree<Key, Value>::rotate_right(AVLNode<Key, Value> *current){
-    AVLNode<Key, Value>* child = current->getLeft();
-    AVLNode<Key, Value>* temp = child->getRight();
-    AVLNode<Key, Value>* grand_parent = current->getParent();
-
-
-    //set child
-    if(grand_parent == nullptr){
-        this->root_ = child;
-        child->setParent(nullptr);
-    } else if(grand_parent->getLeft() == current){
-        child->setParent(grand_parent);
-        grand_parent->setLeft(child);
-    } else if(grand_parent->getRight() == current){
-        child->setParent(grand_parent);
-        grand_parent->setRight(child);
-    }
-
-    //set parent
-    child->setRight(current);
-    current->setParent(child);
-    current->setLeft(temp);
-    if(temp != nullptr){
-        temp->setParent(current);
-    }
-
+    AVL_TRACE_ROTATION();
+    BinarySearchTree<Key, Value>::rotate_right(current);
+    pullUp(current);
+    pullUp(current->getParent());
 }
 
 
@@ -373,15 +425,43 @@ void AVLTree<Key, Value>::rotate_right(AVLNode<Key, Value> *current){
 template<class Key, class Value>
 void AVLTree<Key, Value>:: remove(const Key& key)
 {
+    AVL_TRACE_SCOPE(AVL_TRACE_REMOVE);
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
     // TODO
     AVLNode<Key, Value>* remove_node = static_cast<AVLNode<Key, Value>*>(this->traverse_helper_remove(key, this->root_));
     if(remove_node == nullptr){
         return;
     }
+    remove_at(remove_node);
+}
 
+/**
+* removeAt's hook.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    remove_at(static_cast<AVLNode<Key, Value>*>(node));
+}
+
+/**
+* Unlinks and frees remove_node, then rebalances.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::remove_at(AVLNode<Key, Value>* remove_node)
+{
     if(remove_node->getLeft() != nullptr && remove_node->getRight() != nullptr){
+        // the predecessor takes over the node's place and balance; its old
+        // spot (the right side of its parent, or the left side of itself if
+        // it was the node's left child) is what got shorter
         AVLNode<Key, Value>* pred_node = static_cast<AVLNode<Key, Value>*>(this->predecessor(remove_node));
-        this->nodeSwap(remove_node, pred_node);
+        pred_node->setBalance(remove_node->getBalance());
+        AVLNode<Key, Value>* shrunk = static_cast<AVLNode<Key, Value>*>(this->replaceWithPredecessor(remove_node, pred_node));
+        this->destroyNode(remove_node);
+        remove_fix(shrunk, shrunk == pred_node ? 1 : -1);
+        pullUpPath(shrunk);
+        AVL_CHECK_PATH(this, shrunk);
+        return;
     }
 
     AVLNode<Key, Value>* parent = remove_node->getParent();
@@ -401,21 +481,23 @@ void AVLTree<Key, Value>:: remove(const Key& key)
 
     if(right == nullptr && left == nullptr){
         if(parent == nullptr){
-            this->root_ = nullptr;
+            this->setRoot(nullptr);
         } else if(parent->getLeft() == remove_node){
             parent->setLeft(nullptr);
         } else{
             parent->setRight(nullptr);
         }
-        delete remove_node;
+        this->destroyNode(remove_node);
         remove_fix(parent, diff);
+        pullUpPath(parent);
+        AVL_CHECK_PATH(this, parent);
         return;
     }
     
     
     if(right != nullptr && left == nullptr){
         if(parent == nullptr){
-            this->root_ = right;
+            this->setRoot(right);
             right->setParent(nullptr);
         } else{
             if(parent->getLeft() == remove_node){
@@ -426,12 +508,14 @@ void AVLTree<Key, Value>:: remove(const Key& key)
             right->setParent(parent);
         }
 
-        delete remove_node;
+        this->destroyNode(remove_node);
         remove_fix(parent, diff);
+        pullUpPath(parent);
+        AVL_CHECK_PATH(this, parent);
         return;
     } else if(left != nullptr && right == nullptr){
         if(parent == nullptr){
-            this->root_ = left;
+            this->setRoot(left);
             left->setParent(nullptr);
         } else{
             if(parent->getLeft() == remove_node){
@@ -442,8 +526,10 @@ void AVLTree<Key, Value>:: remove(const Key& key)
             left->setParent(parent);
         }
 
-        delete remove_node;
+        this->destroyNode(remove_node);
         remove_fix(parent, diff);
+        pullUpPath(parent);
+        AVL_CHECK_PATH(this, parent);
         return;
     }
     return;
@@ -543,6 +629,87 @@ void AVLTree<Key, Value>::remove_fix(AVLNode<Key,Value>* current, int diff){
     }
 }
 
+/**
+* Bulk-builds a balanced AVL tree from items sorted by strictly increasing key,
+* replacing the current contents. Balances are set from the subtree heights
+* computed during the build, so no rotations are needed.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::buildFromSorted(const std::vector<std::pair<Key, Value> >& items)
+{
+    // the plain clear, as in BinarySearchTree::buildFromSorted
+    BinarySearchTree<Key, Value>::clear();
+    int height = 0;
+    this->setRoot(build_helper(items, 0, items.size(), nullptr, height));
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::build_helper(const std::vector<std::pair<Key, Value> >& items, size_t lo, size_t hi, AVLNode<Key, Value> *parent, int& height){
+    if(lo >= hi){
+        height = 0;
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key, Value>* current = createNode(items[mid].first, items[mid].second, parent);
+    int left_height = 0;
+    int right_height = 0;
+    current->setLeft(build_helper(items, lo, mid, current, left_height));
+    current->setRight(build_helper(items, mid + 1, hi, current, right_height));
+    current->setBalance(static_cast<int8_t>(right_height - left_height));
+    pullUp(current);
+    height = 1 + std::max(left_height, right_height);
+    return current;
+}
+
+/**
+* Checks the path from the root to target (see BinarySearchTree::checkPath),
+* that every balance on it is in [-1, 1], and that the balances of target,
+* its parent and its children match their subtree heights. Each of those
+* heights is found by following the taller child (O(log n)), so the check
+* stays O(log n); a wrong balance elsewhere is caught once an update
+* touches it.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::checkBalancePath(const AVLNode<Key, Value> *target) const
+{
+    this->checkPath(target);
+    if(target == nullptr){
+        // the path ended above the root (e.g. the root was removed)
+        target = static_cast<const AVLNode<Key, Value>*>(this->root_);
+        if(target == nullptr){
+            return;
+        }
+    }
+    for(const AVLNode<Key, Value>* curr = target->getParent(); curr != nullptr; curr = curr->getParent()){
+        if(curr->getBalance() < -1 || curr->getBalance() > 1){
+            throw std::logic_error("AVL invariant: balance out of range");
+        }
+    }
+    const AVLNode<Key, Value>* exact[] = { target, target->getParent(), target->getLeft(), target->getRight() };
+    for(size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++){
+        if(exact[i] != nullptr && exact[i]->getBalance() != checkedHeight(exact[i]->getRight()) - checkedHeight(exact[i]->getLeft())){
+            throw std::logic_error("AVL invariant: balance does not match subtree heights");
+        }
+    }
+}
+
+/**
+* Height of the subtree, assuming the balances below are right: follows the
+* taller child down to a leaf.
+*/
+template<class Key, class Value>
+int AVLTree<Key, Value>::checkedHeight(const AVLNode<Key, Value> *current)
+{
+    int height = 0;
+    while(current != nullptr){
+        if(current->getBalance() < -1 || current->getBalance() > 1){
+            throw std::logic_error("AVL invariant: balance out of range");
+        }
+        height++;
+        current = current->getBalance() > 0 ? current->getRight() : current->getLeft();
+    }
+    return height;
+}
 
 template<class Key, class Value>
 void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
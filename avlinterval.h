@@ -0,0 +1,251 @@
+#ifndef AVLINTERVAL_H
+#define AVLINTERVAL_H
+
+#include <iostream>
+#include <utility>
+#include <cstddef>
+#include "avlmulti.h"
+
+/**
+* A closed interval [low, high], ordered by low, then high.
+*/
+template <typename T>
+struct Interval {
+    T low;
+    T high;
+
+    Interval(const T& lo, const T& hi) : low(lo), high(hi) {}
+
+    bool operator==(const Interval& rhs) const { return !(low < rhs.low) && !(rhs.low < low) && !(high < rhs.high) && !(rhs.high < high); }
+    bool operator<(const Interval& rhs) const { return low < rhs.low || (!(rhs.low < low) && high < rhs.high); }
+    bool operator>(const Interval& rhs) const { return rhs < *this; }
+};
+
+template <typename T>
+std::ostream& operator<<(std::ostream& out, const Interval<T>& interval)
+{
+    return out << "[" << interval.low << "," << interval.high << "]";
+}
+
+/**
+* A SizedAVLNode that also stores the largest high endpoint in its
+* subtree.
+*/
+template <typename T, typename Value>
+class IntervalNode : public SizedAVLNode<Interval<T>, Value>
+{
+public:
+    IntervalNode(const Interval<T>& key, const Value& value, IntervalNode<T, Value>* parent);
+    virtual ~IntervalNode();
+
+    const T& getMaxHigh() const;
+    void setMaxHigh(const T& maxHigh);
+
+    virtual IntervalNode<T, Value>* getParent() const override;
+    virtual IntervalNode<T, Value>* getLeft() const override;
+    virtual IntervalNode<T, Value>* getRight() const override;
+    virtual size_t footprint() const override;
+    virtual Node<Interval<T>, Value>* cloneInto(void* where) const override;
+
+protected:
+    T maxHigh_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the IntervalNode class.
+  -------------------------------------------------
+*/
+
+template<typename T, typename Value>
+IntervalNode<T, Value>::IntervalNode(const Interval<T>& key, const Value& value, IntervalNode<T, Value> *parent) :
+    SizedAVLNode<Interval<T>, Value>(key, value, parent), maxHigh_(key.high)
+{
+
+}
+
+template<typename T, typename Value>
+IntervalNode<T, Value>::~IntervalNode()
+{
+
+}
+
+template<typename T, typename Value>
+const T& IntervalNode<T, Value>::getMaxHigh() const
+{
+    return maxHigh_;
+}
+
+template<typename T, typename Value>
+void IntervalNode<T, Value>::setMaxHigh(const T& maxHigh)
+{
+    maxHigh_ = maxHigh;
+}
+
+template<typename T, typename Value>
+IntervalNode<T, Value> *IntervalNode<T, Value>::getParent() const
+{
+    return static_cast<IntervalNode<T, Value>*>(this->parent_);
+}
+
+template<typename T, typename Value>
+IntervalNode<T, Value> *IntervalNode<T, Value>::getLeft() const
+{
+    return static_cast<IntervalNode<T, Value>*>(this->left_);
+}
+
+template<typename T, typename Value>
+IntervalNode<T, Value> *IntervalNode<T, Value>::getRight() const
+{
+    return static_cast<IntervalNode<T, Value>*>(this->right_);
+}
+
+template<typename T, typename Value>
+size_t IntervalNode<T, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<typename T, typename Value>
+Node<Interval<T>, Value>* IntervalNode<T, Value>::cloneInto(void* where) const
+{
+    return new (where) IntervalNode<T, Value>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the IntervalNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An interval tree: an AVLMultiMap keyed by Interval<T> (so the same
+* interval may be stored more than once) whose nodes also keep the
+* largest high endpoint in their subtree. The rebalancing is AVLTree's;
+* the endpoint is kept up to date through its pullUp hooks, which run
+* after every rotation and along the changed path of each insert and
+* remove.
+*
+*   IntervalTree<uint64_t, int> tree;
+*   tree.insert(std::make_pair(Interval<uint64_t>(10, 20), id));
+*   tree.stab(15, [](const std::pair<const Interval<uint64_t>, int>& item){ ... });
+*
+* stab and overlap visit the matching items in order of low endpoint. A
+* subtree is skipped when its largest high endpoint ends before the query
+* or its smallest low endpoint starts after it, so a query costs O(log n)
+* plus O(log n) per reported interval at worst, and close to O(log n + k)
+* when the intervals are short compared to their spread.
+*/
+template <class T, class Value>
+class IntervalTree : public AVLMultiMap<Interval<T>, Value>
+{
+public:
+    template <typename Visitor>
+    size_t stab(const T& point, Visitor visit) const;
+    template <typename Visitor>
+    size_t overlap(const T& low, const T& high, Visitor visit) const;
+
+protected:
+    virtual AVLNode<Interval<T>, Value>* createNode(const Interval<T>& key, const Value& value, AVLNode<Interval<T>, Value>* parent);
+    virtual void pullUp(AVLNode<Interval<T>, Value>* node);
+    virtual void pullUpPath(AVLNode<Interval<T>, Value>* node);
+
+    static void remax(Node<Interval<T>, Value>* node);
+    template <typename Visitor>
+    static size_t overlapHelper(const Node<Interval<T>, Value>* current, const T& low, const T& high, Visitor& visit);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the IntervalTree class.
+  ---------------------------------------------
+*/
+
+template<class T, class Value>
+AVLNode<Interval<T>, Value>* IntervalTree<T, Value>::createNode(const Interval<T>& key, const Value& value, AVLNode<Interval<T>, Value>* parent)
+{
+    return new IntervalNode<T, Value>(key, value, static_cast<IntervalNode<T, Value>*>(parent));
+}
+
+/**
+* Recomputes node's largest high endpoint from its own and its children's.
+*/
+template<class T, class Value>
+void IntervalTree<T, Value>::remax(Node<Interval<T>, Value>* node)
+{
+    IntervalNode<T, Value>* current = static_cast<IntervalNode<T, Value>*>(node);
+    const T* maxHigh = &current->getKey().high;
+    for(int side = 0; side < 2; side++){
+        const IntervalNode<T, Value>* child = static_cast<const IntervalNode<T, Value>*>(current->child(side == 1));
+        if(child != nullptr && *maxHigh < child->getMaxHigh()){
+            maxHigh = &child->getMaxHigh();
+        }
+    }
+    current->setMaxHigh(*maxHigh);
+}
+
+template<class T, class Value>
+void IntervalTree<T, Value>::pullUp(AVLNode<Interval<T>, Value>* node)
+{
+    AVLMultiMap<Interval<T>, Value>::resize(node);
+    remax(node);
+}
+
+template<class T, class Value>
+void IntervalTree<T, Value>::pullUpPath(AVLNode<Interval<T>, Value>* node)
+{
+    for(Node<Interval<T>, Value>* curr = node; curr != nullptr; curr = curr->parent()){
+        AVLMultiMap<Interval<T>, Value>::resize(curr);
+        remax(curr);
+    }
+}
+
+/**
+* Calls visit(item) for every stored interval that contains point, and
+* returns how many there were.
+*/
+template<class T, class Value>
+template<typename Visitor>
+size_t IntervalTree<T, Value>::stab(const T& point, Visitor visit) const
+{
+    return overlapHelper(this->root_, point, point, visit);
+}
+
+/**
+* Calls visit(item) for every stored interval that shares a point with
+* [low, high], and returns how many there were.
+*/
+template<class T, class Value>
+template<typename Visitor>
+size_t IntervalTree<T, Value>::overlap(const T& low, const T& high, Visitor visit) const
+{
+    return overlapHelper(this->root_, low, high, visit);
+}
+
+template<class T, class Value>
+template<typename Visitor>
+size_t IntervalTree<T, Value>::overlapHelper(const Node<Interval<T>, Value>* current, const T& low, const T& high, Visitor& visit)
+{
+    if(current == nullptr || static_cast<const IntervalNode<T, Value>*>(current)->getMaxHigh() < low){
+        return 0;
+    }
+    size_t found = overlapHelper(current->child(false), low, high, visit);
+    const Interval<T>& interval = current->getKey();
+    if(high < interval.low){
+        // everything to the right starts even later
+        return found;
+    }
+    if(!(interval.high < low)){
+        visit(current->getItem());
+        found++;
+    }
+    return found + overlapHelper(current->child(true), low, high, visit);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the IntervalTree class.
+  ---------------------------------------------
+*/
+
+#endif
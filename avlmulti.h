@@ -0,0 +1,599 @@
+#ifndef AVLMULTI_H
+#define AVLMULTI_H
+
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also stores the number of nodes in its subtree, so
+* ranks and counts over a key range take O(log n).
+*/
+template <typename Key, typename Value>
+class SizedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    SizedAVLNode(const Key& key, const Value& value, SizedAVLNode<Key, Value>* parent);
+    virtual ~SizedAVLNode();
+
+    size_t getSize() const;
+    void setSize(size_t size);
+
+    virtual SizedAVLNode<Key, Value>* getParent() const override;
+    virtual SizedAVLNode<Key, Value>* getLeft() const override;
+    virtual SizedAVLNode<Key, Value>* getRight() const override;
+    virtual size_t footprint() const override;
+    virtual Node<Key, Value>* cloneInto(void* where) const override;
+
+protected:
+    size_t size_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the SizedAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+SizedAVLNode<Key, Value>::SizedAVLNode(const Key& key, const Value& value, SizedAVLNode<Key, Value> *parent) :
+    AVLNode<Key, Value>(key, value, parent), size_(1)
+{
+
+}
+
+template<class Key, class Value>
+SizedAVLNode<Key, Value>::~SizedAVLNode()
+{
+
+}
+
+template<class Key, class Value>
+size_t SizedAVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+void SizedAVLNode<Key, Value>::setSize(size_t size)
+{
+    size_ = size;
+}
+
+template<class Key, class Value>
+SizedAVLNode<Key, Value> *SizedAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<SizedAVLNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+SizedAVLNode<Key, Value> *SizedAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<SizedAVLNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+SizedAVLNode<Key, Value> *SizedAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<SizedAVLNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+size_t SizedAVLNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* SizedAVLNode<Key, Value>::cloneInto(void* where) const
+{
+    return new (where) SizedAVLNode<Key, Value>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the SizedAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree that keeps every inserted item: equal keys are stored as
+* separate, adjacent nodes, in insertion order (like std::multimap).
+* Subtree sizes (SizedAVLNode) make count, size and the bounds' ranks
+* O(log n); the rebalancing is AVLTree's, through its augmentation hooks.
+*
+* remove(key) removes every item with key; removeOne removes just the
+* first, and the inherited removeAt the one an iterator points to. find
+* and operator[] return the first item with key.
+*/
+template <class Key, class Value>
+class AVLMultiMap : public AVLTree<Key, Value>
+{
+public:
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    virtual void remove(const Key& key);
+    bool removeOne(const Key& key);
+
+    iterator find(const Key& key) const;
+    iterator upperBound(const Key& key) const;
+    std::pair<iterator, iterator> equalRange(const Key& key) const;
+    size_t count(const Key& key) const;
+    size_t size() const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void pullUp(AVLNode<Key, Value>* node);
+    virtual void pullUpPath(AVLNode<Key, Value>* node);
+    virtual Node<Key, Value>* insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item);
+    virtual bool duplicateKeys() const;
+
+    static size_t sizeOf(const Node<Key, Value>* node);
+    static void resize(Node<Key, Value>* node);
+    size_t countBelow(const Key& key, bool inclusive) const;
+    Node<Key, Value>* firstOf(const Key& key) const;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the AVLMultiMap class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::sizeOf(const Node<Key, Value>* node)
+{
+    return node == nullptr ? 0 : static_cast<const SizedAVLNode<Key, Value>*>(node)->getSize();
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLMultiMap<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new SizedAVLNode<Key, Value>(key, value, static_cast<SizedAVLNode<Key, Value>*>(parent));
+}
+
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::resize(Node<Key, Value>* node)
+{
+    static_cast<SizedAVLNode<Key, Value>*>(node)->setSize(1 + sizeOf(node->child(false)) + sizeOf(node->child(true)));
+}
+
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::pullUp(AVLNode<Key, Value>* node)
+{
+    resize(node);
+}
+
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::pullUpPath(AVLNode<Key, Value>* node)
+{
+    for(Node<Key, Value>* curr = node; curr != nullptr; curr = curr->parent()){
+        resize(curr);
+    }
+}
+
+template<class Key, class Value>
+bool AVLMultiMap<Key, Value>::duplicateKeys() const
+{
+    return true;
+}
+
+/**
+* Adds new_item after every item with an equal key.
+*/
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    if(this->root_ == nullptr){
+        AVLTree<Key, Value>::insert(new_item);
+        return;
+    }
+    Node<Key, Value>* curr = this->root_;
+    while(true){
+        bool right = !(new_item.first < curr->getKey());
+        Node<Key, Value>* next = curr->child(right);
+        if(next == nullptr){
+            this->insert_child(static_cast<AVLNode<Key, Value>*>(curr), right, new_item);
+            return;
+        }
+        curr = next;
+    }
+}
+
+/**
+* insertNear's hook. A search from the hint ends at a node with an equal
+* key if there is one; the new item then goes right after that node.
+*/
+template<class Key, class Value>
+Node<Key, Value>* AVLMultiMap<Key, Value>::insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item)
+{
+    if(at == nullptr){
+        AVLTree<Key, Value>::insert(new_item);
+        return this->root_;
+    }
+    if(!(at->getKey() == new_item.first)){
+        return this->insert_child(static_cast<AVLNode<Key, Value>*>(at), at->getKey() < new_item.first, new_item);
+    }
+    Node<Key, Value>* next = at->child(true);
+    if(next == nullptr){
+        return this->insert_child(static_cast<AVLNode<Key, Value>*>(at), true, new_item);
+    }
+    while(next->child(false) != nullptr){
+        next = next->child(false);
+    }
+    return this->insert_child(static_cast<AVLNode<Key, Value>*>(next), false, new_item);
+}
+
+/**
+* Removes every item with key.
+*/
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::remove(const Key& key)
+{
+    while(removeOne(key)){
+    }
+}
+
+/**
+* Removes the first item with key. Returns false if there is none.
+*/
+template<class Key, class Value>
+bool AVLMultiMap<Key, Value>::removeOne(const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    Node<Key, Value>* node = firstOf(key);
+    if(node == nullptr){
+        return false;
+    }
+    this->remove_at(static_cast<AVLNode<Key, Value>*>(node));
+    return true;
+}
+
+/**
+* The first node with key, or NULL.
+*/
+template<class Key, class Value>
+Node<Key, Value>* AVLMultiMap<Key, Value>::firstOf(const Key& key) const
+{
+    Node<Key, Value>* bound = this->nodeAt(this->lowerBound(key));
+    return bound != nullptr && bound->getKey() == key ? bound : nullptr;
+}
+
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator AVLMultiMap<Key, Value>::find(const Key& key) const
+{
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    return this->iteratorAt(firstOf(key));
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator AVLMultiMap<Key, Value>::upperBound(const Key& key) const
+{
+    Node<Key, Value>* curr = this->root_;
+    Node<Key, Value>* bound = nullptr;
+    while(curr != nullptr){
+        if(key < curr->getKey()){
+            bound = curr;
+            curr = curr->getLeft();
+        } else {
+            curr = curr->getRight();
+        }
+    }
+    return this->iteratorAt(bound);
+}
+
+/**
+* The items with key, as [first, last).
+*/
+template<class Key, class Value>
+std::pair<typename AVLMultiMap<Key, Value>::iterator, typename AVLMultiMap<Key, Value>::iterator>
+AVLMultiMap<Key, Value>::equalRange(const Key& key) const
+{
+    return std::make_pair(this->lowerBound(key), upperBound(key));
+}
+
+/**
+* The number of items with a key less than key (or not greater, with
+* inclusive), from the subtree sizes along one root-to-leaf path.
+*/
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::countBelow(const Key& key, bool inclusive) const
+{
+    size_t below = 0;
+    Node<Key, Value>* curr = this->root_;
+    while(curr != nullptr){
+        bool right = inclusive ? !(key < curr->getKey()) : curr->getKey() < key;
+        if(right){
+            below += sizeOf(curr->child(false)) + 1;
+        }
+        curr = curr->child(right);
+    }
+    return below;
+}
+
+/**
+* The number of items with key. O(log n) however many there are.
+*/
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::count(const Key& key) const
+{
+    return countBelow(key, true) - countBelow(key, false);
+}
+
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::size() const
+{
+    return sizeOf(this->root_);
+}
+
+template<class Key, class Value>
+Value& AVLMultiMap<Key, Value>::operator[](const Key& key)
+{
+    Node<Key, Value>* node = firstOf(key);
+    if(node == nullptr) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value>
+Value const & AVLMultiMap<Key, Value>::operator[](const Key& key) const
+{
+    Node<Key, Value>* node = firstOf(key);
+    if(node == nullptr) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the AVLMultiMap class.
+  ---------------------------------------------
+*/
+
+/**
+* A multiset with one counted node per distinct key: the tree maps each
+* key to its number of copies, so duplicates cost no extra nodes and
+* count is a single search. Iterating yields (key, copies) pairs.
+*
+* insert(std::make_pair(key, n)) adds n copies; remove(key) removes them
+* all and removeOne(key) a single one. The copies are only changed through
+* those, which keep size() in step, so operator[] and the iterators from
+* begin, end and lowerBound are read-only (use count rather than find,
+* whose iterator is the base class's).
+*/
+template <class Key>
+class AVLMultiSet : public AVLTree<Key, size_t>
+{
+public:
+    /**
+    * The base iterator with read-only access to the (key, copies) pairs.
+    */
+    class iterator : public AVLTree<Key, size_t>::iterator
+    {
+    public:
+        iterator();
+        iterator(const typename AVLTree<Key, size_t>::iterator& it);
+
+        const std::pair<const Key, size_t>& operator*() const;
+        const std::pair<const Key, size_t>* operator->() const;
+
+        iterator& operator++();
+    };
+
+    AVLMultiSet();
+
+    void insert(const Key& key);
+    virtual void insert(const std::pair<const Key, size_t>& new_item);
+    virtual void remove(const Key& key);
+    virtual void buildFromSorted(const std::vector<std::pair<Key, size_t> >& items);
+    bool removeOne(const Key& key);
+    virtual void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator lowerBound(const Key& key) const;
+    size_t count(const Key& key) const;
+    size_t size() const;
+    size_t const & operator[](const Key& key) const;
+
+protected:
+    virtual Node<Key, size_t>* insertBelow(Node<Key, size_t>* at, const std::pair<const Key, size_t>& new_item);
+    virtual void eraseNode(Node<Key, size_t>* node);
+
+    size_t size_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the AVLMultiSet class.
+  ---------------------------------------------
+*/
+
+template<class Key>
+AVLMultiSet<Key>::iterator::iterator()
+{
+
+}
+
+template<class Key>
+AVLMultiSet<Key>::iterator::iterator(const typename AVLTree<Key, size_t>::iterator& it) :
+    AVLTree<Key, size_t>::iterator(it)
+{
+
+}
+
+template<class Key>
+const std::pair<const Key, size_t>& AVLMultiSet<Key>::iterator::operator*() const
+{
+    return AVLTree<Key, size_t>::iterator::operator*();
+}
+
+template<class Key>
+const std::pair<const Key, size_t>* AVLMultiSet<Key>::iterator::operator->() const
+{
+    return AVLTree<Key, size_t>::iterator::operator->();
+}
+
+template<class Key>
+typename AVLMultiSet<Key>::iterator& AVLMultiSet<Key>::iterator::operator++()
+{
+    AVLTree<Key, size_t>::iterator::operator++();
+    return *this;
+}
+
+template<class Key>
+AVLMultiSet<Key>::AVLMultiSet() :
+    AVLTree<Key, size_t>(),
+    size_(0)
+{
+
+}
+
+template<class Key>
+void AVLMultiSet<Key>::insert(const Key& key)
+{
+    insert(std::make_pair(key, static_cast<size_t>(1)));
+}
+
+template<class Key>
+void AVLMultiSet<Key>::insert(const std::pair<const Key, size_t>& new_item)
+{
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    if(new_item.second == 0){
+        return;
+    }
+    insertBelow(this->searchPath(new_item.first), new_item);
+}
+
+/**
+* insert and insertNear's hook: adds new_item.second copies of the key to
+* the node the search ended at, or a new node.
+*/
+template<class Key>
+Node<Key, size_t>* AVLMultiSet<Key>::insertBelow(Node<Key, size_t>* at, const std::pair<const Key, size_t>& new_item)
+{
+    size_ += new_item.second;
+    if(at != nullptr && at->getKey() == new_item.first){
+        at->setValue(at->getValue() + new_item.second);
+        return at;
+    }
+    return AVLTree<Key, size_t>::insertBelow(at, new_item);
+}
+
+template<class Key>
+void AVLMultiSet<Key>::remove(const Key& key)
+{
+    Node<Key, size_t>* node = this->internalFind(key);
+    if(node != nullptr){
+        eraseNode(node);
+    }
+}
+
+/**
+* Removes one copy of key. Returns false if there is none.
+*/
+template<class Key>
+bool AVLMultiSet<Key>::removeOne(const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    Node<Key, size_t>* node = this->internalFind(key);
+    if(node == nullptr){
+        return false;
+    }
+    if(node->getValue() > 1){
+        node->setValue(node->getValue() - 1);
+        size_--;
+    } else {
+        eraseNode(node);
+    }
+    return true;
+}
+
+/**
+* remove and removeAt's hook: drops the node with all its copies.
+*/
+template<class Key>
+void AVLMultiSet<Key>::eraseNode(Node<Key, size_t>* node)
+{
+    size_ -= node->getValue();
+    AVLTree<Key, size_t>::eraseNode(node);
+}
+
+/**
+* Builds the set from sorted, distinct (key, copies) pairs.
+*/
+template<class Key>
+void AVLMultiSet<Key>::buildFromSorted(const std::vector<std::pair<Key, size_t> >& items)
+{
+    AVLTree<Key, size_t>::buildFromSorted(items);
+    size_ = 0;
+    for(size_t i = 0; i < items.size(); i++){
+        size_ += items[i].second;
+    }
+}
+
+template<class Key>
+void AVLMultiSet<Key>::clear()
+{
+    AVLTree<Key, size_t>::clear();
+    size_ = 0;
+}
+
+template<class Key>
+typename AVLMultiSet<Key>::iterator AVLMultiSet<Key>::begin() const
+{
+    return AVLTree<Key, size_t>::begin();
+}
+
+template<class Key>
+typename AVLMultiSet<Key>::iterator AVLMultiSet<Key>::end() const
+{
+    return AVLTree<Key, size_t>::end();
+}
+
+template<class Key>
+typename AVLMultiSet<Key>::iterator AVLMultiSet<Key>::lowerBound(const Key& key) const
+{
+    return AVLTree<Key, size_t>::lowerBound(key);
+}
+
+/**
+* The number of copies of key; throws std::out_of_range if there are none.
+*/
+template<class Key>
+size_t const & AVLMultiSet<Key>::operator[](const Key& key) const
+{
+    return AVLTree<Key, size_t>::operator[](key);
+}
+
+template<class Key>
+size_t AVLMultiSet<Key>::count(const Key& key) const
+{
+    Node<Key, size_t>* node = this->internalFind(key);
+    return node == nullptr ? 0 : node->getValue();
+}
+
+/**
+* The total number of copies.
+*/
+template<class Key>
+size_t AVLMultiSet<Key>::size() const
+{
+    return size_;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the AVLMultiSet class.
+  ---------------------------------------------
+*/
+
+#endif
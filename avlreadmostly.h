@@ -0,0 +1,497 @@
+#ifndef AVLREADMOSTLY_H
+#define AVLREADMOSTLY_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include "avlbst.h"
+#include "epoch.h"
+
+/**
+* An AVLTree for read-mostly workloads: find, contains, operator[] and
+* scan take no locks and do no atomic read-modify-writes, while writers
+* (serialized by a mutex, so one at a time) insert and remove.
+*
+* Writers change the tree with the base class's relaxed stores, but put a
+* release fence after creating a node (createNode) and after finishing
+* one in a bulk build (pullUp), so the link that then publishes it is not
+* seen before its contents. They bump a sequence number before and after
+* each operation.
+* Readers never wait for the sequence number: they walk the tree with
+* acquire loads (the nodes they reach stay allocated, see below) and
+* retry if it was odd or changed meanwhile, so they never return a result
+* mixed from before and after a rotation or the predecessor swap in
+* remove. A half-done swap can briefly point a node at itself, so walks
+* give up after MAX_DEPTH steps and retry. After READ_RETRIES failed
+* attempts a reader takes the write lock instead, so a steady stream of
+* writers cannot starve it. clear, buildFromSorted and compact leave the
+* old nodes as they are and swap in the new root with a single store, so
+* they do not make readers retry at all, however long they take.
+*
+* Nodes unlinked by remove (and clear, buildFromSorted and compact) are not deleted right
+* away but retired with the current epoch (see epoch.h) and freed in
+* batches once no reader that could still be standing on them is left.
+*
+* Readers copy values out, so Value must be trivially copyable: a copy
+* racing with an overwrite is thrown away, never used. find and
+* operator[] replace the inherited ones; the inherited iterators are not
+* safe against a concurrent writer, so only use them while no writer runs.
+*/
+template <class Key, class Value>
+class ReadMostlyAVLTree : public AVLTree<Key, Value>
+{
+public:
+    static_assert(std::is_trivially_copyable<Value>::value, "ReadMostlyAVLTree values must be trivially copyable");
+
+    static const int MAX_DEPTH = 128;
+    static const size_t RECLAIM_BATCH = 256;
+    static const int READ_RETRIES = 16;
+
+    ReadMostlyAVLTree();
+    virtual ~ReadMostlyAVLTree();
+
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    virtual void remove(const Key& key);
+    virtual void buildFromSorted(const std::vector<std::pair<Key, Value> >& items);
+    virtual typename AVLTree<Key, Value>::iterator insertNear(const typename AVLTree<Key, Value>::iterator& hint, const std::pair<const Key, Value>& new_item);
+    virtual typename AVLTree<Key, Value>::iterator removeAt(const typename AVLTree<Key, Value>::iterator& pos);
+    virtual void compact(typename AVLTree<Key, Value>::Layout layout = AVLTree<Key, Value>::VAN_EMDE_BOAS);
+    virtual void clear();
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+
+    template <typename Visitor>
+    size_t scan(const Key& from, size_t count, Visitor visit) const;
+
+    size_t retired() const;
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void pullUp(AVLNode<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+
+    void beginWrite();
+    void endWrite();
+    uint64_t beginRead() const;
+    bool validateRead(uint64_t seq) const;
+    Node<Key, Value>* readFind(typename BstParam<Key>::type key, bool& ok) const;
+    bool readScan(const Key& from, size_t count, std::vector<std::pair<Key, Value> >& items) const;
+    void retireTree(Node<Key, Value>* root);
+    void reclaimIfDue();
+    void reclaim();
+
+    std::atomic<uint64_t> seq_;
+    // serializes writers, and readers that ran out of retries
+    mutable std::mutex writeLock_;
+    std::vector<std::pair<uint64_t, Node<Key, Value>*> > retired_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ReadMostlyAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+ReadMostlyAVLTree<Key, Value>::ReadMostlyAVLTree() :
+    AVLTree<Key, Value>(),
+    seq_(0)
+{
+
+}
+
+/**
+* No readers may be running by now, so retired nodes are freed directly.
+* The base destructor frees the rest (with the base destroyNode).
+*/
+template<class Key, class Value>
+ReadMostlyAVLTree<Key, Value>::~ReadMostlyAVLTree()
+{
+    for(size_t i = 0; i < retired_.size(); i++){
+        AVLTree<Key, Value>::destroyNode(retired_[i].second);
+    }
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::beginWrite()
+{
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::endWrite()
+{
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    reclaimIfDue();
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    beginWrite();
+    AVLTree<Key, Value>::insert(new_item);
+    endWrite();
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    beginWrite();
+    AVLTree<Key, Value>::remove(key);
+    endWrite();
+}
+
+/**
+* Builds the new tree off to the side, then swaps it in and retires the
+* old one.
+*/
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::buildFromSorted(const std::vector<std::pair<Key, Value> >& items)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    Node<Key, Value>* old = this->root_;
+    int height = 0;
+    this->setRoot(this->build_helper(items, 0, items.size(), nullptr, height));
+    retireTree(old);
+    reclaimIfDue();
+}
+
+/**
+* The writer's cursor operations. The hint must come from the writer (the
+* iterators returned here, or an iterator taken while no writer ran).
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::iterator
+ReadMostlyAVLTree<Key, Value>::insertNear(const typename AVLTree<Key, Value>::iterator& hint, const std::pair<const Key, Value>& new_item)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    beginWrite();
+    typename AVLTree<Key, Value>::iterator it = AVLTree<Key, Value>::insertNear(hint, new_item);
+    endWrite();
+    return it;
+}
+
+template<class Key, class Value>
+typename AVLTree<Key, Value>::iterator
+ReadMostlyAVLTree<Key, Value>::removeAt(const typename AVLTree<Key, Value>::iterator& pos)
+{
+    if(pos == this->end()){
+        throw std::out_of_range("Invalid iterator");
+    }
+    std::lock_guard<std::mutex> guard(writeLock_);
+    beginWrite();
+    typename AVLTree<Key, Value>::iterator it = AVLTree<Key, Value>::removeAt(pos);
+    endWrite();
+    return it;
+}
+
+/**
+* compact copies the nodes before it publishes them and retires the old
+* ones without changing them, so readers already on the old nodes finish
+* their walk there.
+*/
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::compact(typename AVLTree<Key, Value>::Layout layout)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    AVLTree<Key, Value>::compact(layout);
+    reclaimIfDue();
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::clear()
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    Node<Key, Value>* old = this->root_;
+    this->setRoot(nullptr);
+    retireTree(old);
+    reclaimIfDue();
+}
+
+/**
+* Retires every node of a subtree no longer linked from the tree. The
+* nodes are left as they are (the base clear unlinks them one by one), so
+* readers still on them see the tree they started on.
+*/
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::retireTree(Node<Key, Value>* root)
+{
+    std::vector<Node<Key, Value>*> nodes;
+    this->collectInOrder(root, nodes);
+    for(size_t i = 0; i < nodes.size(); i++){
+        destroyNode(nodes[i]);
+    }
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::reclaimIfDue()
+{
+    if(retired_.size() >= RECLAIM_BATCH){
+        reclaim();
+    }
+}
+
+/**
+* The base class links a node right after creating it, and a bulk build
+* right after pulling it up, with relaxed stores; the fences order the
+* node's contents before that link for the readers' acquire loads.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* ReadMostlyAVLTree<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    AVLNode<Key, Value>* node = AVLTree<Key, Value>::createNode(key, value, parent);
+    std::atomic_thread_fence(std::memory_order_release);
+    return node;
+}
+
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::pullUp(AVLNode<Key, Value>* node)
+{
+    AVLTree<Key, Value>::pullUp(node);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+/**
+* Called (with the write lock held) for every node remove or clear unlinks.
+*/
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
+    retired_.push_back(std::make_pair(EpochDomain::instance().current(), node));
+}
+
+/**
+* Frees the retired nodes that no pinned reader can reach: those retired
+* at least two epochs before the oldest pinned one. One epoch is not
+* enough: a node is tagged with no fence after its unlink, so a reader
+* can pin the very next epoch and still load the link to it. A reader
+* pinned two epochs later started after the fence in the minActive call
+* that followed the unlink, so it sees the unlink.
+*/
+template<class Key, class Value>
+void ReadMostlyAVLTree<Key, Value>::reclaim()
+{
+    EpochDomain& domain = EpochDomain::instance();
+    domain.advance();
+    uint64_t oldest = domain.minActive();
+    size_t kept = 0;
+    for(size_t i = 0; i < retired_.size(); i++){
+        if(retired_[i].first + 1 < oldest){
+            AVLTree<Key, Value>::destroyNode(retired_[i].second);
+        } else {
+            retired_[kept++] = retired_[i];
+        }
+    }
+    retired_.resize(kept);
+}
+
+/**
+* The number of removed nodes still waiting for readers to move on.
+*/
+template<class Key, class Value>
+size_t ReadMostlyAVLTree<Key, Value>::retired() const
+{
+    return retired_.size();
+}
+
+/**
+* The sequence number to validate against. Does not wait if a writer is
+* in progress (seq is odd); validateRead fails then.
+*/
+template<class Key, class Value>
+uint64_t ReadMostlyAVLTree<Key, Value>::beginRead() const
+{
+    return seq_.load(std::memory_order_acquire);
+}
+
+/**
+* True if no writer ran since beginRead returned seq, i.e. everything read
+* in between was a consistent state of the tree.
+*/
+template<class Key, class Value>
+bool ReadMostlyAVLTree<Key, Value>::validateRead(uint64_t seq) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (seq & 1) == 0 && seq_.load(std::memory_order_relaxed) == seq;
+}
+
+/**
+* One unvalidated search for key. Sets ok to false if the walk ran past
+* MAX_DEPTH (the tree was changing under us).
+*/
+template<class Key, class Value>
+Node<Key, Value>* ReadMostlyAVLTree<Key, Value>::readFind(typename BstParam<Key>::type key, bool& ok) const
+{
+    Node<Key, Value>* curr = this->loadRoot();
+    for(int depth = 0; curr != nullptr; depth++){
+        if(depth == MAX_DEPTH){
+            ok = false;
+            return nullptr;
+        }
+        typename BstParam<Key>::type currKey = curr->getKey();
+        if(currKey == key){
+            break;
+        }
+        curr = curr->loadChild(currKey < key);
+    }
+    ok = true;
+    return curr;
+}
+
+/**
+* Copies the value for key into value. Returns false (leaving value
+* alone) if key is not in the tree.
+*/
+template<class Key, class Value>
+bool ReadMostlyAVLTree<Key, Value>::find(const Key& key, Value& value) const
+{
+    EpochGuard guard;
+    bool ok;
+    for(int attempt = 0; attempt < READ_RETRIES; attempt++){
+        uint64_t seq = beginRead();
+        Node<Key, Value>* node = readFind(key, ok);
+        Value copy;
+        if(node != nullptr){
+            copy = node->getValue();
+        }
+        if(ok && validateRead(seq)){
+            if(node == nullptr){
+                return false;
+            }
+            value = copy;
+            return true;
+        }
+    }
+    std::lock_guard<std::mutex> lock(writeLock_);
+    Node<Key, Value>* node = readFind(key, ok);
+    if(node == nullptr){
+        return false;
+    }
+    value = node->getValue();
+    return true;
+}
+
+template<class Key, class Value>
+bool ReadMostlyAVLTree<Key, Value>::contains(const Key& key) const
+{
+    EpochGuard guard;
+    bool ok;
+    for(int attempt = 0; attempt < READ_RETRIES; attempt++){
+        uint64_t seq = beginRead();
+        Node<Key, Value>* node = readFind(key, ok);
+        if(ok && validateRead(seq)){
+            return node != nullptr;
+        }
+    }
+    std::lock_guard<std::mutex> lock(writeLock_);
+    return readFind(key, ok) != nullptr;
+}
+
+/**
+* The value for key, by value. Throws std::out_of_range if key is not in
+* the tree.
+*/
+template<class Key, class Value>
+Value ReadMostlyAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    Value value;
+    if(!find(key, value)){
+        throw std::out_of_range("Invalid key");
+    }
+    return value;
+}
+
+/**
+* Calls visit(item) on up to count items (std::pair<Key, Value> copies)
+* in key order, starting at the first key not less than from, and returns
+* the number visited. The items are collected and validated first, so
+* visit sees one consistent state of the tree (and may take its time).
+*/
+template<class Key, class Value>
+template<typename Visitor>
+size_t ReadMostlyAVLTree<Key, Value>::scan(const Key& from, size_t count, Visitor visit) const
+{
+    std::vector<std::pair<Key, Value> > items;
+    {
+        EpochGuard guard;
+        bool ok = false;
+        for(int attempt = 0; attempt < READ_RETRIES && !ok; attempt++){
+            uint64_t seq = beginRead();
+            ok = readScan(from, count, items) && validateRead(seq);
+        }
+        if(!ok){
+            std::lock_guard<std::mutex> lock(writeLock_);
+            readScan(from, count, items);
+        }
+    }
+    for(size_t i = 0; i < items.size(); i++){
+        visit(items[i]);
+    }
+    return items.size();
+}
+
+/**
+* One unvalidated attempt at scan's items. Returns false if a walk ran
+* past MAX_DEPTH steps (the tree was changing under us).
+*/
+template<class Key, class Value>
+bool ReadMostlyAVLTree<Key, Value>::readScan(const Key& from, size_t count, std::vector<std::pair<Key, Value> >& items) const
+{
+    items.clear();
+
+    // lower bound
+    Node<Key, Value>* curr = this->loadRoot();
+    Node<Key, Value>* next = nullptr;
+    for(int depth = 0; curr != nullptr; depth++){
+        if(depth == MAX_DEPTH){
+            return false;
+        }
+        if(curr->getKey() < from){
+            curr = curr->loadChild(true);
+        } else {
+            next = curr;
+            curr = curr->loadChild(false);
+        }
+    }
+
+    // in-order successors through the parent pointers
+    while(next != nullptr && items.size() < count){
+        items.push_back(std::make_pair(next->getKey(), next->getValue()));
+        Node<Key, Value>* child = next->loadChild(true);
+        int steps = 0;
+        if(child != nullptr){
+            next = child;
+            for(child = next->loadChild(false); child != nullptr && steps < MAX_DEPTH; child = next->loadChild(false), steps++){
+                next = child;
+            }
+        } else {
+            Node<Key, Value>* parent = next->loadParent();
+            while(parent != nullptr && parent->loadChild(true) == next && steps < MAX_DEPTH){
+                next = parent;
+                parent = next->loadParent();
+                steps++;
+            }
+            next = parent;
+        }
+        if(steps == MAX_DEPTH){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ReadMostlyAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef AVLTOPDOWN_H
+#define AVLTOPDOWN_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include "avlbst.h"
+
+/**
+* An AVLTree with a different rebalancing engine. Same nodes, rotations,
+* iterator and results as AVLTree; only the way balances are fixed differs.
+*
+* insert() makes one descent and remembers the deepest node on the path
+* with a nonzero balance (the only node that can need a rotation). After the
+* leaf is linked, only the nodes from that node down are touched: their
+* balances are updated along the key's path and at most one (single or
+* double) rotation is done at the top. No walk back up through parent
+* pointers is needed.
+*
+* remove() records the search path in a fixed array during its descent
+* (including the extra descent to the predecessor) and retraces that array
+* instead of following parent pointers, stopping as soon as a subtree's
+* height is unchanged.
+*
+* Nodes come from createNode and every update ends with pullUpPath, as in
+* AVLTree, so a subclass that keeps per-subtree data can use this engine.
+*/
+template <class Key, class Value>
+class TopDownAVLTree : public AVLTree<Key, Value>
+{
+public:
+    virtual void insert (const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key &key);
+
+protected:
+    // AVL height is < 1.45 log2(n + 2), so this covers any tree that fits in memory
+    static const int MAX_PATH = 128;
+
+    AVLNode<Key, Value>* rebalance(AVLNode<Key, Value> *current, bool& height_changed);
+};
+
+/*
+ * If key is already in the tree, the value is overwritten.
+ */
+template<class Key, class Value>
+void TopDownAVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+{
+    AVL_TRACE_SCOPE(AVL_TRACE_INSERT);
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    if(this->root_ == nullptr){
+        this->setRoot(this->createNode(new_item.first, new_item.second, nullptr));
+        return;
+    }
+
+    const Key& key = new_item.first;
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* safe = curr;
+    AVLNode<Key, Value>* new_node = nullptr;
+    while(new_node == nullptr){
+        AVL_TRACE_STEP();
+        AVLNode<Key, Value>* next;
+        if(key < curr->getKey()){
+            next = curr->getLeft();
+            if(next == nullptr){
+                new_node = this->createNode(key, new_item.second, curr);
+                curr->setLeft(new_node);
+            }
+        } else if(curr->getKey() < key){
+            next = curr->getRight();
+            if(next == nullptr){
+                new_node = this->createNode(key, new_item.second, curr);
+                curr->setRight(new_node);
+            }
+        } else {
+            curr->setValue(new_item.second);
+            this->pullUpPath(curr);
+            return;
+        }
+        if(next != nullptr){
+            if(next->getBalance() != 0){
+                safe = next;
+            }
+            curr = next;
+        }
+    }
+
+    // every node strictly below safe had balance 0 and now leans toward the new leaf
+    for(AVLNode<Key, Value>* p = safe; p != new_node; ){
+        if(key < p->getKey()){
+            p->updateBalance(-1);
+            p = p->getLeft();
+        } else {
+            p->updateBalance(1);
+            p = p->getRight();
+        }
+    }
+
+    if(safe->getBalance() == -2 || safe->getBalance() == 2){
+        bool height_changed;
+        rebalance(safe, height_changed);
+    }
+    this->pullUpPath(new_node);
+    AVL_CHECK_PATH(this, new_node->getParent());
+}
+
+/**
+* Fixes a node whose balance is -2 or 2 with a single or double rotation.
+* Returns the new root of the subtree; height_changed tells whether the
+* subtree is now shorter than before the rotation (always true after an
+* insert, and after a removal unless the taller child was balanced).
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* TopDownAVLTree<Key, Value>::rebalance(AVLNode<Key, Value> *current, bool& height_changed)
+{
+    if(current->getBalance() == -2){
+        AVLNode<Key, Value>* child = current->getLeft();
+        if(child->getBalance() <= 0){
+            // zig zig
+            this->rotate_right(current);
+            if(child->getBalance() == 0){
+                current->setBalance(-1);
+                child->setBalance(1);
+                height_changed = false;
+            } else {
+                current->setBalance(0);
+                child->setBalance(0);
+                height_changed = true;
+            }
+            return child;
+        }
+        // zig zag
+        AVLNode<Key, Value>* grand_child = child->getRight();
+        this->rotate_left(child);
+        this->rotate_right(current);
+        current->setBalance(grand_child->getBalance() == -1 ? 1 : 0);
+        child->setBalance(grand_child->getBalance() == 1 ? -1 : 0);
+        grand_child->setBalance(0);
+        height_changed = true;
+        return grand_child;
+    }
+
+    AVLNode<Key, Value>* child = current->getRight();
+    if(child->getBalance() >= 0){
+        // zig zig
+        this->rotate_left(current);
+        if(child->getBalance() == 0){
+            current->setBalance(1);
+            child->setBalance(-1);
+            height_changed = false;
+        } else {
+            current->setBalance(0);
+            child->setBalance(0);
+            height_changed = true;
+        }
+        return child;
+    }
+    // zig zag
+    AVLNode<Key, Value>* grand_child = child->getLeft();
+    this->rotate_right(child);
+    this->rotate_left(current);
+    current->setBalance(grand_child->getBalance() == 1 ? -1 : 0);
+    child->setBalance(grand_child->getBalance() == -1 ? 1 : 0);
+    grand_child->setBalance(0);
+    height_changed = true;
+    return grand_child;
+}
+
+/*
+ * A node with 2 children is replaced by its predecessor, as in AVLTree.
+ */
+template<class Key, class Value>
+void TopDownAVLTree<Key, Value>::remove(const Key& key)
+{
+    AVL_TRACE_SCOPE(AVL_TRACE_REMOVE);
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    AVLNode<Key, Value>* path[MAX_PATH];
+    int8_t went_left[MAX_PATH];
+    int depth = 0;
+
+    AVLNode<Key, Value>* remove_node = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while(remove_node != nullptr){
+        AVL_TRACE_STEP();
+        if(key < remove_node->getKey()){
+            path[depth] = remove_node;
+            went_left[depth++] = 1;
+            remove_node = remove_node->getLeft();
+        } else if(remove_node->getKey() < key){
+            path[depth] = remove_node;
+            went_left[depth++] = 0;
+            remove_node = remove_node->getRight();
+        } else {
+            break;
+        }
+    }
+    if(remove_node == nullptr){
+        return;
+    }
+
+    if(remove_node->getLeft() != nullptr && remove_node->getRight() != nullptr){
+        // keep descending to the predecessor, which then takes remove_node's slot
+        int slot = depth;
+        path[depth] = remove_node;
+        went_left[depth++] = 1;
+        AVLNode<Key, Value>* pred_node = remove_node->getLeft();
+        while(pred_node->getRight() != nullptr){
+            path[depth] = pred_node;
+            went_left[depth++] = 0;
+            pred_node = pred_node->getRight();
+        }
+        pred_node->setBalance(remove_node->getBalance());
+        this->replaceWithPredecessor(remove_node, pred_node);
+        path[slot] = pred_node;
+        this->destroyNode(remove_node);
+    } else {
+        AVLNode<Key, Value>* child = remove_node->getLeft() != nullptr ? remove_node->getLeft() : remove_node->getRight();
+        AVLNode<Key, Value>* parent = depth > 0 ? path[depth - 1] : nullptr;
+        if(child != nullptr){
+            child->setParent(parent);
+        }
+        if(parent == nullptr){
+            this->setRoot(child);
+        } else if(went_left[depth - 1]){
+            parent->setLeft(child);
+        } else {
+            parent->setRight(child);
+        }
+        this->destroyNode(remove_node);
+    }
+
+    // retrace the cached path; each step the subtree on the recorded side got shorter
+    for(int i = depth - 1; i >= 0; i--){
+        AVLNode<Key, Value>* current = path[i];
+        current->updateBalance(went_left[i] ? 1 : -1);
+        int8_t balance = current->getBalance();
+        if(balance == 1 || balance == -1){
+            break;
+        }
+        if(balance == 2 || balance == -2){
+            bool height_changed;
+            rebalance(current, height_changed);
+            if(!height_changed){
+                break;
+            }
+        }
+    }
+    this->pullUpPath(depth > 0 ? path[depth - 1] : nullptr);
+    AVL_CHECK_PATH(this, depth > 0 ? path[depth - 1] : nullptr);
+}
+
+#endif
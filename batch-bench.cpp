@@ -0,0 +1,86 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include "avlbatch.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: batch-bench [keys] [updates] [threads]
+//
+// Updates/s for batch sizes 1 to 100K on a BatchedAVLTree prefilled with
+// keys (default 1M) items. Each batch is 70% puts and 30% erases of
+// uniform keys, half of them present. At least updates (default 200K)
+// updates are applied per batch size, on a fresh tree each time:
+//   single  insert/remove one update at a time, in batch order
+//   batch   applyBatch on one thread
+//   batchN  applyBatch with threads (default: hardware threads, min 2)
+
+typedef BatchUpdate<uint64_t, uint64_t> Update;
+
+static const size_t kBatchSizes[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+static vector<vector<Update> > makeBatches(size_t keys, size_t batchSize, size_t updates)
+{
+    BenchRng rng(batchSize);
+    size_t count = max<size_t>(1, updates / batchSize);
+    vector<vector<Update> > batches(count);
+    for(size_t b = 0; b < count; b++){
+        for(size_t i = 0; i < batchSize; i++){
+            uint64_t key = rng.below(2 * keys);
+            batches[b].push_back(rng.below(10) < 7 ? Update::put(key, i) : Update::erase(key));
+        }
+    }
+    return batches;
+}
+
+static double run(int mode, unsigned int threads, size_t keys, const vector<vector<Update> >& batches)
+{
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < keys; i++){
+        items.push_back(make_pair(2 * i, i));
+    }
+    BatchedAVLTree<uint64_t, uint64_t> tree;
+    tree.buildFromSorted(items);
+
+    size_t updates = 0;
+    uint64_t start = benchNowNs();
+    for(size_t b = 0; b < batches.size(); b++){
+        const vector<Update>& batch = batches[b];
+        if(mode == 0){
+            for(size_t i = 0; i < batch.size(); i++){
+                if(batch[i].op == Update::PUT){
+                    tree.insert(make_pair(batch[i].key, batch[i].value));
+                } else {
+                    tree.remove(batch[i].key);
+                }
+            }
+        } else {
+            tree.applyBatch(batch, mode == 1 ? 1 : threads);
+        }
+        updates += batch.size();
+    }
+    return updates / ((benchNowNs() - start) / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t keys = benchArg(argc, argv, 1, 1000000);
+    size_t updates = benchArg(argc, argv, 2, 200000);
+    unsigned int threads = static_cast<unsigned int>(benchArg(argc, argv, 3, max(2u, thread::hardware_concurrency())));
+
+    cout << "M updates/s, " << keys << " keys, " << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << left << setw(10) << "batch" << right << setw(10) << "single" << setw(10) << "batch"
+         << setw(10) << ("batch" + to_string(threads)) << endl;
+    for(size_t s = 0; s < sizeof(kBatchSizes) / sizeof(kBatchSizes[0]); s++){
+        vector<vector<Update> > batches = makeBatches(keys, kBatchSizes[s], updates);
+        cout << left << setw(10) << kBatchSizes[s] << right << fixed << setprecision(2);
+        for(int mode = 0; mode < 3; mode++){
+            cout << setw(10) << run(mode, threads, keys, batches) / 1e6;
+        }
+        cout << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/**
+* Small helpers shared by the *-bench programs: a monotonic clock,
+* a fast deterministic RNG and key set generators.
+*/
+
+/**
+* Nanoseconds from a monotonic clock.
+*/
+inline uint64_t benchNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* xorshift64* generator. Deterministic for a given seed so that runs
+* are reproducible.
+*/
+class BenchRng
+{
+public:
+    explicit BenchRng(uint64_t seed = 0x9E3779B97F4A7C15ULL) : state_(seed ? seed : 1) {}
+
+    uint64_t next()
+    {
+        state_ ^= state_ >> 12;
+        state_ ^= state_ << 25;
+        state_ ^= state_ >> 27;
+        return state_ * 0x2545F4914F6CDD1DULL;
+    }
+
+    // Uniform in [0, bound)
+    uint64_t below(uint64_t bound)
+    {
+        return next() % bound;
+    }
+
+    // Uniform in [0, 1)
+    double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t state_;
+};
+
+/**
+* Returns the keys 0..n-1 in a random order.
+*/
+inline std::vector<uint64_t> benchShuffledKeys(size_t n, uint64_t seed)
+{
+    std::vector<uint64_t> keys(n);
+    for(size_t i = 0; i < n; i++){
+        keys[i] = i;
+    }
+    BenchRng rng(seed);
+    for(size_t i = n; i > 1; i--){
+        std::swap(keys[i - 1], keys[rng.below(i)]);
+    }
+    return keys;
+}
+
+/**
+* Draws ranks in [0, n) from a Zipf distribution with exponent s: rank r is
+* picked with probability proportional to 1 / (r + 1)^s. s = 0 is uniform;
+* s around 1 gives the "few hot keys" shape of real access logs. Uses a
+* precomputed CDF, so sampling is a binary search - generate samples before
+* timing.
+*/
+class BenchZipf
+{
+public:
+    BenchZipf(size_t n, double s, uint64_t seed) : cdf_(n), rng_(seed)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < n; i++){
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cdf_[i] = sum;
+        }
+        for(size_t i = 0; i < n; i++){
+            cdf_[i] /= sum;
+        }
+    }
+
+    size_t next()
+    {
+        double u = rng_.uniform();
+        size_t rank = std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+        return rank < cdf_.size() ? rank : cdf_.size() - 1;
+    }
+
+private:
+    std::vector<double> cdf_;
+    BenchRng rng_;
+};
+
+/**
+* One hardware counter read through perf_event_open, counting user-space
+* events of this thread. available() is false when the kernel refuses
+* (no PMU in a VM, perf_event_paranoid too high); read() then returns 0.
+*/
+class BenchPerfCounter
+{
+public:
+    BenchPerfCounter(uint32_t type, uint64_t config) : fd_(-1)
+    {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~BenchPerfCounter()
+    {
+        if(fd_ >= 0) close(fd_);
+    }
+
+    bool available() const { return fd_ >= 0; }
+
+    void start()
+    {
+        if(fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+        if(fd_ < 0) return 0;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if(::read(fd_, &count, sizeof(count)) != sizeof(count)) return 0;
+        return count;
+    }
+
+private:
+    BenchPerfCounter(const BenchPerfCounter&);
+    BenchPerfCounter& operator=(const BenchPerfCounter&);
+
+    int fd_;
+};
+
+/**
+* Peak resident set size of this process so far, in KB (Linux ru_maxrss).
+*/
+inline long benchPeakRssKb()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+}
+
+/**
+* Prevents the compiler from optimizing away a computed value.
+*/
+template<typename T>
+inline void benchKeep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+* Reads a size argument, e.g. "100000", or returns the fallback.
+*/
+inline size_t benchArg(int argc, char* argv[], int index, size_t fallback)
+{
+    if(argc > index){
+        return static_cast<size_t>(std::strtoull(argv[index], nullptr, 10));
+    }
+    return fallback;
+}
+
+#endif
@@ -0,0 +1,1503 @@
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "avltopdown.h"
+#include "avlmulti.h"
+#include "avlbatch.h"
+#include "avlinterval.h"
+#include "avlaggregate.h"
+#include "veb-layout.h"
+#include "learned-index.h"
+#include "cold-value.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "treapbst.h"
+#include "wal.h"
+#include "leaf-depth.h"
+#include "trace.h"
+#include "sharded-map.h"
+#include "avlreadmostly.h"
+
+using namespace std;
+
+// Expects tree to hold exactly ref's items, in order.
+template<class Tree, class Key, class Value>
+void expectSameContents(Tree& tree, const map<Key, Value>& ref)
+{
+    typename Tree::iterator it = tree.begin();
+    for(typename map<Key, Value>::const_iterator r = ref.begin(); r != ref.end(); ++r, ++it){
+        ASSERT_TRUE(it != tree.end()) << "tree ends before key " << r->first;
+        EXPECT_EQ(r->first, it->first);
+        EXPECT_EQ(r->second, it->second);
+    }
+    EXPECT_TRUE(it == tree.end());
+}
+
+// Runs the same random inserts, removes and finds against tree and a
+// std::map, checking every find, and the contents at the end. Keys come
+// from [0, keys), so that removes and repeated inserts often hit.
+template<class Tree>
+void runAgainstMap(Tree& tree, int ops, int keys, unsigned seed)
+{
+    map<int, int> ref;
+    srand(seed);
+    for(int i = 0; i < ops; i++){
+        int key = rand() % keys;
+        int op = rand() % 4;
+        if(op < 2){
+            tree.insert(make_pair(key, i));
+            ref[key] = i;
+        } else if(op == 2){
+            tree.remove(key);
+            ref.erase(key);
+        } else {
+            typename Tree::iterator it = tree.find(key);
+            map<int, int>::iterator r = ref.find(key);
+            ASSERT_EQ(r == ref.end(), it == tree.end()) << "find(" << key << ") after " << i << " ops";
+            if(r != ref.end()){
+                EXPECT_EQ(r->second, it->second);
+            }
+        }
+    }
+    expectSameContents(tree, ref);
+}
+
+TEST(BST, InsertFindRemove)
+{
+    BinarySearchTree<char,int> bt;
+    bt.insert(std::make_pair('a',1));
+    bt.insert(std::make_pair('b',2));
+
+    BinarySearchTree<char,int>::iterator it = bt.begin();
+    EXPECT_EQ('a', it->first);
+    ++it;
+    EXPECT_EQ('b', it->first);
+    EXPECT_TRUE(bt.find('b') != bt.end());
+    bt.remove('b');
+    EXPECT_TRUE(bt.find('b') == bt.end());
+    EXPECT_TRUE(bt.find('a') != bt.end());
+}
+
+TEST(AVLTree, InsertFindRemove)
+{
+    AVLTree<char,int> at;
+    at.insert(std::make_pair('a',1));
+    at.insert(std::make_pair('b',2));
+
+    AVLTree<char,int>::iterator it = at.begin();
+    EXPECT_EQ('a', it->first);
+    ++it;
+    EXPECT_EQ('b', it->first);
+    EXPECT_TRUE(at.find('b') != at.end());
+    at.remove('b');
+    EXPECT_TRUE(at.find('b') == at.end());
+    EXPECT_TRUE(at.isBalanced());
+}
+
+TEST(AVLTree, LeafDepthHistogram)
+{
+    // ascending inserts of 2^k - 1 keys build a perfect AVL tree
+    AVLTree<int, int> tree;
+    for(int i = 1; i <= 7; i++){
+        tree.insert(make_pair(i, i));
+    }
+    LeafDepthReport report = analyzeTreeShape(tree);
+    EXPECT_EQ(7u, report.nodes);
+    EXPECT_EQ(4u, report.leaves);
+    EXPECT_EQ(3, report.height);
+    ASSERT_EQ(3u, report.histogram.size());
+    EXPECT_EQ(4u, report.histogram[2]);
+    EXPECT_TRUE(report.equalPaths);
+
+    // 8 goes below 7, the rightmost leaf, so it is the first leaf out of line
+    tree.insert(make_pair(8, 8));
+    report = analyzeTreeShape(tree);
+    EXPECT_EQ(4u, report.leaves);
+    ASSERT_EQ(4u, report.histogram.size());
+    EXPECT_EQ(3u, report.histogram[2]);
+    EXPECT_EQ(1u, report.histogram[3]);
+    EXPECT_FALSE(report.equalPaths);
+    EXPECT_EQ("RRR", report.firstOffendingPath);
+    EXPECT_EQ(3, report.firstOffendingDepth);
+}
+
+TEST(SplayTree, MatchesStdMap)
+{
+    SplayTree<int, int> tree;
+    runAgainstMap(tree, 20000, 500, 1);
+}
+
+TEST(SplayTree, SequentialKeys)
+{
+    // ascending inserts make a path; each access must still splay it back
+    SplayTree<int, int> tree;
+    map<int, int> ref;
+    for(int i = 0; i < 2000; i++){
+        tree.insert(make_pair(i, -i));
+        ref[i] = -i;
+    }
+    EXPECT_EQ(0, tree[0]);
+    EXPECT_EQ(-1999, tree[1999]);
+    expectSameContents(tree, ref);
+    EXPECT_THROW(tree[5000], std::out_of_range);
+}
+
+TEST(Treap, MatchesStdMap)
+{
+    Treap<int, int> tree;
+    runAgainstMap(tree, 20000, 500, 2);
+}
+
+TEST(Treap, SeedsGiveSameContents)
+{
+    Treap<int, int> a(1);
+    Treap<int, int> b(99);
+    runAgainstMap(a, 5000, 200, 3);
+    runAgainstMap(b, 5000, 200, 3);
+    Treap<int, int>::iterator ia = a.begin();
+    for(Treap<int, int>::iterator ib = b.begin(); ib != b.end(); ++ib, ++ia){
+        ASSERT_TRUE(ia != a.end());
+        EXPECT_EQ(ib->first, ia->first);
+    }
+}
+
+// Exposes the red-black invariants, which the tree does not check itself.
+template<class Key, class Value>
+class CheckedRedBlackTree : public RedBlackTree<Key, Value>
+{
+public:
+    // The number of black nodes on every path from the root down to a NULL
+    // leaf, or -1 if the paths differ, a red node has a red child or the
+    // root is red.
+    int blackHeight() const
+    {
+        RBNode<Key, Value>* root = static_cast<RBNode<Key, Value>*>(this->root_);
+        if(root != nullptr && root->getColor() != RBNode<Key, Value>::BLACK){
+            return -1;
+        }
+        return blackHeight(root);
+    }
+
+private:
+    static int blackHeight(RBNode<Key, Value>* node)
+    {
+        if(node == nullptr){
+            return 1;
+        }
+        bool red = node->getColor() == RBNode<Key, Value>::RED;
+        if(red && ((node->getLeft() != nullptr && node->getLeft()->getColor() == RBNode<Key, Value>::RED)
+            || (node->getRight() != nullptr && node->getRight()->getColor() == RBNode<Key, Value>::RED))){
+            return -1;
+        }
+        int left = blackHeight(node->getLeft());
+        int right = blackHeight(node->getRight());
+        if(left == -1 || left != right){
+            return -1;
+        }
+        return left + (red ? 0 : 1);
+    }
+};
+
+TEST(RedBlackTree, MatchesStdMap)
+{
+    CheckedRedBlackTree<int, int> tree;
+    runAgainstMap(tree, 20000, 500, 4);
+    EXPECT_GT(tree.blackHeight(), 0);
+}
+
+TEST(RedBlackTree, KeepsInvariantsThroughRemoves)
+{
+    CheckedRedBlackTree<int, int> tree;
+    map<int, int> ref;
+    for(int i = 0; i < 1000; i++){
+        tree.insert(make_pair(i, i));
+        ref[i] = i;
+        ASSERT_GT(tree.blackHeight(), 0) << "after inserting " << i;
+    }
+    // every other key, then the rest from the top down
+    for(int i = 0; i < 1000; i += 2){
+        tree.remove(i);
+        ref.erase(i);
+        ASSERT_GT(tree.blackHeight(), 0) << "after removing " << i;
+    }
+    expectSameContents(tree, ref);
+    for(int i = 999; i > 0; i -= 2){
+        tree.remove(i);
+        ASSERT_NE(-1, tree.blackHeight()) << "after removing " << i;
+    }
+    EXPECT_TRUE(tree.empty());
+}
+
+TEST(TopDownAVLTree, MatchesStdMap)
+{
+    TopDownAVLTree<int, int> tree;
+    runAgainstMap(tree, 20000, 500, 5);
+    EXPECT_TRUE(tree.isBalanced());
+}
+
+// An AVLTree subclass (Base) that keeps subtree sizes through the
+// augmentation hooks, to check that Base's updates call them.
+template<class Key, class Value, class Base>
+class SizedAVLTree : public Base
+{
+public:
+    // Whether every node's size is one more than its children's sizes.
+    bool sizesValid() const
+    {
+        return checkedSize(this->root_) != static_cast<size_t>(-1);
+    }
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) override
+    {
+        return new SizedAVLNode<Key, Value>(key, value, static_cast<SizedAVLNode<Key, Value>*>(parent));
+    }
+
+    virtual void pullUp(AVLNode<Key, Value>* node) override
+    {
+        SizedAVLNode<Key, Value>* sized = static_cast<SizedAVLNode<Key, Value>*>(node);
+        sized->setSize(1 + sizeOf(sized->getLeft()) + sizeOf(sized->getRight()));
+    }
+
+    virtual void pullUpPath(AVLNode<Key, Value>* node) override
+    {
+        for(; node != nullptr; node = node->getParent()){
+            pullUp(node);
+        }
+    }
+
+private:
+    static size_t sizeOf(const SizedAVLNode<Key, Value>* node)
+    {
+        return node == nullptr ? 0 : node->getSize();
+    }
+
+    static size_t checkedSize(const Node<Key, Value>* node)
+    {
+        if(node == nullptr){
+            return 0;
+        }
+        size_t left = checkedSize(node->getLeft());
+        size_t right = checkedSize(node->getRight());
+        const size_t BAD = static_cast<size_t>(-1);
+        if(left == BAD || right == BAD || static_cast<const SizedAVLNode<Key, Value>*>(node)->getSize() != left + right + 1){
+            return BAD;
+        }
+        return left + right + 1;
+    }
+};
+
+TEST(TopDownAVLTree, CallsAugmentationHooks)
+{
+    SizedAVLTree<int, int, TopDownAVLTree<int, int> > tree;
+    srand(6);
+    for(int i = 0; i < 3000; i++){
+        int key = rand() % 300;
+        if(rand() % 3 == 0){
+            tree.remove(key);
+        } else {
+            tree.insert(make_pair(key, i));
+        }
+        ASSERT_TRUE(tree.sizesValid()) << "after " << i << " ops";
+    }
+}
+
+// Applies batch to ref as applyBatch should: in batch order, so the last
+// update of a key wins.
+void applyToMap(map<int, int>& ref, const vector<BatchUpdate<int, int> >& batch)
+{
+    for(size_t i = 0; i < batch.size(); i++){
+        if(batch[i].op == BatchUpdate<int, int>::PUT){
+            ref[batch[i].key] = batch[i].value;
+        } else {
+            ref.erase(batch[i].key);
+        }
+    }
+}
+
+// A batch of count random puts and erases (erases with odds 1 in
+// eraseOdds) over keys in [0, keys), with repeated keys.
+vector<BatchUpdate<int, int> > randomBatch(size_t count, int keys, int eraseOdds, int tag)
+{
+    vector<BatchUpdate<int, int> > batch;
+    for(size_t i = 0; i < count; i++){
+        int key = rand() % keys;
+        if(rand() % eraseOdds == 0){
+            batch.push_back(BatchUpdate<int, int>::erase(key));
+        } else {
+            batch.push_back(BatchUpdate<int, int>::put(key, tag + static_cast<int>(i)));
+        }
+    }
+    return batch;
+}
+
+TEST(BatchedAVLTree, LastWriterWins)
+{
+    BatchedAVLTree<int, int> tree;
+    tree.insert(make_pair(5, 50));
+    tree.insert(make_pair(6, 60));
+    vector<BatchUpdate<int, int> > batch;
+    batch.push_back(BatchUpdate<int, int>::put(1, 10));
+    batch.push_back(BatchUpdate<int, int>::erase(1));
+    batch.push_back(BatchUpdate<int, int>::put(2, 20));
+    batch.push_back(BatchUpdate<int, int>::put(2, 21));
+    batch.push_back(BatchUpdate<int, int>::erase(5));
+    batch.push_back(BatchUpdate<int, int>::put(5, 51));
+    batch.push_back(BatchUpdate<int, int>::put(6, 61));
+    batch.push_back(BatchUpdate<int, int>::erase(6));
+    batch.push_back(BatchUpdate<int, int>::erase(7));
+    for(unsigned int threads = 1; threads <= 4; threads += 3){
+        BatchedAVLTree<int, int> copy;
+        copy.insert(make_pair(5, 50));
+        copy.insert(make_pair(6, 60));
+        copy.applyBatch(batch, threads);
+        map<int, int> ref;
+        ref[2] = 21;
+        ref[5] = 51;
+        expectSameContents(copy, ref);
+    }
+    tree.applyBatch(vector<BatchUpdate<int, int> >());
+    EXPECT_EQ(50, tree[5]);
+}
+
+TEST(BatchedAVLTree, MatchesStdMap)
+{
+    // small batches take the finger path (climbing or from the root),
+    // batches about as large as the tree take mergeRebuild with threads
+    const size_t sizes[] = { 1, 7, 100, 3000, 80000 };
+    for(unsigned int threads = 1; threads <= 4; threads += 3){
+        BatchedAVLTree<int, int> tree;
+        map<int, int> ref;
+        srand(24 + threads);
+        for(int round = 0; round < 20; round++){
+            size_t count = sizes[round % 5];
+            vector<BatchUpdate<int, int> > batch = randomBatch(count, 100000, round % 2 ? 3 : 8, round * 100000);
+            tree.applyBatch(batch, threads);
+            applyToMap(ref, batch);
+            ASSERT_TRUE(tree.isBalanced()) << "round " << round << ", " << threads << " threads";
+            expectSameContents(tree, ref);
+        }
+        // erase everything in one batch
+        vector<BatchUpdate<int, int> > batch;
+        for(map<int, int>::iterator r = ref.begin(); r != ref.end(); ++r){
+            batch.push_back(BatchUpdate<int, int>::erase(r->first));
+        }
+        tree.applyBatch(batch, threads);
+        EXPECT_TRUE(tree.empty());
+    }
+}
+
+TEST(BatchedAVLTree, CallsAugmentationHooks)
+{
+    for(unsigned int threads = 1; threads <= 4; threads += 3){
+        SizedAVLTree<int, int, BatchedAVLTree<int, int> > tree;
+        srand(26);
+        const size_t sizes[] = { 50, 80000, 500 };
+        for(int round = 0; round < 3; round++){
+            tree.applyBatch(randomBatch(sizes[round], 100000, 4, 0), threads);
+            ASSERT_TRUE(tree.sizesValid()) << "round " << round << ", " << threads << " threads";
+            EXPECT_TRUE(tree.isBalanced());
+        }
+    }
+}
+
+TEST(AVLMultiMap, MatchesStdMultimap)
+{
+    AVLMultiMap<int, int> tree;
+    multimap<int, int> ref;
+    srand(11);
+    for(int i = 0; i < 4000; i++){
+        int key = rand() % 64;
+        int op = rand() % 8;
+        if(op < 5){
+            tree.insert(make_pair(key, i));
+            ref.insert(make_pair(key, i));
+        } else if(op < 7){
+            multimap<int, int>::iterator r = ref.find(key);
+            EXPECT_EQ(r != ref.end(), tree.removeOne(key));
+            if(r != ref.end()){
+                ref.erase(r);
+            }
+        } else {
+            tree.remove(key);
+            ref.erase(key);
+        }
+        EXPECT_EQ(ref.count(key), tree.count(key)) << "count(" << key << ") after " << i << " ops";
+    }
+    EXPECT_EQ(ref.size(), tree.size());
+    for(int key = -1; key <= 64; key++){
+        // equal keys come back in insertion order, as in std::multimap
+        pair<AVLMultiMap<int, int>::iterator, AVLMultiMap<int, int>::iterator> range = tree.equalRange(key);
+        pair<multimap<int, int>::iterator, multimap<int, int>::iterator> expected = ref.equal_range(key);
+        for(; expected.first != expected.second; ++expected.first, ++range.first){
+            ASSERT_TRUE(range.first != range.second) << "equalRange(" << key << ") ends early";
+            EXPECT_EQ(key, range.first->first);
+            EXPECT_EQ(expected.first->second, range.first->second);
+        }
+        EXPECT_TRUE(range.first == range.second);
+    }
+    EXPECT_TRUE(tree.isBalanced());
+}
+
+TEST(AVLMultiSet, CountsCopies)
+{
+    AVLMultiSet<int> set;
+    map<int, size_t> ref;
+    size_t total = 0;
+    srand(12);
+    for(int i = 0; i < 4000; i++){
+        int key = rand() % 64;
+        int op = rand() % 4;
+        if(op < 2){
+            size_t copies = op == 0 ? 1 : rand() % 4;
+            set.insert(make_pair(key, copies));
+            if(copies != 0){
+                ref[key] += copies;
+            }
+            total += copies;
+        } else if(op == 2){
+            EXPECT_EQ(ref.count(key) != 0, set.removeOne(key));
+            if(ref.count(key) != 0){
+                total--;
+                if(--ref[key] == 0){
+                    ref.erase(key);
+                }
+            }
+        } else {
+            total -= ref.count(key) ? ref[key] : 0;
+            set.remove(key);
+            ref.erase(key);
+        }
+        EXPECT_EQ(ref.count(key) ? ref[key] : 0, set.count(key)) << "count(" << key << ") after " << i << " ops";
+    }
+    EXPECT_EQ(total, set.size());
+    expectSameContents(set, ref);
+
+    // clear through a base reference resets size() too
+    AVLTree<int, size_t>& base = set;
+    base.clear();
+    EXPECT_EQ(0u, set.size());
+    EXPECT_TRUE(set.begin() == set.end());
+    set.insert(3);
+    set.insert(3);
+    EXPECT_EQ(2u, set.size());
+    EXPECT_EQ(2u, set[3]);
+    EXPECT_THROW(set[4], std::out_of_range);
+}
+
+// Collects the values an IntervalTree query visits, in visiting order.
+struct CollectValues {
+    vector<int>* values;
+    void operator()(const pair<const Interval<int>, int>& item) const { values->push_back(item.second); }
+};
+
+TEST(IntervalTree, StabAndOverlapMatchScan)
+{
+    IntervalTree<int, int> tree;
+    // keyed like the tree, so equal intervals keep their insertion order
+    multimap<pair<int, int>, int> ref;
+    srand(13);
+    for(int i = 0; i < 3000; i++){
+        int low = rand() % 1000;
+        int high = low + (rand() % 8 == 0 ? rand() % 500 : rand() % 20);
+        if(rand() % 4 != 0){
+            tree.insert(make_pair(Interval<int>(low, high), i));
+            ref.insert(make_pair(make_pair(low, high), i));
+        } else if(!ref.empty()){
+            // remove an interval that is there: the first at or after
+            // (low, low), which lower_bound finds first among its equals
+            multimap<pair<int, int>, int>::iterator r = ref.lower_bound(make_pair(low, low));
+            if(r == ref.end()){
+                r = ref.begin();
+            }
+            EXPECT_TRUE(tree.removeOne(Interval<int>(r->first.first, r->first.second)));
+            ref.erase(r);
+        }
+        if(i % 50 != 0){
+            continue;
+        }
+        int qlow = rand() % 1100 - 50;
+        int qhigh = qlow + (i % 100 == 0 ? 0 : rand() % 100);
+        vector<int> stabbed, overlapped, expectedStab, expectedOverlap;
+        for(multimap<pair<int, int>, int>::iterator r = ref.begin(); r != ref.end(); ++r){
+            if(r->first.first <= qlow && qlow <= r->first.second){
+                expectedStab.push_back(r->second);
+            }
+            if(r->first.first <= qhigh && qlow <= r->first.second){
+                expectedOverlap.push_back(r->second);
+            }
+        }
+        CollectValues stab = { &stabbed };
+        CollectValues overlap = { &overlapped };
+        EXPECT_EQ(expectedStab.size(), tree.stab(qlow, stab));
+        EXPECT_EQ(expectedStab, stabbed) << "stab(" << qlow << ") after " << i << " ops";
+        EXPECT_EQ(expectedOverlap.size(), tree.overlap(qlow, qhigh, overlap));
+        EXPECT_EQ(expectedOverlap, overlapped) << "overlap(" << qlow << ", " << qhigh << ") after " << i << " ops";
+    }
+    EXPECT_EQ(ref.size(), tree.size());
+    EXPECT_TRUE(tree.isBalanced());
+}
+
+// The aggregate of ref's values with lo <= key <= hi, combined in key order.
+template<class Aggregate>
+typename Aggregate::type scanAggregate(const map<int, typename Aggregate::type>& ref, int lo, int hi)
+{
+    typename Aggregate::type total = Aggregate::identity();
+    for(typename map<int, typename Aggregate::type>::const_iterator r = ref.lower_bound(lo); r != ref.end() && r->first <= hi; ++r){
+        total = Aggregate::combine(total, Aggregate::lift(r->second));
+    }
+    return total;
+}
+
+// Runs random inserts (overwrites among them) and removes against tree and
+// a std::map, checking range aggregates against a scan as it goes.
+template<class Aggregate>
+void runAggregates(unsigned seed)
+{
+    typedef typename Aggregate::type V;
+    AggregateAVLTree<int, V, Aggregate> tree;
+    map<int, V> ref;
+    srand(seed);
+    for(int i = 0; i < 3000; i++){
+        int key = rand() % 200;
+        if(rand() % 3 != 0){
+            V value = V(1 + rand() % 9);
+            tree.insert(make_pair(key, value));
+            ref[key] = value;
+        } else {
+            tree.remove(key);
+            ref.erase(key);
+        }
+        int lo = rand() % 220 - 10;
+        int hi = lo + rand() % 60;
+        ASSERT_EQ(scanAggregate<Aggregate>(ref, lo, hi), tree.aggregate(lo, hi)) << "aggregate(" << lo << ", " << hi << ") after " << i << " ops";
+        ASSERT_EQ(scanAggregate<Aggregate>(ref, hi, lo), tree.aggregate(hi, lo));
+    }
+    EXPECT_EQ(scanAggregate<Aggregate>(ref, -1, 200), tree.aggregate());
+    // compacting copies the summaries along with the nodes
+    tree.compact();
+    for(int lo = -1; lo < 200; lo += 7){
+        EXPECT_EQ(scanAggregate<Aggregate>(ref, lo, lo + 50), tree.aggregate(lo, lo + 50));
+    }
+}
+
+TEST(AggregateAVLTree, SumMinMaxMatchScan)
+{
+    runAggregates<SumAggregate<int64_t> >(14);
+    runAggregates<MinAggregate<int> >(15);
+    runAggregates<MaxAggregate<double> >(16);
+}
+
+TEST(AggregateAVLTree, CombinesInKeyOrder)
+{
+    // string concatenation is not commutative, so the order shows
+    AggregateAVLTree<int, string, SumAggregate<string> > tree;
+    const char* letters = "jdbhfaicge";
+    for(int i = 0; letters[i] != 0; i++){
+        tree.insert(make_pair(letters[i] - 'a', string(1, letters[i])));
+    }
+    EXPECT_EQ("abcdefghij", tree.aggregate());
+    EXPECT_EQ("cdefg", tree.aggregate(2, 6));
+    EXPECT_EQ("", tree.aggregate(20, 30));
+    tree.insert(make_pair(4, string("E")));
+    tree.remove(5);
+    EXPECT_EQ("cdEg", tree.aggregate(2, 6));
+
+    vector<pair<int, string> > items;
+    items.push_back(make_pair(1, string("x")));
+    items.push_back(make_pair(2, string("y")));
+    items.push_back(make_pair(3, string("z")));
+    tree.buildFromSorted(items);
+    EXPECT_EQ("xyz", tree.aggregate());
+    EXPECT_EQ("yz", tree.aggregate(2, 9));
+}
+
+// Fills tree with random items, compacts it with layout, and checks that
+// the contents and shape are unchanged, that every node moved into the
+// arena, and that iterators taken afterwards walk the moved nodes. Then
+// churns and empties the tree, which must free the arena block.
+template<class Tree>
+void expectCompactKeepsTree(Tree& tree, typename Tree::Layout layout, unsigned seed)
+{
+    map<int, int> ref;
+    srand(seed);
+    for(int i = 0; i < 3000; i++){
+        int key = rand() % 1000;
+        if(rand() % 4 != 0){
+            tree.insert(make_pair(key, i));
+            ref[key] = i;
+        } else {
+            tree.remove(key);
+            ref.erase(key);
+        }
+    }
+    LeafDepthReport before = analyzeTreeShape(tree);
+    tree.compact(layout);
+    LeafDepthReport after = analyzeTreeShape(tree);
+    EXPECT_EQ(before.height, after.height);
+    EXPECT_EQ(before.histogram, after.histogram);
+    EXPECT_EQ(ref.size(), tree.memoryUsage().arenaNodes);
+    expectSameContents(tree, ref);
+    for(map<int, int>::iterator r = ref.begin(); r != ref.end(); ++r){
+        typename Tree::iterator it = tree.find(r->first);
+        ASSERT_TRUE(it != tree.end()) << "find(" << r->first << ") after compact";
+        EXPECT_EQ(r->second, it->second);
+        map<int, int>::iterator next = r;
+        ++next;
+        ++it;
+        EXPECT_EQ(next == ref.end(), it == tree.end());
+        if(next != ref.end() && it != tree.end()){
+            EXPECT_EQ(next->first, it->first);
+        }
+    }
+
+    for(int i = 0; i < 3000; i++){
+        int key = rand() % 1000;
+        if(rand() % 2 != 0){
+            tree.insert(make_pair(key, -i));
+            ref[key] = -i;
+        } else {
+            tree.remove(key);
+            ref.erase(key);
+        }
+    }
+    expectSameContents(tree, ref);
+    for(map<int, int>::iterator r = ref.begin(); r != ref.end(); ++r){
+        tree.remove(r->first);
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(0u, tree.memoryUsage().allocatedBytes);
+}
+
+TEST(Compact, KeepsContentsAndShape)
+{
+    BinarySearchTree<int, int> bst;
+    expectCompactKeepsTree(bst, BinarySearchTree<int, int>::IN_ORDER, 17);
+    AVLTree<int, int> avl;
+    expectCompactKeepsTree(avl, AVLTree<int, int>::VAN_EMDE_BOAS, 18);
+    CheckedRedBlackTree<int, int> rb;
+    expectCompactKeepsTree(rb, RedBlackTree<int, int>::VAN_EMDE_BOAS, 19);
+    Treap<int, int> treap;
+    expectCompactKeepsTree(treap, Treap<int, int>::IN_ORDER, 20);
+}
+
+TEST(Compact, KeepsNodeAugmentations)
+{
+    CheckedRedBlackTree<int, int> rb;
+    AVLMultiMap<int, int> multi;
+    for(int i = 0; i < 500; i++){
+        rb.insert(make_pair(i * 7 % 500, i));
+        multi.insert(make_pair(i % 50, i));
+    }
+    int blackHeight = rb.blackHeight();
+    rb.compact();
+    multi.compact();
+    EXPECT_GT(blackHeight, 0);
+    EXPECT_EQ(blackHeight, rb.blackHeight());
+    EXPECT_EQ(500u, multi.size());
+    EXPECT_EQ(10u, multi.count(7));
+    // the moved nodes keep rebalancing as before
+    for(int i = 0; i < 250; i++){
+        rb.remove(i);
+        EXPECT_TRUE(multi.removeOne(i % 50));
+    }
+    EXPECT_GT(rb.blackHeight(), 0);
+    EXPECT_EQ(250u, multi.size());
+    EXPECT_EQ(5u, multi.count(7));
+    EXPECT_TRUE(multi.isBalanced());
+}
+
+TEST(VebLayoutTree, MatchesSortedKeys)
+{
+    // every size up to a few full levels, so each padding case comes up
+    for(int n = 0; n <= 140; n++){
+        AVLTree<int, int> tree;
+        vector<int> keys;
+        for(int i = 0; i < n; i++){
+            keys.push_back(3 * i + 1);
+            tree.insert(make_pair(3 * i + 1, -i));
+        }
+        VebLayoutTree<int, int> snapshot(tree);
+        ASSERT_EQ(keys.size(), snapshot.size());
+        EXPECT_EQ(n == 0, snapshot.empty());
+        for(int key = -1; key <= 3 * n + 2; key++){
+            size_t rank = lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            ASSERT_EQ(rank, snapshot.lowerBound(key)) << "lowerBound(" << key << ") with " << n << " keys";
+            bool present = key % 3 == 1 && key <= 3 * n - 2;
+            int value = 1;
+            EXPECT_EQ(present, snapshot.find(key, value));
+            EXPECT_EQ(present, snapshot.contains(key));
+            EXPECT_EQ(present ? -(key / 3) : 1, value);
+        }
+        for(int i = 0; i < n; i++){
+            EXPECT_EQ(keys[i], snapshot.at(i).first);
+            EXPECT_EQ(-i, snapshot.at(i).second);
+        }
+        EXPECT_THROW(snapshot.at(n), std::out_of_range);
+    }
+}
+
+TEST(VebLayoutTree, RebuildsFromLargerTree)
+{
+    AVLTree<int, int> tree;
+    map<int, int> ref;
+    runAgainstMap(tree, 20000, 5000, 22);
+    for(AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it){
+        ref[it->first] = it->second;
+    }
+    VebLayoutTree<int, int> snapshot;
+    snapshot.build(tree);
+    EXPECT_EQ(ref.size(), snapshot.size());
+    for(int key = -1; key <= 5000; key++){
+        map<int, int>::iterator r = ref.find(key);
+        int value;
+        ASSERT_EQ(r != ref.end(), snapshot.find(key, value)) << "find(" << key << ")";
+        if(r != ref.end()){
+            EXPECT_EQ(r->second, value);
+        }
+        size_t rank = snapshot.lowerBound(key);
+        map<int, int>::iterator bound = ref.lower_bound(key);
+        EXPECT_EQ(static_cast<size_t>(distance(ref.begin(), bound)), rank);
+    }
+    // a rebuild replaces the old contents
+    tree.clear();
+    tree.insert(make_pair(7, 70));
+    snapshot.build(tree);
+    EXPECT_EQ(1u, snapshot.size());
+    EXPECT_EQ(0u, snapshot.lowerBound(7));
+    EXPECT_EQ(1u, snapshot.lowerBound(8));
+    EXPECT_FALSE(snapshot.contains(6));
+}
+
+// Checks index against ref for every key in [lo, hi], and a spread of
+// keys far outside it.
+template<class Key>
+void expectIndexMatches(const LearnedIndex<Key, int>& index, const map<Key, int>& ref, Key lo, Key hi)
+{
+    EXPECT_EQ(ref.size(), index.size());
+    for(Key key = lo; key <= hi; key++){
+        typename map<Key, int>::const_iterator r = ref.find(key);
+        int value = 0;
+        ASSERT_EQ(r != ref.end(), index.find(key, value)) << "find(" << key << ")";
+        EXPECT_EQ(r != ref.end(), index.contains(key));
+        if(r != ref.end()){
+            EXPECT_EQ(r->second, value);
+        }
+    }
+    int value;
+    EXPECT_EQ(ref.count(numeric_limits<Key>::min()) != 0, index.find(numeric_limits<Key>::min(), value));
+    EXPECT_EQ(ref.count(numeric_limits<Key>::max()) != 0, index.find(numeric_limits<Key>::max(), value));
+}
+
+TEST(LearnedIndex, FindsAfterInsertAndRebuild)
+{
+    const size_t epsilons[] = { 1, 4, 64 };
+    for(size_t e = 0; e < 3; e++){
+        // clustered keys on both sides of zero, so segments break often
+        AVLTree<long, int> tree;
+        map<long, int> ref;
+        srand(23 + e);
+        for(int i = 0; i < 3000; i++){
+            long key = (rand() % 2 ? -1 : 1) * (rand() % 4 == 0 ? rand() % 20000 : rand() % 500);
+            tree.insert(make_pair(key, i));
+            ref[key] = i;
+        }
+        LearnedIndex<long, int> index(epsilons[e]);
+        index.build(tree);
+        EXPECT_GT(index.segments(), 0u);
+        expectIndexMatches(index, ref, -20001L, 20001L);
+
+        // inserts overwrite keys in the arrays and buffer the rest
+        size_t buffered = 0;
+        for(int i = 0; i < 500; i++){
+            long key = rand() % 30000 - 15000;
+            if(ref.count(key) == 0){
+                buffered++;
+            }
+            index.insert(make_pair(key, -i));
+            ref[key] = -i;
+        }
+        EXPECT_LE(index.deltaSize(), buffered);
+        expectIndexMatches(index, ref, -20001L, 20001L);
+        index.rebuild();
+        EXPECT_EQ(0u, index.deltaSize());
+        expectIndexMatches(index, ref, -20001L, 20001L);
+    }
+
+    // keys at the ends of the range
+    AVLTree<uint64_t, int> tree;
+    map<uint64_t, int> ref;
+    for(int i = 0; i < 100; i++){
+        tree.insert(make_pair(static_cast<uint64_t>(i), i));
+        ref[i] = i;
+        tree.insert(make_pair(numeric_limits<uint64_t>::max() - i, -i));
+        ref[numeric_limits<uint64_t>::max() - i] = -i;
+    }
+    LearnedIndex<uint64_t, int> index(4);
+    index.build(tree);
+    expectIndexMatches(index, ref, uint64_t(0), uint64_t(200));
+    expectIndexMatches(index, ref, numeric_limits<uint64_t>::max() - 200, numeric_limits<uint64_t>::max() - 1);
+    index.insert(make_pair(uint64_t(1) << 63, 7));
+    index.rebuild();
+    ref[uint64_t(1) << 63] = 7;
+    expectIndexMatches(index, ref, (uint64_t(1) << 63) - 10, (uint64_t(1) << 63) + 10);
+}
+
+// Exposes fitLevel, to feed it keys no tree would give it.
+class CheckedLearnedIndex : public LearnedIndex<int, int>
+{
+public:
+    using LearnedIndex<int, int>::Level;
+
+    static Level fitted(const vector<int>& keys, size_t epsilon)
+    {
+        Level level;
+        fitLevel(keys, epsilon, level);
+        return level;
+    }
+
+    static double slope(const Level& level, size_t segment) { return level.segments[segment].slope; }
+    static size_t start(const Level& level, size_t segment) { return level.segments[segment].start; }
+};
+
+TEST(LearnedIndex, EqualKeysStartSegments)
+{
+    // a copy of a segment's first key starts the next segment; copies of
+    // later keys fit within epsilon like any other key
+    int keys[] = { 3, 3, 3, 4, 5, 5, 6 };
+    CheckedLearnedIndex::Level level = CheckedLearnedIndex::fitted(vector<int>(keys, keys + 7), 4);
+    ASSERT_EQ(3u, level.segments.size());
+    EXPECT_EQ(0u, CheckedLearnedIndex::start(level, 0));
+    EXPECT_EQ(1u, CheckedLearnedIndex::start(level, 1));
+    EXPECT_EQ(2u, CheckedLearnedIndex::start(level, 2));
+    for(size_t i = 0; i < level.segments.size(); i++){
+        double slope = CheckedLearnedIndex::slope(level, i);
+        EXPECT_TRUE(slope == slope && slope >= 0 && slope < 1e9) << "segment " << i << " slope " << slope;
+    }
+}
+
+// Runs random cursor operations against tree and a std::map: insertNear
+// and findNear from the last iterator an operation returned, removeAt of
+// an item found that way, and plain inserts and removes in between.
+// Checks every returned iterator (removeAt's must be the successor), and
+// calls check(tree) every 100 operations and at the end.
+template<class Tree, class Check>
+void runCursorOps(Tree& tree, int ops, int keys, unsigned seed, Check check)
+{
+    map<int, int> ref;
+    typename Tree::iterator hint = tree.end();
+    srand(seed);
+    for(int i = 0; i < ops; i++){
+        int key = rand() % keys;
+        int op = rand() % 6;
+        if(op < 2){
+            typename Tree::iterator it = tree.insertNear(hint, make_pair(key, i));
+            ref[key] = i;
+            ASSERT_TRUE(it != tree.end());
+            EXPECT_EQ(key, it->first);
+            EXPECT_EQ(i, it->second);
+            hint = it;
+        } else if(op == 2){
+            typename Tree::iterator it = tree.findNear(hint, key);
+            map<int, int>::iterator r = ref.find(key);
+            ASSERT_EQ(r == ref.end(), it == tree.end()) << "findNear(" << key << ") after " << i << " ops";
+            if(r != ref.end()){
+                EXPECT_EQ(r->second, it->second);
+                hint = it;
+            }
+        } else if(op == 3){
+            typename Tree::iterator it = tree.findNear(hint, key);
+            if(it == tree.end()){
+                continue;
+            }
+            typename Tree::iterator next = tree.removeAt(it);
+            ref.erase(key);
+            map<int, int>::iterator r = ref.upper_bound(key);
+            ASSERT_EQ(r == ref.end(), next == tree.end()) << "removeAt(" << key << ") after " << i << " ops";
+            if(r != ref.end()){
+                EXPECT_EQ(r->first, next->first);
+                EXPECT_EQ(r->second, next->second);
+            }
+            hint = next;
+        } else if(op == 4){
+            tree.insert(make_pair(key, i));
+            ref[key] = i;
+        } else {
+            // a plain remove of the hint's item would leave it dangling
+            if(hint != tree.end() && hint->first == key){
+                hint = tree.end();
+            }
+            tree.remove(key);
+            ref.erase(key);
+        }
+        if(i % 100 == 0){
+            ASSERT_TRUE(check(tree)) << "invariants broken after " << i << " ops";
+        }
+    }
+    expectSameContents(tree, ref);
+    EXPECT_TRUE(check(tree));
+    EXPECT_THROW(tree.removeAt(tree.end()), std::out_of_range);
+}
+
+// Exposes the treap's heap order on priorities.
+template<class Key, class Value>
+class CheckedTreap : public Treap<Key, Value>
+{
+public:
+    bool heapOrdered() const
+    {
+        return heapOrdered(static_cast<TreapNode<Key, Value>*>(this->root_));
+    }
+
+private:
+    static bool heapOrdered(const TreapNode<Key, Value>* node)
+    {
+        if(node == nullptr){
+            return true;
+        }
+        for(int side = 0; side < 2; side++){
+            const TreapNode<Key, Value>* child = side ? node->getRight() : node->getLeft();
+            if(child != nullptr && node->getPriority() < child->getPriority()){
+                return false;
+            }
+        }
+        return heapOrdered(node->getLeft()) && heapOrdered(node->getRight());
+    }
+};
+
+struct IsBalanced {
+    template<class Tree>
+    bool operator()(const Tree& tree) const { return tree.isBalanced(); }
+};
+
+struct HasBlackHeight {
+    template<class Tree>
+    bool operator()(const Tree& tree) const { return tree.empty() || tree.blackHeight() > 0; }
+};
+
+struct IsHeapOrdered {
+    template<class Tree>
+    bool operator()(const Tree& tree) const { return tree.heapOrdered(); }
+};
+
+// Splay trees promise no shape; BST_VALIDATE checks the links and order.
+struct AnyShape {
+    template<class Tree>
+    bool operator()(const Tree&) const { return true; }
+};
+
+TEST(CursorOps, MatchStdMap)
+{
+    BinarySearchTree<int, int> bst;
+    runCursorOps(bst, 5000, 300, 27, AnyShape());
+    AVLTree<int, int> avl;
+    runCursorOps(avl, 20000, 500, 28, IsBalanced());
+    TopDownAVLTree<int, int> topDown;
+    runCursorOps(topDown, 20000, 500, 29, IsBalanced());
+    CheckedRedBlackTree<int, int> rb;
+    runCursorOps(rb, 20000, 500, 30, HasBlackHeight());
+    CheckedTreap<int, int> treap;
+    runCursorOps(treap, 20000, 500, 31, IsHeapOrdered());
+    SplayTree<int, int> splay;
+    runCursorOps(splay, 20000, 500, 32, AnyShape());
+    ReadMostlyAVLTree<int, int> readMostly;
+    runCursorOps(readMostly, 20000, 500, 34, IsBalanced());
+}
+
+TEST(CursorOps, SequentialWalk)
+{
+    // a sorted pass with each result as the next hint, the intended use
+    AVLTree<int, int> tree;
+    AVLTree<int, int>::iterator hint = tree.end();
+    for(int i = 0; i < 1000; i++){
+        hint = tree.insertNear(hint, make_pair(2 * i, i));
+    }
+    hint = tree.end();
+    for(int i = 0; i < 1000; i++){
+        hint = tree.findNear(hint, 2 * i);
+        ASSERT_TRUE(hint != tree.end());
+        EXPECT_EQ(i, hint->second);
+        EXPECT_TRUE(tree.findNear(hint, 2 * i + 1) == tree.end());
+    }
+    // remove every other item in one pass, each from the last successor
+    AVLTree<int, int>::iterator it = tree.begin();
+    while(it != tree.end()){
+        it = tree.removeAt(it);
+        if(it != tree.end()){
+            ++it;
+        }
+    }
+    EXPECT_TRUE(tree.isBalanced());
+    int expected = 2;
+    for(it = tree.begin(); it != tree.end(); ++it, expected += 4){
+        EXPECT_EQ(expected, it->first);
+    }
+    EXPECT_EQ(2002, expected);
+}
+
+TEST(CursorOps, MultiMapKeepsEveryItem)
+{
+    AVLMultiMap<int, int> tree;
+    multimap<int, int> ref;
+    AVLMultiMap<int, int>::iterator hint = tree.end();
+    srand(33);
+    for(int i = 0; i < 5000; i++){
+        int key = rand() % 50;
+        if(rand() % 3 != 0){
+            hint = tree.insertNear(hint, make_pair(key, i));
+            ref.insert(make_pair(key, i));
+            ASSERT_TRUE(hint != tree.end());
+            EXPECT_EQ(key, hint->first);
+            EXPECT_EQ(i, hint->second);
+        } else if(ref.count(key) != 0){
+            // the last item with key; removeAt returns the first after them
+            pair<AVLMultiMap<int, int>::iterator, AVLMultiMap<int, int>::iterator> range = tree.equalRange(key);
+            AVLMultiMap<int, int>::iterator last = range.first;
+            for(AVLMultiMap<int, int>::iterator it = range.first; it != range.second; ++it){
+                last = it;
+            }
+            int value = last->second;
+            hint = tree.removeAt(last);
+            EXPECT_TRUE(hint == range.second);
+            multimap<int, int>::iterator r = ref.equal_range(key).first;
+            while(r->second != value){
+                ++r;
+            }
+            ref.erase(r);
+        }
+        EXPECT_EQ(ref.count(key), tree.count(key));
+    }
+    EXPECT_EQ(ref.size(), tree.size());
+    EXPECT_TRUE(tree.isBalanced());
+}
+
+// A value larger than a cache line, which counts its live copies.
+struct BigRecord {
+    static int live;
+    int id;
+    char payload[120];
+
+    BigRecord(int i = 0) : id(i) { payload[0] = static_cast<char>(i); live++; }
+    BigRecord(const BigRecord& other) : id(other.id) { payload[0] = other.payload[0]; live++; }
+    BigRecord& operator=(const BigRecord& other) { id = other.id; payload[0] = other.payload[0]; return *this; }
+    ~BigRecord() { live--; }
+};
+
+int BigRecord::live = 0;
+
+std::ostream& operator<<(std::ostream& out, const BigRecord& record)
+{
+    return out << record.id;
+}
+
+TEST(ColdValue, TreeRoundTrip)
+{
+    {
+        AVLTree<int, ColdValue<BigRecord> > tree;
+        map<int, int> ref;
+        srand(36);
+        for(int i = 0; i < 5000; i++){
+            int key = rand() % 400;
+            if(rand() % 3 == 0){
+                tree.remove(key);
+                ref.erase(key);
+            } else {
+                tree.insert(make_pair(key, ColdValue<BigRecord>(BigRecord(i))));
+                ref[key] = i;
+            }
+        }
+        tree.compact();
+        AVLTree<int, ColdValue<BigRecord> >::iterator it = tree.begin();
+        for(map<int, int>::iterator r = ref.begin(); r != ref.end(); ++r, ++it){
+            ASSERT_TRUE(it != tree.end());
+            EXPECT_EQ(r->first, it->first);
+            EXPECT_EQ(r->second, it->second->id);
+            EXPECT_EQ(static_cast<char>(r->second), (*it->second).payload[0]);
+        }
+        EXPECT_TRUE(it == tree.end());
+        EXPECT_EQ(static_cast<int>(ref.size()), BigRecord::live);
+    }
+    EXPECT_EQ(0, BigRecord::live);
+    EXPECT_TRUE((std::is_same<ColdIfLarge<BigRecord>::type, ColdValue<BigRecord> >::value));
+    EXPECT_TRUE((std::is_same<ColdIfLarge<int>::type, int>::value));
+}
+
+TEST(ColdValue, CopyAndMove)
+{
+    {
+        ColdValue<BigRecord> a(BigRecord(1));
+        ColdValue<BigRecord> b(BigRecord(2));
+        ColdValue<BigRecord> c(a);
+        EXPECT_EQ(1, c->id);
+        EXPECT_NE(&*a, &*c);
+        c = b;
+        EXPECT_EQ(2, c->id);
+        c = c;
+        EXPECT_EQ(2, c->id);
+
+        // moving hands the slot over and leaves the source empty
+        const BigRecord* slot = &*b;
+        ColdValue<BigRecord> d(std::move(b));
+        EXPECT_EQ(slot, &*d);
+        EXPECT_TRUE(b.empty());
+        // copies of an empty value are empty
+        ColdValue<BigRecord> e(b);
+        EXPECT_TRUE(e.empty());
+        c = b;
+        EXPECT_TRUE(c.empty());
+        // and an empty value can be assigned to again
+        c = a;
+        EXPECT_EQ(1, c->id);
+        b = d;
+        EXPECT_EQ(2, b->id);
+        a = std::move(d);
+        EXPECT_EQ(2, a->id);
+        EXPECT_EQ(1, d->id);
+        EXPECT_EQ(4, BigRecord::live);
+    }
+    EXPECT_EQ(0, BigRecord::live);
+}
+
+TEST(ColdValue, ReusesFreedSlots)
+{
+    const BigRecord* slot;
+    {
+        ColdValue<BigRecord> value(BigRecord(7));
+        slot = &*value;
+    }
+    // the slab's free list is LIFO, so the next value takes the same slot
+    ColdValue<BigRecord> value(BigRecord(8));
+    EXPECT_EQ(slot, &*value);
+    ColdValue<BigRecord> moved(std::move(value));
+    moved = ColdValue<BigRecord>(BigRecord(9));
+    EXPECT_EQ(9, moved->id);
+}
+
+TEST(RecordingTree, RecordsReadsThroughBaseReferences)
+{
+    string path = "/tmp/bst-gtest-trace-" + to_string(::getpid());
+    {
+        TraceWriter writer(path);
+        RecordingTree<uint64_t, int> tree(writer);
+        tree.insert(make_pair(uint64_t(1), 10));
+        tree.insert(make_pair(uint64_t(2), 20));
+        BinarySearchTree<uint64_t, int>& base = tree;
+        EXPECT_TRUE(base.find(1) != base.end());
+        EXPECT_TRUE(base.findNear(base.begin(), 2) != base.end());
+        EXPECT_EQ(20, tree[2]);
+        const BinarySearchTree<uint64_t, int>& constBase = tree;
+        EXPECT_EQ(10, constBase[1]);
+        EXPECT_THROW(base[3], std::out_of_range);
+        base.remove(1);
+    }
+    vector<TraceRecord> records = readTrace(path);
+    std::remove(path.c_str());
+    const uint8_t ops[] = { TRACE_INSERT, TRACE_INSERT, TRACE_FIND, TRACE_FIND, TRACE_FIND, TRACE_FIND, TRACE_FIND, TRACE_REMOVE };
+    const uint64_t keys[] = { 1, 2, 1, 2, 2, 1, 3, 1 };
+    ASSERT_EQ(sizeof(ops), records.size());
+    for(size_t i = 0; i < records.size(); i++){
+        EXPECT_EQ(ops[i], records[i].op) << "record " << i;
+        EXPECT_EQ(keys[i], records[i].key) << "record " << i;
+    }
+}
+
+TEST(ShardedAVLMap, SplitsUnderConcurrentTraffic)
+{
+    const int THREADS = 4;
+    const int KEYS = 40000;
+    ShardedAVLMap<int, int> sharded(vector<int>(), 64);
+    for(int key = 0; key < KEYS; key += 2){
+        sharded.insert(make_pair(key, key));
+    }
+
+    // each writer owns the keys equal to its index mod THREADS, so it can
+    // check its own finds against its own std::map while splits go on
+    vector<map<int, int> > refs(THREADS);
+    vector<int> mismatches(THREADS, 0);
+    std::atomic<bool> done(false);
+    vector<std::thread> writers;
+    for(int t = 0; t < THREADS; t++){
+        for(int key = t; key < KEYS; key += THREADS){
+            if(key % 2 == 0){
+                refs[t][key] = key;
+            }
+        }
+        writers.push_back(std::thread([&, t]() {
+            unsigned seed = 100 + t;
+            for(int i = 0; i < 100000; i++){
+                int key = static_cast<int>(rand_r(&seed) % (KEYS / THREADS)) * THREADS + t;
+                int op = rand_r(&seed) % 3;
+                if(op == 0){
+                    sharded.insert(make_pair(key, i));
+                    refs[t][key] = i;
+                } else if(op == 1){
+                    sharded.remove(key);
+                    refs[t].erase(key);
+                } else {
+                    int value = -1;
+                    bool found = sharded.find(key, value);
+                    map<int, int>::iterator r = refs[t].find(key);
+                    if(found != (r != refs[t].end()) || (found && value != r->second)){
+                        mismatches[t]++;
+                    }
+                }
+            }
+        }));
+    }
+    std::thread splitter([&]() {
+        unsigned seed = 7;
+        while(!done.load()){
+            sharded.splitShardOf(static_cast<int>(rand_r(&seed) % KEYS));
+        }
+    });
+    for(int t = 0; t < THREADS; t++){
+        writers[t].join();
+    }
+    done.store(true);
+    splitter.join();
+
+    for(int t = 0; t < THREADS; t++){
+        EXPECT_EQ(0, mismatches[t]) << "writer " << t;
+    }
+    EXPECT_GT(sharded.shardCount(), 1u);
+    map<int, int> ref;
+    for(int t = 0; t < THREADS; t++){
+        ref.insert(refs[t].begin(), refs[t].end());
+    }
+    ShardedAVLMap<int, int>::iterator it = sharded.begin();
+    for(map<int, int>::iterator r = ref.begin(); r != ref.end(); ++r, ++it){
+        ASSERT_TRUE(it != sharded.end());
+        ASSERT_EQ(r->first, it->first);
+        EXPECT_EQ(r->second, it->second);
+    }
+    EXPECT_TRUE(it == sharded.end());
+}
+
+TEST(ReadMostlyAVLTree, TwoTreesUnderConcurrentWriters)
+{
+    // Both trees retire into the one process-wide epoch domain. Even keys
+    // are always present with value 3 * key; writers insert (value
+    // 5 * key) and remove odd keys, and now and then rebuild a tree from
+    // the even keys or compact it, retiring all of its nodes at once.
+    const uint64_t KEYS = 4000;
+    ReadMostlyAVLTree<uint64_t, uint64_t> trees[2];
+    vector<pair<uint64_t, uint64_t> > evens;
+    for(uint64_t key = 0; key < KEYS; key += 2){
+        evens.push_back(make_pair(key, 3 * key));
+    }
+    trees[0].buildFromSorted(evens);
+    trees[1].buildFromSorted(evens);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> errors(0);
+    vector<std::thread> threads;
+    for(int r = 0; r < 3; r++){
+        threads.push_back(std::thread([&, r]() {
+            unsigned seed = 11 + r;
+            for(uint64_t n = 0; !done.load(); n++){
+                ReadMostlyAVLTree<uint64_t, uint64_t>& tree = trees[n % 2];
+                uint64_t key = rand_r(&seed) % KEYS;
+                uint64_t value = 0;
+                bool found = tree.find(key, value);
+                if(key % 2 == 0 ? !found || value != 3 * key : found && value != 5 * key){
+                    errors++;
+                }
+                if(n % 16 == 0){
+                    uint64_t prev = 0;
+                    size_t seen = 0;
+                    tree.scan(key, 40, [&](const pair<uint64_t, uint64_t>& item) {
+                        if((seen > 0 && item.first <= prev) || item.second != (item.first % 2 == 0 ? 3 : 5) * item.first){
+                            errors++;
+                        }
+                        prev = item.first;
+                        seen++;
+                    });
+                }
+            }
+        }));
+    }
+    vector<std::thread> writers;
+    for(int w = 0; w < 2; w++){
+        writers.push_back(std::thread([&, w]() {
+            unsigned seed = 21 + w;
+            ReadMostlyAVLTree<uint64_t, uint64_t>& tree = trees[w];
+            for(int i = 1; i <= 40000; i++){
+                uint64_t key = (rand_r(&seed) % (KEYS / 2)) * 2 + 1;
+                if(rand_r(&seed) % 2){
+                    tree.insert(make_pair(key, 5 * key));
+                } else {
+                    tree.remove(key);
+                }
+                if(i % 5000 == 0){
+                    tree.buildFromSorted(evens);
+                } else if(i % 3000 == 0){
+                    tree.compact();
+                }
+            }
+        }));
+    }
+    for(int w = 0; w < 2; w++){
+        writers[w].join();
+    }
+    done.store(true);
+    for(size_t r = 0; r < threads.size(); r++){
+        threads[r].join();
+    }
+    EXPECT_EQ(0, errors.load());
+    for(int t = 0; t < 2; t++){
+        EXPECT_TRUE(trees[t].isBalanced());
+        EXPECT_TRUE(trees[t].contains(KEYS - 2));
+        trees[t].clear();
+        EXPECT_FALSE(trees[t].contains(0));
+    }
+}
+
+// A fresh file prefix for a LoggedTree, with no log or snapshot left over.
+static string walPrefix(const string& name)
+{
+    string prefix = "/tmp/bst-gtest-" + name + "-" + to_string(::getpid());
+    std::remove((prefix + ".wal").c_str());
+    std::remove((prefix + ".snap").c_str());
+    return prefix;
+}
+
+static void removeWal(const string& prefix)
+{
+    std::remove((prefix + ".wal").c_str());
+    std::remove((prefix + ".snap").c_str());
+}
+
+TEST(LoggedTree, RecoversFromTornLogTail)
+{
+    string prefix = walPrefix("torn");
+    map<int, long> ref;
+    {
+        LoggedTree<int, long> tree(prefix, 1);
+        for(int i = 0; i < 500; i++){
+            tree.insert(make_pair(i % 97, static_cast<long>(i)));
+            ref[i % 97] = i;
+        }
+        tree.remove(5);
+        ref.erase(5);
+    }
+    // half a record, as if we crashed in the middle of appending it
+    FILE* log = std::fopen((prefix + ".wal").c_str(), "ab");
+    ASSERT_TRUE(log != NULL);
+    std::fputc(WriteAheadLog<int, long>::WAL_INSERT, log);
+    std::fputc(42, log);
+    std::fclose(log);
+
+    {
+        LoggedTree<int, long> tree(prefix, 1);
+        tree.recover();
+        expectSameContents(tree, ref);
+        EXPECT_TRUE(tree.isBalanced());
+        // the torn tail is cut off, so this record is readable after it
+        tree.insert(make_pair(1000, 1L));
+        ref[1000] = 1;
+    }
+    LoggedTree<int, long> tree(prefix, 1);
+    tree.recover();
+    expectSameContents(tree, ref);
+    removeWal(prefix);
+}
+
+TEST(LoggedTree, RecoversFromSnapshotPlusLog)
+{
+    string prefix = walPrefix("snap");
+    map<int, long> ref;
+    srand(1);
+    {
+        LoggedTree<int, long> tree(prefix, 7);
+        for(int i = 0; i < 5000; i++){
+            int key = rand() % 800;
+            if(rand() % 3 == 0){
+                tree.remove(key);
+                ref.erase(key);
+            } else {
+                tree.insert(make_pair(key, static_cast<long>(i)));
+                ref[key] = i;
+            }
+            if(i == 2500){
+                tree.snapshot();
+            }
+        }
+        tree.sync();
+    }
+    LoggedTree<int, long> tree(prefix, 7);
+    tree.recover();
+    expectSameContents(tree, ref);
+    EXPECT_TRUE(tree.isBalanced());
+    removeWal(prefix);
+}
+
+TEST(LoggedTree, RecoversAfterClearAndBuild)
+{
+    string prefix = walPrefix("clear");
+    map<int, long> ref;
+    {
+        LoggedTree<int, long> tree(prefix, 3);
+        for(int i = 0; i < 100; i++){
+            tree.insert(make_pair(i, static_cast<long>(i)));
+        }
+        // through a base reference too: both are virtual
+        AVLTree<int, long>& base = tree;
+        base.clear();
+        tree.insert(make_pair(1000, 1000L));
+        tree.sync();
+    }
+    ref[1000] = 1000;
+    {
+        LoggedTree<int, long> tree(prefix, 3);
+        tree.recover();
+        expectSameContents(tree, ref);
+
+        vector<pair<int, long> > items;
+        for(int i = 0; i < 10; i++){
+            items.push_back(make_pair(2 * i, static_cast<long>(-i)));
+        }
+        AVLTree<int, long>& base = tree;
+        base.buildFromSorted(items);
+        tree.remove(4);
+        tree.sync();
+    }
+    ref.clear();
+    for(int i = 0; i < 10; i++){
+        if(i != 2){
+            ref[2 * i] = -i;
+        }
+    }
+    LoggedTree<int, long> tree(prefix, 3);
+    tree.recover();
+    expectSameContents(tree, ref);
+    removeWal(prefix);
+}
+
+TEST(LoggedTree, RecoversCursorOperations)
+{
+    string prefix = walPrefix("cursor");
+    map<int, long> ref;
+    {
+        LoggedTree<int, long> tree(prefix, 5);
+        runCursorOps(tree, 3000, 200, 35, IsBalanced());
+        for(LoggedTree<int, long>::iterator it = tree.begin(); it != tree.end(); ++it){
+            ref[it->first] = it->second;
+        }
+        tree.sync();
+    }
+    LoggedTree<int, long> tree(prefix, 5);
+    tree.recover();
+    expectSameContents(tree, ref);
+    removeWal(prefix);
+}
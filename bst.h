@@ -5,6 +5,47 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "tree-perf.h"
+#include "avl-trace.h"
+#include "node-arena.h"
+
+/**
+* Building with -DBST_VALIDATE checks the tree invariants after every
+* update, along the touched root-to-node path only (see checkPath), so it
+* costs O(log n) per operation on a balanced tree instead of a full rescan.
+* A broken invariant throws std::logic_error.
+*/
+#ifdef BST_VALIDATE
+#define BST_CHECK_PATH(tree, node) (tree)->checkPath(node)
+#define BST_CHECK_LINKS(tree, node, ordered) (tree)->checkLinks(node, ordered)
+#else
+#define BST_CHECK_PATH(tree, node) ((void)0)
+#define BST_CHECK_LINKS(tree, node, ordered) ((void)0)
+#endif
+
+/**
+* Keys that are trivially copyable and at most two words are "small": the
+* search loops (see searchPath) take and compare them by value, so they
+* stay in registers. Other keys keep being passed by const reference.
+*/
+template <typename T>
+struct BstSmallType : std::integral_constant<bool,
+    std::is_trivially_copyable<T>::value && sizeof(T) <= 2 * sizeof(void*)>
+{};
+
+template <typename T>
+struct BstParam {
+    typedef typename std::conditional<BstSmallType<T>::value, T, const T&>::type type;
+};
 
 /**
  * A templated class for a Node in a search tree.
@@ -29,6 +70,13 @@ public:
     virtual Node<Key, Value>* getParent() const;
     virtual Node<Key, Value>* getLeft() const;
     virtual Node<Key, Value>* getRight() const;
+    virtual size_t footprint() const;
+    virtual Node<Key, Value>* cloneInto(void* where) const;
+
+    Node<Key, Value>* child(bool right) const;
+    Node<Key, Value>* parent() const;
+    Node<Key, Value>* loadChild(bool right) const;
+    Node<Key, Value>* loadParent() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
@@ -144,13 +192,78 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
     return right_;
 }
 
+/**
+* The size of the node object, for BinarySearchTree::memoryUsage and
+* compact. Every node class overrides this and cloneInto.
+*/
+template<typename Key, typename Value>
+size_t Node<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+/**
+* Copy-constructs this node, links included, at where (footprint() bytes),
+* for compact to move it into a NodeArena.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::cloneInto(void* where) const
+{
+    return new (where) Node<Key, Value>(*this);
+}
+
+/**
+* Non-virtual child access for the search loops: the right child if right
+* is true, else the left one. Derived nodes only narrow the pointer type in
+* their getters, so this is the same node getLeft/getRight return.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::child(bool right) const
+{
+    return right ? right_ : left_;
+}
+
+/**
+* Non-virtual parent access, for loops that climb the tree (see
+* fingerSearch).
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::parent() const
+{
+    return parent_;
+}
+
+/**
+* child() and getParent() as acquire loads, for readers that walk the tree
+* while a writer changes it (see ReadMostlyAVLTree). The setters pair with
+* them as relaxed atomic stores, which are plain stores on x86 and ARM but
+* keep the concurrent accesses free of data races; the ordering comes from
+* the fences such a tree puts in its own hooks, so that a node reached
+* this way is fully constructed.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::loadChild(bool right) const
+{
+    // load both and select, like child(): loading through a selected address
+    // waits for the comparison and made reader searches ~1.6x slower
+    Node<Key, Value>* left = __atomic_load_n(&left_, __ATOMIC_ACQUIRE);
+    Node<Key, Value>* rightChild = __atomic_load_n(&right_, __ATOMIC_ACQUIRE);
+    return right ? rightChild : left;
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::loadParent() const
+{
+    return __atomic_load_n(&parent_, __ATOMIC_ACQUIRE);
+}
+
 /**
 * A setter for setting the parent of a node.
 */
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    __atomic_store_n(&parent_, parent, __ATOMIC_RELAXED);
 }
 
 /**
@@ -159,7 +272,7 @@ void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 template<typename Key, typename Value>
 void Node<Key, Value>::setLeft(Node<Key, Value>* left)
 {
-    left_ = left;
+    __atomic_store_n(&left_, left, __ATOMIC_RELAXED);
 }
 
 /**
@@ -168,7 +281,7 @@ void Node<Key, Value>::setLeft(Node<Key, Value>* left)
 template<typename Key, typename Value>
 void Node<Key, Value>::setRight(Node<Key, Value>* right)
 {
-    right_ = right;
+    __atomic_store_n(&right_, right, __ATOMIC_RELAXED);
 }
 
 /**
@@ -186,6 +299,27 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+struct LeafDepthReport;
+
+/**
+* What a tree's nodes take on the heap, as reported by memoryUsage.
+* allocatedBytes is what the allocator handed out for them: the usable
+* size of each node allocated with new plus its chunk header (glibc;
+* elsewhere just the node size), and the NodeArena blocks of compacted
+* nodes, dead slots included. slackBytes is the part of that the nodes do
+* not use. Memory that values own themselves (a std::string's buffer, say)
+* is not counted.
+*/
+struct TreeMemoryUsage {
+    size_t nodes;
+    size_t nodeBytes;
+    size_t allocatedBytes;
+    size_t slackBytes;
+    size_t arenaNodes;              // nodes living in NodeArena blocks
+
+    TreeMemoryUsage() : nodes(0), nodeBytes(0), allocatedBytes(0), slackBytes(0), arenaNodes(0) {}
+};
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -198,13 +332,20 @@ public:
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    virtual void clear(); //TODO
+    virtual void buildFromSorted(const std::vector<std::pair<Key, Value> >& items);
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
 
+    enum Layout { IN_ORDER, VAN_EMDE_BOAS };
+    TreeMemoryUsage memoryUsage() const;
+    virtual void compact(Layout layout = VAN_EMDE_BOAS);
+
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename Tree>
+    friend LeafDepthReport analyzeTreeShape(const Tree& tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -231,7 +372,13 @@ public:
 public:
     iterator begin() const;
     iterator end() const;
-    iterator find(const Key& key) const;
+    // find and findNear are virtual so that a wrapper such as RecordingTree
+    // sees every lookup, including operator[]'s, which goes through find
+    virtual iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    virtual iterator findNear(const iterator& hint, const Key& key) const;
+    virtual iterator insertNear(const iterator& hint, const std::pair<const Key, Value>& keyValuePair);
+    virtual iterator removeAt(const iterator& pos);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
@@ -255,10 +402,33 @@ protected:
     static Node<Key, Value>* traverse_helper_pred(Node<Key, Value>* current, Node<Key, Value>* parent, int classifer);
     static Node<Key, Value> *traverse_helper_succ(Node<Key, Value> *current, Node<Key, Value> *parent, int classifer);
     Node<Key, Value>* traverse_helper_remove(const Key& key, Node<Key, Value>* current) const;
+    Node<Key, Value>* searchPath(typename BstParam<Key>::type key) const;
+    Node<Key, Value>* searchFrom(Node<Key, Value>* curr, typename BstParam<Key>::type key) const;
+    Node<Key, Value>* fingerSearch(Node<Key, Value>* finger, typename BstParam<Key>::type key) const;
+    virtual Node<Key, Value>* insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& keyValuePair);
+    virtual void eraseNode(Node<Key, Value>* node);
+    static iterator iteratorAt(Node<Key, Value>* node);
+    static Node<Key, Value>* nodeAt(const iterator& it);
+    Node<Key, Value>* helper_build(const std::vector<std::pair<Key, Value> >& items, size_t lo, size_t hi, Node<Key, Value>* parent);
+    Node<Key, Value>* removeNode(Node<Key, Value>* remove_node);
+    Node<Key, Value>* replaceWithPredecessor(Node<Key, Value>* remove_node, Node<Key, Value>* pred_node);
+    void rotate_left(Node<Key, Value>* current);
+    void rotate_right(Node<Key, Value>* current);
+    void checkPath(const Node<Key, Value>* target) const;
+    void checkLinks(const Node<Key, Value>* current, bool ordered) const;
+    virtual bool duplicateKeys() const;
+    void setRoot(Node<Key, Value>* root);
+    Node<Key, Value>* loadRoot() const;
+    virtual void destroyNode(Node<Key, Value>* node);
+    static void collectInOrder(Node<Key, Value>* root, std::vector<Node<Key, Value>*>& out);
+    static void collectVanEmdeBoas(Node<Key, Value>* root, int height, std::vector<Node<Key, Value>*>& out);
+    static void collectAtDepth(Node<Key, Value>* root, int depth, std::vector<Node<Key, Value>*>& out);
+    static int heightOf(Node<Key, Value>* root);
 
 
 protected:
     Node<Key, Value>* root_;
+    NodeArena arena_;
     // You should not need other data members
 };
 
@@ -351,6 +521,7 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator&
 BinarySearchTree<Key, Value>::iterator::operator++()
 {
+    AVL_TRACE_SCOPE(AVL_TRACE_NEXT);
     // TODO
     if(current_ == nullptr){
         return *this;
@@ -466,28 +637,105 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::find(const Key & k) const
 {
+    AVL_TRACE_SCOPE(AVL_TRACE_FIND);
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
     Node<Key, Value> *curr = internalFind(k);
     BinarySearchTree<Key, Value>::iterator it(curr);
     return it;
 }
 
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::lowerBound(const Key& key) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* bound = nullptr;
+    while(curr != nullptr){
+        if(curr->getKey() < key){
+            curr = curr->getRight();
+        } else {
+            bound = curr;
+            curr = curr->getLeft();
+        }
+    }
+    return iterator(bound);
+}
+
+/**
+* Like find, but the search starts at hint (the item last accessed, say)
+* instead of the root: it climbs from hint only as far as needed to reach
+* a subtree that holds key, then descends. Walking keys in (nearly) sorted
+* order with each result as the next hint costs amortized O(1) steps per
+* call instead of O(log n). The end iterator as hint searches from the root.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::findNear(const iterator& hint, const Key& key) const
+{
+    AVL_TRACE_SCOPE(AVL_TRACE_FIND);
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    Node<Key, Value>* last = fingerSearch(hint.current_, key);
+    if(last == nullptr || !(last->getKey() == key)){
+        return end();
+    }
+    return iterator(last);
+}
+
+/**
+* Inserts (or overwrites) keyValuePair, searching for its place from hint
+* as findNear does, and returns an iterator to it, which makes a good hint
+* for the next nearby insert.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insertNear(const iterator& hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    Node<Key, Value>* at = fingerSearch(hint.current_, keyValuePair.first);
+    return iterator(insertBelow(at, keyValuePair));
+}
+
+/**
+* Removes the item pos points to, without searching for it, and returns an
+* iterator to the item after it (or end()). Throws std::out_of_range for
+* the end iterator.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::removeAt(const iterator& pos)
+{
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    if(pos.current_ == nullptr){
+        throw std::out_of_range("Invalid iterator");
+    }
+    iterator next(pos);
+    ++next;
+    eraseNode(pos.current_);
+    return next;
+}
+
 /**
  * @precondition The key exists in the map
- * Returns the value associated with the key
+ * Returns the value associated with the key. The lookup is find's, so
+ * an override of find sees it too.
  */
 template<class Key, class Value>
 Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
 }
 template<class Key, class Value>
 Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
 }
 
 /**
@@ -499,24 +747,39 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 template<class Key, class Value>
 void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-    if(root_ ==NULL){
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    Node<Key, Value>* curr_node = BstSmallType<Key>::value ? searchPath(keyValuePair.first) : traverse_helper(root_, keyValuePair);
+    BinarySearchTree<Key, Value>::insertBelow(curr_node, keyValuePair);
+}
+
+/**
+* Finishes an insert once the search for keyValuePair's key has ended at
+* curr_node (NULL for an empty tree): overwrites its value if the keys
+* match, else hangs a new leaf off it. Returns the node holding the item.
+* Balanced trees override this (and eraseNode) so that insertNear and
+* removeAt keep them balanced.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::insertBelow(Node<Key, Value>* curr_node, const std::pair<const Key, Value> &keyValuePair)
+{
+    if(curr_node == NULL){
         Node<Key, Value>* new_node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL); 
-        root_ = new_node;
-        return;
+        setRoot(new_node);
+        return new_node;
     }
-    
-    Node<Key, Value>* curr_node = traverse_helper(root_, keyValuePair);
 
+    Node<Key, Value>* new_node = curr_node;
     if(curr_node->getKey() == keyValuePair.first){
         curr_node->setValue(keyValuePair.second);
     }else if(curr_node->getKey() > keyValuePair.first){
-        Node<Key, Value>* new_node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, curr_node); 
+        new_node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, curr_node); 
         curr_node->setLeft(new_node);
     }else if(curr_node->getKey() < keyValuePair.first){
-        Node<Key, Value>* new_node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, curr_node); 
+        new_node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, curr_node); 
         curr_node->setRight(new_node);
     }
-
+    BST_CHECK_PATH(this, curr_node);
+    return new_node;
 }
 
 template<class Key, class Value>
@@ -553,65 +816,119 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::traverse_helper(Node<Key, Value>
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::remove(const Key& key)
 {
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
     // TODO
     Node<Key, Value>* remove_node = traverse_helper_remove(key, root_);
     if(remove_node == nullptr){
         return;
     }
+    removeNode(remove_node);
+}
+
+/**
+* Conversions between nodes and iterators, for derived trees (the iterator
+* only lets BinarySearchTree at its node).
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::nodeAt(const iterator& it)
+{
+    return it.current_;
+}
+
+/**
+* Unlinks and frees node for removeAt. Balanced trees override this to
+* rebalance afterwards.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    removeNode(node);
+}
 
+/**
+* Unlinks and deletes the given node. A node with 2 children is replaced by
+* its predecessor (see replaceWithPredecessor). Returns the parent of the
+* position that lost a node (NULL if it was the root), which is where any
+* rebalancing of the remaining tree has to start.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* remove_node)
+{
     if(remove_node->getLeft() != nullptr && remove_node->getRight() != nullptr){
-        Node<Key, Value>* pred_node = predecessor(remove_node);
-        nodeSwap(remove_node, pred_node);
+        Node<Key, Value>* parent = replaceWithPredecessor(remove_node, predecessor(remove_node));
+        destroyNode(remove_node);
+        BST_CHECK_PATH(this, parent);
+        return parent;
     }
 
     Node<Key, Value>* parent = remove_node->getParent();
-    Node<Key, Value>* right = remove_node->getRight();
-    Node<Key, Value>* left = remove_node->getLeft();
+    Node<Key, Value>* child = remove_node->getLeft() != nullptr ? remove_node->getLeft() : remove_node->getRight();
 
-    if(right == nullptr && left == nullptr){
-        if(parent == nullptr){
-            root_ = nullptr;
-        } else if(parent->getLeft() == remove_node){
-            parent->setLeft(nullptr);
-        } else{
-            parent->setRight(nullptr);
-        }
-        delete remove_node;
-        return;
+    if(child != nullptr){
+        child->setParent(parent);
+    }
+    if(parent == nullptr){
+        setRoot(child);
+    } else if(parent->getLeft() == remove_node){
+        parent->setLeft(child);
+    } else{
+        parent->setRight(child);
     }
-    
-    
-    if(right != nullptr && left == nullptr){
-        if(parent == nullptr){
-            root_ = right;
-            right->setParent(nullptr);
-        } else{
-            if(parent->getLeft() == remove_node){
-                parent->setLeft(right);
-            } else {
-                parent->setRight(right);
-            }
-            right->setParent(parent);
-        }
 
-        delete remove_node;
-        return;
-    } else if(left != nullptr && right == nullptr){
-        if(parent == nullptr){
-            root_ = left;
-            left->setParent(nullptr);
-        } else{
-            if(parent->getLeft() == remove_node){
-                parent->setLeft(left);
-            } else {
-                parent->setRight(left);
-            }
-            left->setParent(parent);
+    destroyNode(remove_node);
+    BST_CHECK_PATH(this, parent);
+    return parent;
+}
+
+/**
+* Moves pred_node, the predecessor of remove_node (which has 2 children),
+* into remove_node's place and detaches remove_node; the caller deletes it.
+* This has the same result as nodeSwap followed by unlinking remove_node,
+* but only relinks the predecessor: about half the pointer writes, and
+* remove_node itself is never written. Nodes are never copied or moved, so
+* iterators to every other item stay valid across a remove.
+* Returns the parent of the predecessor's old position (pred_node itself
+* if it was remove_node's left child), whose subtree on that side shrank.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::replaceWithPredecessor(Node<Key, Value>* remove_node, Node<Key, Value>* pred_node)
+{
+    Node<Key, Value>* parent = remove_node->getParent();
+    Node<Key, Value>* left = remove_node->getLeft();
+    Node<Key, Value>* right = remove_node->getRight();
+    Node<Key, Value>* shrunk;
+
+    if(pred_node == left){
+        shrunk = pred_node;
+    } else {
+        // pred_node is the rightmost node of the left subtree: hand its left child to its parent
+        shrunk = pred_node->getParent();
+        Node<Key, Value>* pred_left = pred_node->getLeft();
+        shrunk->setRight(pred_left);
+        if(pred_left != nullptr){
+            pred_left->setParent(shrunk);
         }
+        pred_node->setLeft(left);
+        left->setParent(pred_node);
+    }
 
-        delete remove_node;
-        return;
-    } 
+    pred_node->setRight(right);
+    right->setParent(pred_node);
+    pred_node->setParent(parent);
+    if(parent == nullptr){
+        setRoot(pred_node);
+    } else if(parent->getLeft() == remove_node){
+        parent->setLeft(pred_node);
+    } else {
+        parent->setRight(pred_node);
+    }
+    return shrunk;
 }
 
 
@@ -621,6 +938,7 @@ BinarySearchTree<Key, Value>::traverse_helper_remove(const Key& key, Node<Key, V
     if(current == nullptr){
         return nullptr;
     }
+    AVL_TRACE_STEP();
     if(current->getKey() == key){
         return current;
     } else if(current->getKey() > key){
@@ -680,21 +998,62 @@ void BinarySearchTree<Key, Value>::clear()
 {
     // TODO
     helper_clear(root_);
-    root_ = nullptr;
+    setRoot(nullptr);
 }
 
+/**
+* Deletes the subtree rooted at current in post-order. Iterative (walking
+* back up through the parent pointers) since self-adjusting trees can
+* temporarily be as deep as they are large.
+*/
 template<typename Key, typename Value>
 void  BinarySearchTree<Key, Value>::helper_clear(Node<Key, Value>* current){
-    if(current == nullptr){
-        return;
+    Node<Key, Value>* stop = current == nullptr ? nullptr : current->getParent();
+    while(current != nullptr && current != stop){
+        if(current->getLeft() != nullptr){
+            current = current->getLeft();
+        } else if(current->getRight() != nullptr){
+            current = current->getRight();
+        } else {
+            Node<Key, Value>* parent = current->getParent();
+            if(parent != nullptr){
+                if(parent->getLeft() == current){
+                    parent->setLeft(nullptr);
+                } else {
+                    parent->setRight(nullptr);
+                }
+            }
+            destroyNode(current);
+            current = parent;
+        }
     }
+}
 
-    helper_clear(current->getRight());
-    helper_clear(current->getLeft());
-    delete current;
-    return;
+/**
+* Replaces the contents of the tree with the given items, which must be
+* sorted by strictly increasing key. Builds a perfectly balanced tree in
+* O(n) instead of n separate inserts (used e.g. for crash recovery).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::buildFromSorted(const std::vector<std::pair<Key, Value> >& items)
+{
+    // not the virtual clear: a subclass's clear may do more than empty the
+    // tree (LoggedTree's writes a snapshot), and it overrides this anyway
+    BinarySearchTree<Key, Value>::clear();
+    setRoot(helper_build(items, 0, items.size(), nullptr));
 }
 
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::helper_build(const std::vector<std::pair<Key, Value> >& items, size_t lo, size_t hi, Node<Key, Value>* parent){
+    if(lo >= hi){
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* current = new Node<Key, Value>(items[mid].first, items[mid].second, parent);
+    current->setLeft(helper_build(items, lo, mid, current));
+    current->setRight(helper_build(items, mid + 1, hi, current));
+    return current;
+}
 
 /**
 * A helper function to find the smallest node in the tree.
@@ -725,9 +1084,90 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::traverse_smallest(Node<Key, Valu
 template<typename Key, typename Value>
 Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
 {
+    if(BstSmallType<Key>::value){
+        Node<Key, Value>* last = searchPath(key);
+        return last != nullptr && last->getKey() == key ? last : nullptr;
+    }
     return traverse_helper_remove(key, root_);
 }
 
+/**
+* Iterative search without virtual calls: returns the node holding key,
+* else the last node on its search path (the parent a new node for key
+* would get), or NULL for an empty tree. Used for small keys, where the
+* key is passed by value and the next child is picked with a conditional
+* move rather than a branch.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::searchPath(typename BstParam<Key>::type key) const
+{
+    return searchFrom(root_, key);
+}
+
+/**
+* searchPath starting at curr instead of the root; curr's subtree must be
+* where key belongs.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::searchFrom(Node<Key, Value>* curr, typename BstParam<Key>::type key) const
+{
+    while(curr != nullptr){
+        AVL_TRACE_STEP();
+        typename BstParam<Key>::type curr_key = curr->getKey();
+        if(curr_key == key){
+            return curr;
+        }
+        Node<Key, Value>* next = curr->child(curr_key < key);
+        if(next == nullptr){
+            return curr;
+        }
+        curr = next;
+    }
+    return nullptr;
+}
+
+/**
+* searchPath starting from finger (the root if finger is NULL). First
+* climbs to the lowest ancestor whose subtree must hold key, then descends
+* from there. Going towards larger keys, every ancestor reached from the
+* right has a key below the finger's, so the climb can stop at the first
+* parent whose key is not below key: the subtree under it lies between
+* the finger's key and the parent's (and the parent may be key itself).
+*
+* The climb and descent take O(log d) steps when the d items between
+* finger and key sit under a common ancestor of that height. Without level
+* links, a key just across a high ancestor from the finger still costs
+* O(log n), but a sorted walk crosses each node at most twice, so the
+* total for one pass is O(n).
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::fingerSearch(Node<Key, Value>* finger, typename BstParam<Key>::type key) const
+{
+    if(finger == nullptr){
+        return searchFrom(root_, key);
+    }
+    typename BstParam<Key>::type finger_key = finger->getKey();
+    if(finger_key == key){
+        return finger;
+    }
+    bool right = finger_key < key;
+    Node<Key, Value>* curr = finger;
+    Node<Key, Value>* parent = curr->parent();
+    while(parent != nullptr){
+        AVL_TRACE_STEP();
+        typename BstParam<Key>::type parent_key = parent->getKey();
+        if(right ? !(parent_key < key) : !(key < parent_key)){
+            if(parent_key == key){
+                return parent;
+            }
+            break;
+        }
+        curr = parent;
+        parent = curr->parent();
+    }
+    return searchFrom(curr, key);
+}
+
 /**
  * Return true if the BST is balanced.
  */
@@ -765,6 +1205,170 @@ int BinarySearchTree<Key, Value>::helper_balanced(Node<Key, Value>* current) con
 
 
 
+/**
+* Whether equal keys may sit in separate nodes (see AVLMultiMap). Then
+* keys only have to be non-decreasing in order, and a node need not be the
+* one a search for its key stops at. Only the validation asks.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::duplicateKeys() const
+{
+    return false;
+}
+
+/**
+* Checks the invariants on the path from the root down to target (just the
+* root if target is NULL): every node on it is ordered against all of its
+* ancestors, is reachable by searching for its key, and it and its children
+* have consistent parent/child links. O(depth of target).
+*
+* With duplicateKeys() the path is found through the parent links instead
+* of by searching, and equal keys count as ordered.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::checkPath(const Node<Key, Value>* target) const
+{
+    if(root_ != nullptr && root_->getParent() != nullptr){
+        throw std::logic_error("BST invariant: root has a parent");
+    }
+    if(duplicateKeys()){
+        std::vector<const Node<Key, Value>*> path;
+        for(const Node<Key, Value>* curr = target != nullptr ? target : root_; curr != nullptr; curr = curr->getParent()){
+            path.push_back(curr);
+        }
+        if(!path.empty() && path.back() != root_){
+            throw std::logic_error("BST invariant: node not reachable from the root");
+        }
+        const Key* low = nullptr;
+        const Key* high = nullptr;
+        for(size_t i = path.size(); i-- > 0; ){
+            const Node<Key, Value>* curr = path[i];
+            checkLinks(curr, true);
+            if((low != nullptr && curr->getKey() < *low) || (high != nullptr && *high < curr->getKey())){
+                throw std::logic_error("BST invariant: key out of order with an ancestor");
+            }
+            if(i > 0){
+                if(path[i - 1] == curr->getLeft()){
+                    high = &curr->getKey();
+                } else {
+                    low = &curr->getKey();
+                }
+            }
+        }
+        return;
+    }
+    const Node<Key, Value>* curr = root_;
+    const Key* low = nullptr;
+    const Key* high = nullptr;
+    while(curr != nullptr){
+        checkLinks(curr, true);
+        if((low != nullptr && !(*low < curr->getKey())) || (high != nullptr && !(curr->getKey() < *high))){
+            throw std::logic_error("BST invariant: key out of order with an ancestor");
+        }
+        if(target == nullptr || curr == target){
+            return;
+        }
+        if(target->getKey() < curr->getKey()){
+            high = &curr->getKey();
+            curr = curr->getLeft();
+        } else if(curr->getKey() < target->getKey()){
+            low = &curr->getKey();
+            curr = curr->getRight();
+        } else {
+            break;
+        }
+    }
+    if(target != nullptr){
+        throw std::logic_error("BST invariant: node not reachable by searching for its key");
+    }
+}
+
+/**
+* Checks that current's children point back to it and that current is a
+* child of its parent; with ordered, also that the children's keys are on
+* the correct side. O(1).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::checkLinks(const Node<Key, Value>* current, bool ordered) const
+{
+    const Node<Key, Value>* parent = current->getParent();
+    const Node<Key, Value>* left = current->getLeft();
+    const Node<Key, Value>* right = current->getRight();
+    if(parent == nullptr ? root_ != current : (parent->getLeft() != current && parent->getRight() != current)){
+        throw std::logic_error("BST invariant: node is not a child of its parent");
+    }
+    if((left != nullptr && left->getParent() != current) || (right != nullptr && right->getParent() != current)){
+        throw std::logic_error("BST invariant: child does not point back to its parent");
+    }
+    bool equal_ok = ordered && duplicateKeys();
+    if(ordered && ((left != nullptr && (equal_ok ? current->getKey() < left->getKey() : !(left->getKey() < current->getKey())))
+        || (right != nullptr && (equal_ok ? right->getKey() < current->getKey() : !(current->getKey() < right->getKey()))))){
+        throw std::logic_error("BST invariant: child key on the wrong side");
+    }
+}
+
+/**
+* Rotates current's right child up into current's place.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotate_left(Node<Key, Value>* current)
+{
+    Node<Key, Value>* child = current->getRight();
+    Node<Key, Value>* temp = child->getLeft();
+    Node<Key, Value>* grand_parent = current->getParent();
+
+    //set child
+    child->setParent(grand_parent);
+    if(grand_parent == nullptr){
+        setRoot(child);
+    } else if(grand_parent->getLeft() == current){
+        grand_parent->setLeft(child);
+    } else {
+        grand_parent->setRight(child);
+    }
+
+    //set parent
+    child->setLeft(current);
+    current->setParent(child);
+    current->setRight(temp);
+    if(temp != nullptr){
+        temp->setParent(current);
+    }
+    BST_CHECK_LINKS(this, child, true);
+    BST_CHECK_LINKS(this, current, true);
+}
+
+/**
+* Rotates current's left child up into current's place.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotate_right(Node<Key, Value>* current)
+{
+    Node<Key, Value>* child = current->getLeft();
+    Node<Key, Value>* temp = child->getRight();
+    Node<Key, Value>* grand_parent = current->getParent();
+
+    //set child
+    child->setParent(grand_parent);
+    if(grand_parent == nullptr){
+        setRoot(child);
+    } else if(grand_parent->getLeft() == current){
+        grand_parent->setLeft(child);
+    } else {
+        grand_parent->setRight(child);
+    }
+
+    //set parent
+    child->setRight(current);
+    current->setParent(child);
+    current->setLeft(temp);
+    if(temp != nullptr){
+        temp->setParent(current);
+    }
+    BST_CHECK_LINKS(this, child, true);
+    BST_CHECK_LINKS(this, current, true);
+}
+
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
@@ -841,12 +1445,243 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 
     if(this->root_ == n1) {
-        this->root_ = n2;
+        this->setRoot(n2);
     }
     else if(this->root_ == n2) {
-        this->root_ = n1;
+        this->setRoot(n1);
+    }
+    // keys are out of order until the caller removes one of the two nodes
+    BST_CHECK_LINKS(this, n1, false);
+    BST_CHECK_LINKS(this, n2, false);
+
+}
+
+/**
+* Every change of root_ after construction goes through setRoot. Like the
+* node setters it is a relaxed atomic store; concurrent readers use
+* loadRoot like Node::loadChild.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setRoot(Node<Key, Value>* root)
+{
+    __atomic_store_n(&root_, root, __ATOMIC_RELAXED);
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::loadRoot() const
+{
+    return __atomic_load_n(&root_, __ATOMIC_ACQUIRE);
+}
+
+/**
+* Frees a node that remove or clear has unlinked. Trees with concurrent
+* readers override it to defer the delete until no reader can still hold
+* the node.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
+    if(arena_.owns(node)){
+        node->~Node();
+        arena_.release(node);
+    } else {
+        delete node;
+    }
+}
+
+/**
+* Counts the nodes and what they take on the heap (see TreeMemoryUsage).
+* O(n).
+*/
+template<typename Key, typename Value>
+TreeMemoryUsage BinarySearchTree<Key, Value>::memoryUsage() const
+{
+    TreeMemoryUsage usage;
+    std::vector<Node<Key, Value>*> nodes;
+    collectInOrder(root_, nodes);
+    usage.nodes = nodes.size();
+    for(size_t i = 0; i < nodes.size(); i++){
+        usage.nodeBytes += nodes[i]->footprint();
+        if(arena_.owns(nodes[i])){
+            usage.arenaNodes++;
+        } else {
+#ifdef __GLIBC__
+            usage.allocatedBytes += malloc_usable_size(nodes[i]) + sizeof(size_t);
+#else
+            usage.allocatedBytes += nodes[i]->footprint();
+#endif
+        }
     }
+    usage.allocatedBytes += arena_.bytes();
+    usage.slackBytes = usage.allocatedBytes - usage.nodeBytes;
+    return usage;
+}
 
+/**
+* Moves every node into one fresh NodeArena block, laid out in key order
+* (IN_ORDER, best for scans) or in van Emde Boas order (the default, best
+* for lookups: each subtree of about sqrt(n) nodes is contiguous at every
+* scale, so a search touches O(log_B n) cache lines), and frees the old
+* nodes. After heavy churn the nodes are scattered over the heap; this
+* gives scans and lookups back the locality of a freshly built tree and
+* lets the allocator reuse (or return) the old chunks.
+*
+* The shape of the tree and every node's contents stay the same, but
+* iterators into the tree are invalidated. O(n log n) time and O(n) extra
+* memory while it runs. Later inserts go to the heap as usual; the arena
+* block is freed once all of its nodes are removed.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::compact(Layout layout)
+{
+    if(root_ == nullptr){
+        return;
+    }
+    std::vector<Node<Key, Value>*> order;
+    if(layout == IN_ORDER){
+        collectInOrder(root_, order);
+    } else {
+        collectVanEmdeBoas(root_, heightOf(root_), order);
+    }
+
+    size_t bytes = 0;
+    for(size_t i = 0; i < order.size(); i++){
+        bytes = NodeArena::placeAt(bytes, order[i]->footprint()) + order[i]->footprint();
+    }
+    arena_.startBlock(bytes);
+
+    // (old node, its copy), sorted by old node to translate the copies' links
+    std::vector<std::pair<Node<Key, Value>*, Node<Key, Value>*> > moved(order.size());
+    for(size_t i = 0; i < order.size(); i++){
+        moved[i].first = order[i];
+        moved[i].second = order[i]->cloneInto(arena_.allocate(order[i]->footprint()));
+    }
+    std::less<Node<Key, Value>*> before;
+    std::sort(moved.begin(), moved.end(),
+        [&before](const std::pair<Node<Key, Value>*, Node<Key, Value>*>& a, const std::pair<Node<Key, Value>*, Node<Key, Value>*>& b){
+            return before(a.first, b.first);
+        });
+    auto relocated = [&moved, &before](Node<Key, Value>* old) -> Node<Key, Value>* {
+        if(old == nullptr){
+            return nullptr;
+        }
+        size_t lo = 0, hi = moved.size();
+        while(hi - lo > 1){
+            size_t mid = lo + (hi - lo) / 2;
+            if(before(old, moved[mid].first)){
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        return moved[lo].second;
+    };
+    for(size_t i = 0; i < moved.size(); i++){
+        Node<Key, Value>* copy = moved[i].second;
+        copy->setParent(relocated(copy->parent()));
+        copy->setLeft(relocated(copy->child(false)));
+        copy->setRight(relocated(copy->child(true)));
+    }
+
+    // publish the copies before the old nodes go, for trees whose readers
+    // may still be on them (destroyNode defers the free there); the fence
+    // makes the copies' contents visible to such readers first
+    std::atomic_thread_fence(std::memory_order_release);
+    setRoot(relocated(root_));
+    for(size_t i = 0; i < order.size(); i++){
+        destroyNode(order[i]);
+    }
+    for(size_t i = 0; i < moved.size(); i++){
+        BST_CHECK_LINKS(this, moved[i].second, true);
+    }
+}
+
+/**
+* Appends the nodes of root's subtree to out in key order. Iterative, so
+* a degenerate (list-shaped) tree does not overflow the stack.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::collectInOrder(Node<Key, Value>* root, std::vector<Node<Key, Value>*>& out)
+{
+    std::vector<Node<Key, Value>*> pending;
+    Node<Key, Value>* curr = root;
+    while(curr != nullptr || !pending.empty()){
+        while(curr != nullptr){
+            pending.push_back(curr);
+            curr = curr->child(false);
+        }
+        curr = pending.back();
+        pending.pop_back();
+        out.push_back(curr);
+        curr = curr->child(true);
+    }
+}
+
+/**
+* Appends the top height levels of root's subtree to out in van Emde Boas
+* order: the top half of the levels first (recursively in the same
+* order), then each subtree hanging below them, left to right.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::collectVanEmdeBoas(Node<Key, Value>* root, int height, std::vector<Node<Key, Value>*>& out)
+{
+    if(root == nullptr){
+        return;
+    }
+    if(height == 1){
+        out.push_back(root);
+        return;
+    }
+    int top = height / 2;
+    collectVanEmdeBoas(root, top, out);
+    std::vector<Node<Key, Value>*> bottoms;
+    collectAtDepth(root, top, bottoms);
+    for(size_t i = 0; i < bottoms.size(); i++){
+        collectVanEmdeBoas(bottoms[i], height - top, out);
+    }
+}
+
+/**
+* Appends the nodes exactly depth levels below root to out, left to right.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::collectAtDepth(Node<Key, Value>* root, int depth, std::vector<Node<Key, Value>*>& out)
+{
+    std::vector<std::pair<Node<Key, Value>*, int> > pending(1, std::make_pair(root, 0));
+    while(!pending.empty()){
+        std::pair<Node<Key, Value>*, int> curr = pending.back();
+        pending.pop_back();
+        if(curr.first == nullptr){
+            continue;
+        }
+        if(curr.second == depth){
+            out.push_back(curr.first);
+            continue;
+        }
+        pending.push_back(std::make_pair(curr.first->child(true), curr.second + 1));
+        pending.push_back(std::make_pair(curr.first->child(false), curr.second + 1));
+    }
+}
+
+/**
+* The number of levels in root's subtree (0 if empty). Iterative, like
+* collectInOrder.
+*/
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::heightOf(Node<Key, Value>* root)
+{
+    int height = 0;
+    std::vector<std::pair<Node<Key, Value>*, int> > pending(1, std::make_pair(root, 1));
+    while(!pending.empty()){
+        std::pair<Node<Key, Value>*, int> curr = pending.back();
+        pending.pop_back();
+        if(curr.first != nullptr){
+            height = std::max(height, curr.second);
+            pending.push_back(std::make_pair(curr.first->child(false), curr.second + 1));
+            pending.push_back(std::make_pair(curr.first->child(true), curr.second + 1));
+        }
+    }
+    return height;
 }
 
 /**
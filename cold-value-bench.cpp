@@ -0,0 +1,77 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "avlbst.h"
+#include "cold-value.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: cold-value-bench [keys] [lookups]
+//
+// Times lookups (half hits, half misses) in an AVLTree<uint64_t, V> with
+// 8 byte, 64 byte and 1KB values stored inline in the node, and stored
+// out of line with ColdValue<V>. The lookups only read keys, so the
+// difference is the cache footprint of the search path. The node columns
+// are sizeof the tree node in each case.
+
+template<size_t N>
+struct Blob {
+    char data[N];
+
+    Blob() { data[0] = 0; }
+    explicit Blob(uint64_t seed) { data[0] = static_cast<char>(seed); }
+};
+
+template<size_t N>
+static ostream& operator<<(ostream& out, const Blob<N>& blob)
+{
+    return out << "blob" << N;
+}
+
+template<typename Value>
+static double timeLookups(const vector<uint64_t>& keys, const vector<uint64_t>& probes, const Value& value)
+{
+    AVLTree<uint64_t, Value> tree;
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(make_pair(keys[i], value));
+    }
+    uint64_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < probes.size(); i++){
+        found += tree.find(probes[i]) != tree.end();
+    }
+    double ns = static_cast<double>(benchNowNs() - start) / probes.size();
+    benchKeep(found);
+    return ns;
+}
+
+template<size_t N>
+static void run(const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    Blob<N> blob(N);
+    double inlineNs = timeLookups(keys, probes, blob);
+    double coldNs = timeLookups(keys, probes, ColdValue<Blob<N> >(blob));
+    cout << setw(8) << N << setw(12) << sizeof(AVLNode<uint64_t, Blob<N> >)
+         << setw(12) << sizeof(AVLNode<uint64_t, ColdValue<Blob<N> > >)
+         << fixed << setprecision(1) << setw(12) << inlineNs << setw(12) << coldNs << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 200000);
+    size_t lookups = benchArg(argc, argv, 2, 2000000);
+    vector<uint64_t> keys = benchShuffledKeys(n, 1);
+    vector<uint64_t> probes(lookups);
+    BenchRng rng(2);
+    for(size_t i = 0; i < lookups; i++){
+        probes[i] = rng.below(2 * n);
+    }
+
+    cout << "n=" << n << endl << setw(8) << "value" << setw(12) << "node" << setw(12) << "cold node"
+         << setw(12) << "inline ns" << setw(12) << "cold ns" << endl;
+    run<8>(keys, probes);
+    run<64>(keys, probes);
+    run<1024>(keys, probes);
+    return 0;
+}
@@ -0,0 +1,164 @@
+#ifndef COLD_VALUE_H
+#define COLD_VALUE_H
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+/**
+* Key-value separation for the trees. A node stores its item inline, so a
+* large Value pushes the child links away from the key and a descent drags
+* the value's cache lines along. Using ColdValue<V> as the tree's Value
+* type keeps only a pointer in the node (key, links and value handle then
+* fit in one cache line for small keys) and puts the V itself in a slab.
+*
+*   AVLTree<uint64_t, ColdValue<Record> > tree;
+*   tree.insert(std::make_pair(key, ColdValue<Record>(record)));
+*   const Record& r = *tree.find(key)->second;
+*
+* ColdIfLarge<V>::type picks ColdValue<V> only when V is larger than a
+* cache line, for code that is generic over V.
+*/
+
+/**
+* Fixed size slots for one value type, carved out of chunks of
+* SLOTS_PER_CHUNK. Freed slots go on a free list and are reused; chunks are
+* kept for the life of the process. Shared by all trees, behind a mutex
+* (taken only when a value is created or destroyed, never on lookups).
+*/
+template <typename V>
+class ColdSlab
+{
+public:
+    static ColdSlab& instance()
+    {
+        // never destroyed, so trees with static storage can still free values at exit
+        static ColdSlab* slab = new ColdSlab();
+        return *slab;
+    }
+
+    void* allocate()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if(free_ == nullptr){
+            Slot* chunk = static_cast<Slot*>(::operator new(sizeof(Slot) * SLOTS_PER_CHUNK));
+            chunks_.push_back(chunk);
+            for(size_t i = 0; i < SLOTS_PER_CHUNK; i++){
+                chunk[i].next = free_;
+                free_ = &chunk[i];
+            }
+        }
+        Slot* slot = free_;
+        free_ = slot->next;
+        return slot;
+    }
+
+    void release(void* p)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        Slot* slot = static_cast<Slot*>(p);
+        slot->next = free_;
+        free_ = slot;
+    }
+
+private:
+    static const size_t SLOTS_PER_CHUNK = 4096 / sizeof(V) + 16;
+
+    union Slot {
+        Slot* next;
+        typename std::aligned_storage<sizeof(V), alignof(V)>::type storage;
+    };
+
+    ColdSlab() : free_(nullptr) {}
+
+    ColdSlab(const ColdSlab&);
+    ColdSlab& operator=(const ColdSlab&);
+
+    std::mutex lock_;
+    Slot* free_;
+    std::vector<Slot*> chunks_;
+};
+
+/**
+* A V stored in ColdSlab<V>, with value semantics: copies copy the V into
+* a new slot, moves hand the slot over. A moved-from ColdValue is empty
+* (holds no slot): it may be destroyed, assigned to or copied, which gives
+* another empty one, but not dereferenced.
+*/
+template <typename V>
+class ColdValue
+{
+public:
+    ColdValue() : value_(new (ColdSlab<V>::instance().allocate()) V()) {}
+    ColdValue(const V& value) : value_(new (ColdSlab<V>::instance().allocate()) V(value)) {}
+    ColdValue(const ColdValue& other) : value_(copyOf(other.value_)) {}
+    ColdValue(ColdValue&& other) : value_(other.value_) { other.value_ = nullptr; }
+
+    ~ColdValue()
+    {
+        destroy(value_);
+    }
+
+    ColdValue& operator=(const ColdValue& other)
+    {
+        if(this == &other){
+            return *this;
+        }
+        if(other.value_ == nullptr){
+            destroy(value_);
+            value_ = nullptr;
+        } else if(value_ == nullptr){
+            value_ = copyOf(other.value_);
+        } else {
+            *value_ = *other.value_;
+        }
+        return *this;
+    }
+
+    ColdValue& operator=(ColdValue&& other)
+    {
+        std::swap(value_, other.value_);
+        return *this;
+    }
+
+    V& operator*() { return *value_; }
+    const V& operator*() const { return *value_; }
+    V* operator->() { return value_; }
+    const V* operator->() const { return value_; }
+    const V& get() const { return *value_; }
+    bool empty() const { return value_ == nullptr; }
+
+private:
+    // A copy of *value in a new slot, or null for an empty value.
+    static V* copyOf(const V* value)
+    {
+        return value == nullptr ? nullptr : new (ColdSlab<V>::instance().allocate()) V(*value);
+    }
+
+    static void destroy(V* value)
+    {
+        if(value != nullptr){
+            value->~V();
+            ColdSlab<V>::instance().release(value);
+        }
+    }
+
+    V* value_;
+};
+
+template <typename V>
+std::ostream& operator<<(std::ostream& out, const ColdValue<V>& value)
+{
+    return out << *value;
+}
+
+template <typename V>
+struct ColdIfLarge {
+    typedef typename std::conditional<(sizeof(V) > 64), ColdValue<V>, V>::type type;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: compact-bench [keys] [churn] [lookups]
+//
+// Builds an AVLTree<uint64_t, uint64_t> of keys keys, then churns it:
+// churn * keys rounds of removing a random key and inserting a new one,
+// so the nodes end up spread over the heap in no particular order. Times
+// random lookups and a full in-order scan on the churned tree, then again
+// after compact(IN_ORDER) and after compact(VAN_EMDE_BOAS), and prints
+// memoryUsage() for each.
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static void measure(const string& name, Tree& tree, const vector<uint64_t>& probes)
+{
+    uint64_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < probes.size(); i++){
+        found += tree.find(probes[i]) != tree.end();
+    }
+    double lookupNs = static_cast<double>(benchNowNs() - start) / probes.size();
+
+    TreeMemoryUsage usage = tree.memoryUsage();
+    uint64_t sum = 0;
+    start = benchNowNs();
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+        sum += it->second;
+    }
+    double scanNs = static_cast<double>(benchNowNs() - start) / usage.nodes;
+    benchKeep(found + sum);
+
+    cout << left << setw(14) << name << right << fixed << setprecision(1)
+         << setw(10) << lookupNs << setw(10) << scanNs
+         << setw(12) << usage.nodeBytes << setw(12) << usage.allocatedBytes
+         << setw(12) << usage.slackBytes << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t churn = benchArg(argc, argv, 2, 4);
+    size_t lookups = benchArg(argc, argv, 3, 2000000);
+    const uint64_t SPREAD = 4 * n;
+
+    BenchRng rng(9);
+    vector<uint64_t> live(n);
+    Tree tree;
+    for(size_t i = 0; i < n; i++){
+        live[i] = rng.below(SPREAD);
+        tree.insert(make_pair(live[i], live[i]));
+    }
+    for(size_t i = 0; i < churn * n; i++){
+        size_t victim = rng.below(n);
+        tree.remove(live[victim]);
+        live[victim] = rng.below(SPREAD);
+        tree.insert(make_pair(live[victim], live[victim]));
+    }
+    vector<uint64_t> probes(lookups);
+    for(size_t i = 0; i < lookups; i++){
+        probes[i] = live[rng.below(n)];
+    }
+
+    cout << left << setw(14) << "layout" << right << setw(10) << "lookup" << setw(10) << "scan"
+         << setw(12) << "node B" << setw(12) << "alloc B" << setw(12) << "slack B" << endl;
+    measure("churned", tree, probes);
+    uint64_t start = benchNowNs();
+    tree.compact(Tree::IN_ORDER);
+    double inOrderMs = (benchNowNs() - start) / 1e6;
+    measure("in-order", tree, probes);
+    start = benchNowNs();
+    tree.compact(Tree::VAN_EMDE_BOAS);
+    double vebMs = (benchNowNs() - start) / 1e6;
+    measure("van Emde Boas", tree, probes);
+    cout << "(ns per lookup / per scanned item) compact took " << fixed << setprecision(0)
+         << inOrderMs << " ms in order, " << vebMs << " ms vEB" << endl;
+    return 0;
+}
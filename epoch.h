@@ -0,0 +1,146 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* Epoch-based reclamation, for structures whose readers run without locks
+* while a writer unlinks nodes (see ReadMostlyAVLTree).
+*
+* A reader pins the current global epoch in its slot for the duration of
+* an EpochGuard; pinning is a plain store plus a fence, with no atomic
+* read-modify-write. A writer tags each unlinked node with the epoch it
+* was retired in, and frees it once every pinned reader's epoch is at
+* least two newer (minActive()), since such readers started after the
+* node was unlinked. Only one newer is not enough: a reader's load of the
+* epoch does not synchronize with the writer, so it can pin the next
+* epoch and still see the link to the node.
+*
+* One process-wide domain is shared by all trees. A thread claims a slot
+* the first time it reads (the only read-modify-write a reader ever does)
+* and gives it back when it exits; at most MAX_READERS threads can hold
+* one at a time.
+*/
+class EpochDomain
+{
+public:
+    static const size_t MAX_READERS = 256;
+
+    static EpochDomain& instance()
+    {
+        // never destroyed, so threads exiting after main can still release their slot
+        static EpochDomain* domain = new EpochDomain();
+        return *domain;
+    }
+
+    uint64_t current() const
+    {
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    // Called by writers before minActive, so that readers arriving from now
+    // on pin a newer epoch than anything retired so far.
+    uint64_t advance()
+    {
+        return epoch_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    // The oldest epoch pinned by a reader, or UINT64_MAX if none is reading.
+    uint64_t minActive() const
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t oldest = UINT64_MAX;
+        for(size_t i = 0; i < MAX_READERS; i++){
+            uint64_t pinned = slots_[i].pinned.load(std::memory_order_acquire);
+            if(pinned != 0 && pinned < oldest){
+                oldest = pinned;
+            }
+        }
+        return oldest;
+    }
+
+    void pin()
+    {
+        ReaderSlot& slot = localSlot();
+        if(slot.depth++ == 0){
+            slot.pinned.store(epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void unpin()
+    {
+        ReaderSlot& slot = localSlot();
+        if(--slot.depth == 0){
+            slot.pinned.store(0, std::memory_order_release);
+        }
+    }
+
+private:
+    struct ReaderSlot {
+        std::atomic<bool> claimed;
+        std::atomic<uint64_t> pinned;  // 0 when not reading
+        size_t depth;                  // nested guards, only touched by the owner
+        char pad[64 - sizeof(std::atomic<bool>) - sizeof(std::atomic<uint64_t>) - sizeof(size_t)];
+    };
+
+    // Claims a slot for the calling thread and releases it at thread exit.
+    struct SlotOwner {
+        ReaderSlot* slot;
+
+        SlotOwner() : slot(EpochDomain::instance().claim()) {}
+        ~SlotOwner() { slot->claimed.store(false, std::memory_order_release); }
+    };
+
+    EpochDomain() : epoch_(1)
+    {
+        for(size_t i = 0; i < MAX_READERS; i++){
+            slots_[i].claimed.store(false);
+            slots_[i].pinned.store(0);
+            slots_[i].depth = 0;
+        }
+    }
+
+    EpochDomain(const EpochDomain&);
+    EpochDomain& operator=(const EpochDomain&);
+
+    ReaderSlot* claim()
+    {
+        for(size_t i = 0; i < MAX_READERS; i++){
+            bool expected = false;
+            if(!slots_[i].claimed.load(std::memory_order_relaxed)
+               && slots_[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acq_rel)){
+                return &slots_[i];
+            }
+        }
+        throw std::runtime_error("Too many concurrent epoch readers");
+    }
+
+    ReaderSlot& localSlot()
+    {
+        static thread_local SlotOwner owner;
+        return *owner.slot;
+    }
+
+    std::atomic<uint64_t> epoch_;
+    ReaderSlot slots_[MAX_READERS];
+};
+
+/**
+* Pins the calling thread's epoch for its lifetime. Guards nest.
+*/
+class EpochGuard
+{
+public:
+    EpochGuard() { EpochDomain::instance().pin(); }
+    ~EpochGuard() { EpochDomain::instance().unpin(); }
+
+private:
+    EpochGuard(const EpochGuard&);
+    EpochGuard& operator=(const EpochGuard&);
+};
+
+#endif
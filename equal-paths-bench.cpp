@@ -0,0 +1,103 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include "equal-paths-parallel.h"
+#include "leaf-depth.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: equal-paths-bench [nodes...]
+//
+// For each size (default 1M and 16M; pass e.g. 500000000 for 500M nodes,
+// which needs ~12GB) times equalPaths and equalPathsParallel with 1..N
+// threads on three trees, and analyzeLeafDepths (leaf-depth.h), which
+// always scans the whole tree to build its depth histogram:
+//   balanced  - a perfect tree (all leaves equal, full scan)
+//   mismatch  - the same tree plus one extra leaf under the last leaf
+//               (a full sequential scan, a short one in parallel)
+//   chain     - a degenerate path of n nodes (depth n)
+
+static void buildPerfect(vector<Node>& nodes, size_t n)
+{
+    nodes.clear();
+    nodes.reserve(n + 1);
+    for(size_t i = 0; i < n; i++){
+        nodes.push_back(Node(static_cast<int>(i)));
+    }
+    for(size_t i = 0; 2 * i + 2 < n; i++){
+        nodes[i].left = &nodes[2 * i + 1];
+        nodes[i].right = &nodes[2 * i + 2];
+    }
+}
+
+static void buildChain(vector<Node>& nodes, size_t n)
+{
+    nodes.clear();
+    nodes.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        nodes.push_back(Node(static_cast<int>(i)));
+    }
+    for(size_t i = 0; i + 1 < n; i++){
+        nodes[i].left = &nodes[i + 1];
+    }
+}
+
+static void timeAll(const string& name, Node* root, const vector<unsigned int>& threads)
+{
+    cout << left << setw(10) << name << right;
+    uint64_t start = benchNowNs();
+    bool result = equalPaths(root);
+    cout << setw(12) << fixed << setprecision(1) << (benchNowNs() - start) / 1e6;
+    for(size_t t = 0; t < threads.size(); t++){
+        start = benchNowNs();
+        bool parallel = equalPathsParallel(root, threads[t]);
+        cout << setw(12) << (benchNowNs() - start) / 1e6;
+        if(parallel != result) cout << "(!)";
+    }
+    start = benchNowNs();
+    LeafDepthReport report = analyzeLeafDepths(root, FieldNodeAccess<Node>());
+    cout << setw(12) << (benchNowNs() - start) / 1e6;
+    if(report.equalPaths != result) cout << "(!)";
+    cout << "   -> " << result << ", leaf depth " << report.minLeafDepth << ".." << report.maxLeafDepth << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<size_t> sizes;
+    for(int i = 1; i < argc; i++){
+        sizes.push_back(benchArg(argc, argv, i, 0));
+    }
+    if(sizes.empty()){
+        sizes.push_back(1000000);
+        sizes.push_back(16000000);
+    }
+    vector<unsigned int> threads;
+    unsigned int hw = max(1u, thread::hardware_concurrency());
+    for(unsigned int t = 2; t < hw; t *= 2) threads.push_back(t);
+    threads.push_back(max(2u, hw));
+
+    for(size_t s = 0; s < sizes.size(); s++){
+        // round down to a perfect tree
+        size_t n = 1;
+        while(2 * n + 1 <= sizes[s]) n = 2 * n + 1;
+
+        cout << "n=" << n << " (ms)" << endl << left << setw(10) << "tree" << right << setw(12) << "seq";
+        for(size_t t = 0; t < threads.size(); t++){
+            cout << setw(10) << threads[t] << "-t";
+        }
+        cout << setw(12) << "report" << endl;
+
+        vector<Node> nodes;
+        buildPerfect(nodes, n);
+        timeAll("balanced", &nodes[0], threads);
+        nodes.push_back(Node(-1));
+        nodes[n - 1].left = &nodes[n];
+        timeAll("mismatch", &nodes[0], threads);
+        buildChain(nodes, n);
+        timeAll("chain", &nodes[0], threads);
+    }
+    return 0;
+}
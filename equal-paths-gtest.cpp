@@ -0,0 +1,207 @@
+#include <vector>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include "equal-paths-parallel.h"
+#include "leaf-depth.h"
+using namespace std;
+
+
+Node* a;
+Node* b;
+Node* c;
+Node* d;
+
+void setNode(Node* n, int key, Node* left=NULL, Node* right=NULL)
+{
+  n->key = key;
+  n->left = left;
+  n->right = right;
+}
+
+class EqualPaths : public testing::Test
+{
+protected:
+  void SetUp()
+  {
+    a = new Node(1);
+    b = new Node(2);
+    c = new Node(3);
+    d = new Node(4);
+  }
+
+  void TearDown()
+  {
+    delete a;
+    delete b;
+    delete c;
+    delete d;
+  }
+};
+
+TEST_F(EqualPaths, SingleNode)
+{
+  setNode(a,1,NULL, NULL);
+  EXPECT_TRUE(equalPaths(a));
+}
+
+TEST_F(EqualPaths, OneLeftChild)
+{
+  setNode(a,1,b,NULL);
+  setNode(b,2,NULL,NULL);
+  EXPECT_TRUE(equalPaths(a));
+}
+
+TEST_F(EqualPaths, TwoChildren)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,NULL,NULL);
+  setNode(c,3,NULL,NULL);
+  EXPECT_TRUE(equalPaths(a));
+}
+
+TEST_F(EqualPaths, OneRightChild)
+{
+  setNode(a,1,NULL,c);
+  setNode(c,3,NULL,NULL);
+  EXPECT_TRUE(equalPaths(a));
+}
+
+TEST_F(EqualPaths, UnevenLeaves)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,NULL,d);
+  setNode(c,3,NULL,NULL);
+  setNode(d,4,NULL,NULL);
+  EXPECT_FALSE(equalPaths(a));
+}
+
+TEST_F(EqualPaths, LeafDepthHistogram)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,NULL,d);
+  setNode(c,3,NULL,NULL);
+  setNode(d,4,NULL,NULL);
+  LeafDepthReport report = analyzeLeafDepths(a, FieldNodeAccess<Node>());
+  EXPECT_EQ(4u, report.nodes);
+  EXPECT_EQ(2u, report.leaves);
+  EXPECT_EQ(3, report.height);
+  EXPECT_EQ(1, report.minLeafDepth);
+  EXPECT_EQ(2, report.maxLeafDepth);
+  ASSERT_EQ(3u, report.histogram.size());
+  EXPECT_EQ(0u, report.histogram[0]);
+  EXPECT_EQ(1u, report.histogram[1]);
+  EXPECT_EQ(1u, report.histogram[2]);
+  EXPECT_EQ(equalPaths(a), report.equalPaths);
+  // d (left, then right) is the first leaf in order, so c is the offender
+  EXPECT_EQ("R", report.firstOffendingPath);
+  EXPECT_EQ(1, report.firstOffendingDepth);
+}
+
+TEST(EqualPathsEmpty, NullRoot)
+{
+  EXPECT_TRUE(equalPaths(NULL));
+  EXPECT_TRUE(equalPathsParallel(NULL, 4));
+}
+
+// A perfect tree of the given number of levels, in heap order: the
+// children of nodes[i] are nodes[2i + 1] and nodes[2i + 2].
+static void buildPerfect(vector<Node>& nodes, int levels)
+{
+  size_t n = (size_t(1) << levels) - 1;
+  nodes.clear();
+  nodes.reserve(n + 1);
+  for(size_t i = 0; i < n; i++){
+    nodes.push_back(Node(static_cast<int>(i)));
+  }
+  for(size_t i = 0; 2 * i + 2 < n; i++){
+    nodes[i].left = &nodes[2 * i + 1];
+    nodes[i].right = &nodes[2 * i + 2];
+  }
+}
+
+// Expects equalPathsParallel to give equalPaths' answer for 0 to 8 threads.
+static void expectParallelAgrees(Node* root)
+{
+  bool expected = equalPaths(root);
+  for(unsigned int threads = 0; threads <= 8; threads++){
+    EXPECT_EQ(expected, equalPathsParallel(root, threads)) << threads << " threads";
+  }
+}
+
+TEST(EqualPathsParallel, PerfectTree)
+{
+  vector<Node> nodes;
+  buildPerfect(nodes, 16);
+  EXPECT_TRUE(equalPaths(&nodes[0]));
+  expectParallelAgrees(&nodes[0]);
+  LeafDepthReport report = analyzeLeafDepths(&nodes[0], FieldNodeAccess<Node>());
+  EXPECT_EQ(nodes.size(), report.nodes);
+  EXPECT_EQ(size_t(1) << 15, report.leaves);
+  ASSERT_EQ(16u, report.histogram.size());
+  EXPECT_EQ(size_t(1) << 15, report.histogram[15]);
+  EXPECT_TRUE(report.equalPaths);
+}
+
+TEST(EqualPathsParallel, OneDeeperLeaf)
+{
+  vector<Node> nodes;
+  buildPerfect(nodes, 16);
+  // one extra leaf under the last leaf, found last by a sequential scan
+  nodes.push_back(Node(-1));
+  nodes[nodes.size() - 2].right = &nodes.back();
+  EXPECT_FALSE(equalPaths(&nodes[0]));
+  expectParallelAgrees(&nodes[0]);
+  LeafDepthReport report = analyzeLeafDepths(&nodes[0], FieldNodeAccess<Node>());
+  EXPECT_EQ((size_t(1) << 15) - 1, report.histogram[15]);
+  EXPECT_EQ(1u, report.histogram[16]);
+  EXPECT_FALSE(report.equalPaths);
+  EXPECT_EQ(16, report.firstOffendingDepth);
+  EXPECT_EQ(string(16, 'R'), report.firstOffendingPath);
+}
+
+TEST(EqualPathsParallel, Chain)
+{
+  // too deep for a recursive check
+  vector<Node> nodes(200000, Node(0));
+  for(size_t i = 0; i + 1 < nodes.size(); i++){
+    nodes[i].left = &nodes[i + 1];
+  }
+  EXPECT_TRUE(equalPaths(&nodes[0]));
+  expectParallelAgrees(&nodes[0]);
+}
+
+TEST(EqualPathsParallel, RandomTrees)
+{
+  srand(7);
+  for(int trial = 0; trial < 200; trial++){
+    // a random binary tree, or a perfect one with a random leaf removed
+    vector<Node> nodes;
+    if(trial % 2 == 0){
+      size_t n = 1 + rand() % 3000;
+      nodes.assign(n, Node(0));
+      for(size_t i = 1; i < n; i++){
+        Node* parent = &nodes[rand() % i];
+        while(parent->left != NULL && parent->right != NULL){
+          parent = rand() % 2 ? parent->left : parent->right;
+        }
+        if(parent->left == NULL && (parent->right != NULL || rand() % 2)){
+          parent->left = &nodes[i];
+        } else {
+          parent->right = &nodes[i];
+        }
+      }
+    } else {
+      buildPerfect(nodes, 2 + rand() % 10);
+      if(rand() % 2 && nodes.size() > 1){
+        size_t leaf = nodes.size() / 2 + rand() % (nodes.size() - nodes.size() / 2);
+        Node* parent = &nodes[(leaf - 1) / 2];
+        if(parent->left == &nodes[leaf]){
+          parent->left = NULL;
+        } else {
+          parent->right = NULL;
+        }
+      }
+    }
+    expectParallelAgrees(&nodes[0]);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef EQUAL_PATHS_PARALLEL_H
+#define EQUAL_PATHS_PARALLEL_H
+
+#include "equal-paths.h"
+
+/**
+ * @brief Same result as equalPaths, computed by the given number of threads.
+ *
+ *        The top levels of the tree are split into subtrees that idle threads
+ *        steal from each other; all threads stop as soon as any of them finds a
+ *        leaf at a different depth. Neither version recurses, so degenerate
+ *        (very deep) trees are fine.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param threads Number of threads to use (including the caller's); 1 or 0 runs equalPaths
+ */
+bool equalPathsParallel(Node * root, unsigned int threads);
+
+#endif
@@ -1,38 +1,178 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
-
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <utility>
 #endif
 
-#include "equal-paths.h"
+#include "equal-paths-parallel.h"
 using namespace std;
 
 
 // You may add any prototypes of helper functions here
+static bool scanSubtree(Node * root, int depth, atomic<int>& leaf_depth, const atomic<bool>* stop);
+static bool checkLeaf(int depth, atomic<int>& leaf_depth);
 
 
 bool equalPaths(Node * root)
 {
     // Add your code below
-    int path_depth = -1;
-    int depth = 0;
-    return dfs_depth(root, depth, path_depth);
+    atomic<int> leaf_depth(-1);
+    return scanSubtree(root, 0, leaf_depth, nullptr);
 }
 
+/**
+ * Records the first leaf depth seen, and compares every later one with it.
+ */
+static bool checkLeaf(int depth, atomic<int>& leaf_depth)
+{
+    int expected = -1;
+    if(leaf_depth.compare_exchange_strong(expected, depth)){
+        return true;
+    }
+    return expected == depth;
+}
 
-bool dfs_depth(Node * root, int depth, int& path_depth){
+/**
+ * Depth-first scan with an explicit stack, so it works on trees of any
+ * depth. Descends left and only stacks right children whose sibling was
+ * taken, which keeps the stack at O(height). When stop is given, it is
+ * polled every few thousand nodes so a mismatch found by another worker
+ * ends the scan early (the result then does not matter).
+ */
+static bool scanSubtree(Node * root, int depth, atomic<int>& leaf_depth, const atomic<bool>* stop)
+{
     if(root == nullptr) return true;
 
-    if(root->left == nullptr && root->right == nullptr){
-        if(path_depth == -1){
-            path_depth = depth;
+    vector<pair<Node*, int> > pending;
+    pending.push_back(make_pair(root, depth));
+    unsigned int visited = 0;
+    while(!pending.empty()){
+        Node* current = pending.back().first;
+        int current_depth = pending.back().second;
+        pending.pop_back();
+
+        while(true){
+            if(stop != nullptr && (++visited & 4095) == 0 && stop->load(memory_order_relaxed)){
+                return true;
+            }
+            if(current->left == nullptr && current->right == nullptr){
+                if(!checkLeaf(current_depth, leaf_depth)) return false;
+                break;
+            }
+            current_depth++;
+            if(current->left == nullptr){
+                current = current->right;
+            } else {
+                if(current->right != nullptr){
+                    pending.push_back(make_pair(current->right, current_depth));
+                }
+                current = current->left;
+            }
         }
-        if(path_depth == depth){
-            return true; 
+    }
+    return true;
+}
+
+/**
+ * Work-stealing state for equalPathsParallel. Each worker owns a deque of
+ * subtrees (root, depth); it pushes and pops at the back, idle workers
+ * steal from the front of other workers' deques. Only the top split_depth
+ * levels are split into tasks, below that a task is scanned sequentially.
+ */
+struct EqualPathsPool {
+    struct Queue {
+        mutex lock;
+        deque<pair<Node*, int> > tasks;
+    };
+
+    EqualPathsPool(unsigned int threads, int split) :
+        queues(threads), outstanding(0), leaf_depth(-1), stop(false), split_depth(split)
+    {}
+
+    vector<Queue> queues;
+    atomic<long> outstanding;
+    atomic<int> leaf_depth;
+    atomic<bool> stop;
+    int split_depth;
+
+    void push(unsigned int self, Node* node, int depth)
+    {
+        outstanding.fetch_add(1);
+        lock_guard<mutex> guard(queues[self].lock);
+        queues[self].tasks.push_back(make_pair(node, depth));
+    }
+
+    bool take(unsigned int self, pair<Node*, int>& task)
+    {
+        for(unsigned int i = 0; i < queues.size(); i++){
+            unsigned int victim = (self + i) % queues.size();
+            lock_guard<mutex> guard(queues[victim].lock);
+            if(queues[victim].tasks.empty()) continue;
+            if(victim == self){
+                task = queues[victim].tasks.back();
+                queues[victim].tasks.pop_back();
+            } else {
+                task = queues[victim].tasks.front();
+                queues[victim].tasks.pop_front();
+            }
+            return true;
         }
         return false;
     }
 
-    depth++;
-    return dfs_depth(root->left, depth, path_depth) && dfs_depth(root->right, depth, path_depth);
-}
+    void fail()
+    {
+        stop.store(true);
+    }
 
+    void run(unsigned int self)
+    {
+        pair<Node*, int> task;
+        while(!stop.load(memory_order_relaxed)){
+            if(!take(self, task)){
+                if(outstanding.load() == 0) return;
+                this_thread::yield();
+                continue;
+            }
+            Node* current = task.first;
+            int depth = task.second;
+            // split the top levels: keep the left child, hand out the right one
+            while(depth < split_depth && current->left != nullptr && current->right != nullptr){
+                push(self, current->right, depth + 1);
+                current = current->left;
+                depth++;
+            }
+            if(!scanSubtree(current, depth, leaf_depth, &stop)){
+                fail();
+            }
+            outstanding.fetch_sub(1);
+        }
+    }
+};
+
+bool equalPathsParallel(Node * root, unsigned int threads)
+{
+    if(threads <= 1 || root == nullptr){
+        return equalPaths(root);
+    }
+
+    // enough tasks to keep every worker busy even when subtrees are uneven
+    int split = 4;
+    for(unsigned int t = threads; t > 1; t >>= 1) split++;
+
+    EqualPathsPool pool(threads, split);
+    pool.push(0, root, 0);
+    vector<thread> workers;
+    for(unsigned int i = 1; i < threads; i++){
+        workers.push_back(thread(&EqualPathsPool::run, &pool, i));
+    }
+    pool.run(0);
+    for(size_t i = 0; i < workers.size(); i++){
+        workers[i].join();
+    }
+    return !pool.stop.load();
+}
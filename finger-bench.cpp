@@ -0,0 +1,122 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "avlbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: finger-bench [keys] [ops] [span]
+//
+// Compares root-based find/insert/remove on an AVLTree<uint64_t, uint64_t>
+// holding the even keys 0, 2, ... 2(keys-1) with the cursor-relative
+// findNear/insertNear/removeAt, each call using the previous result as its
+// hint. Three access patterns: sequential (rank +1 each step), near
+// (a random step of up to +-span ranks, default 16) and random (uniform,
+// where a finger cannot help: each call then waits for the previous one,
+// while independent root searches overlap their cache misses). Inserts
+// use the odd key right after each probe, so they all add a node; removes
+// then take those odd keys out again.
+
+static vector<uint64_t> pattern(const string& name, size_t n, size_t ops, size_t span)
+{
+    vector<uint64_t> ranks(ops);
+    BenchRng rng(3);
+    uint64_t rank = n / 4;
+    for(size_t i = 0; i < ops; i++){
+        if(name == "sequential"){
+            rank = (rank + 1) % n;
+        } else if(name == "near"){
+            rank = (rank + n + rng.below(2 * span + 1) - span) % n;
+        } else {
+            rank = rng.below(n);
+        }
+        ranks[i] = rank;
+    }
+    return ranks;
+}
+
+static void build(AVLTree<uint64_t, uint64_t>& tree, size_t n)
+{
+    vector<pair<uint64_t, uint64_t> > items(n);
+    for(size_t i = 0; i < n; i++){
+        items[i] = make_pair(2 * i, i);
+    }
+    tree.buildFromSorted(items);
+}
+
+static double nsPerOp(uint64_t start, size_t ops)
+{
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+static void run(const string& name, size_t n, size_t ops, size_t span)
+{
+    vector<uint64_t> ranks = pattern(name, n, ops, span);
+    AVLTree<uint64_t, uint64_t> tree;
+    build(tree, n);
+    AVLTree<uint64_t, uint64_t>::iterator hint = tree.end();
+    uint64_t found = 0;
+
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        found += tree.find(2 * ranks[i])->second;
+    }
+    double findNs = nsPerOp(start, ops);
+
+    start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        hint = tree.findNear(hint, 2 * ranks[i]);
+        found += hint->second;
+    }
+    double nearNs = nsPerOp(start, ops);
+    benchKeep(found);
+
+    // inserts and removes of distinct odd keys; later repeats of a rank
+    // only overwrite, so both sides do the same structural work
+    start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        tree.insert(make_pair(2 * ranks[i] + 1, i));
+    }
+    double insertNs = nsPerOp(start, ops);
+    start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        tree.remove(2 * ranks[i] + 1);
+    }
+    double removeNs = nsPerOp(start, ops);
+
+    hint = tree.end();
+    start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        hint = tree.insertNear(hint, make_pair(2 * ranks[i] + 1, i));
+    }
+    double insertNearNs = nsPerOp(start, ops);
+    start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        // hint sits on an even key next to the target once it was removed
+        AVLTree<uint64_t, uint64_t>::iterator pos = tree.findNear(hint, 2 * ranks[i] + 1);
+        hint = pos == tree.end() ? tree.findNear(hint, 2 * ranks[i]) : tree.removeAt(pos);
+    }
+    double removeAtNs = nsPerOp(start, ops);
+
+    cout << left << setw(12) << name << right << fixed << setprecision(1)
+         << setw(10) << findNs << setw(10) << nearNs
+         << setw(10) << insertNs << setw(10) << insertNearNs
+         << setw(10) << removeNs << setw(10) << removeAtNs << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t ops = benchArg(argc, argv, 2, 1000000);
+    size_t span = benchArg(argc, argv, 3, 16);
+
+    cout << left << setw(12) << "ns/op" << right
+         << setw(10) << "find" << setw(10) << "findNear"
+         << setw(10) << "insert" << setw(10) << "insNear"
+         << setw(10) << "remove" << setw(10) << "removeAt" << endl;
+    run("sequential", n, ops, span);
+    run("near", n, ops, span);
+    run("random", n, ops, span);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "avlinterval.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: interval-bench [intervals] [maxLength] [queries]
+//
+// Stores intervals random intervals [low, low + length] (low uniform in
+// [0, 1e9), length uniform in [0, maxLength]) in an IntervalTree and times
+// stabbing queries (a point) and overlap queries (a range of maxLength)
+// against a linear scan over the tree's in-order iterator, which checks
+// every interval. The scan only runs a few queries; it is that slow.
+
+typedef IntervalTree<uint64_t, uint32_t> Tree;
+typedef pair<const Interval<uint64_t>, uint32_t> Item;
+
+struct Counter {
+    uint64_t* sum;
+
+    void operator()(const Item& item) { *sum += item.second; }
+};
+
+static double nsPerOp(uint64_t start, size_t ops)
+{
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 10000000);
+    uint64_t maxLength = benchArg(argc, argv, 2, 1000);
+    size_t queries = benchArg(argc, argv, 3, 100000);
+    const uint64_t SPREAD = 1000000000;
+    size_t scanQueries = max<size_t>(1, min<size_t>(queries, 20));
+
+    BenchRng rng(11);
+    vector<pair<Interval<uint64_t>, uint32_t> > items;
+    items.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        uint64_t low = rng.below(SPREAD);
+        items.push_back(make_pair(Interval<uint64_t>(low, low + rng.below(maxLength + 1)), static_cast<uint32_t>(i)));
+    }
+    sort(items.begin(), items.end());
+
+    Tree tree;
+    uint64_t start = benchNowNs();
+    tree.buildFromSorted(items);
+    double buildNs = nsPerOp(start, n);
+    items.clear();
+    items.shrink_to_fit();
+
+    vector<uint64_t> points(queries);
+    for(size_t i = 0; i < queries; i++){
+        points[i] = rng.below(SPREAD);
+    }
+
+    uint64_t sum = 0;
+    Counter counter = { &sum };
+    size_t hits = 0;
+    start = benchNowNs();
+    for(size_t i = 0; i < queries; i++){
+        hits += tree.stab(points[i], counter);
+    }
+    double stabNs = nsPerOp(start, queries);
+    double stabHits = static_cast<double>(hits) / queries;
+
+    hits = 0;
+    start = benchNowNs();
+    for(size_t i = 0; i < queries; i++){
+        hits += tree.overlap(points[i], points[i] + maxLength, counter);
+    }
+    double overlapNs = nsPerOp(start, queries);
+    double overlapHits = static_cast<double>(hits) / queries;
+
+    hits = 0;
+    start = benchNowNs();
+    for(size_t i = 0; i < scanQueries; i++){
+        for(Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+            if(it->first.low <= points[i] && points[i] <= it->first.high){
+                sum += it->second;
+                hits++;
+            }
+        }
+    }
+    double scanNs = nsPerOp(start, scanQueries);
+    double scanHits = static_cast<double>(hits) / scanQueries;
+    benchKeep(sum);
+
+    cout << n << " intervals, max length " << maxLength << ", build "
+         << fixed << setprecision(1) << buildNs << " ns/interval" << endl;
+    cout << left << setw(14) << "query" << right << setw(14) << "ns/query" << setw(12) << "hits" << endl;
+    cout << left << setw(14) << "stab" << right << setw(14) << stabNs << setw(12) << stabHits << endl;
+    cout << left << setw(14) << "overlap" << right << setw(14) << overlapNs << setw(12) << overlapHits << endl;
+    cout << left << setw(14) << "scan stab" << right << setw(14) << scanNs << setw(12) << scanHits << endl;
+    return 0;
+}
@@ -0,0 +1,158 @@
+#ifndef LEAF_DEPTH_H
+#define LEAF_DEPTH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * Shape statistics of a binary tree, as computed by analyzeLeafDepths.
+ * Depths count edges from the root (the root has depth 0), as in equalPaths.
+ */
+struct LeafDepthReport {
+    size_t nodes;
+    size_t leaves;
+    int height;                     // levels, i.e. max leaf depth + 1 (0 when empty)
+    int minLeafDepth;               // -1 when empty
+    int maxLeafDepth;               // -1 when empty
+    std::vector<size_t> histogram;  // histogram[d] = number of leaves at depth d
+    bool equalPaths;                // all leaves at the same depth
+
+    // Path from the root ('L'/'R' per edge) to the first leaf, in in-order,
+    // whose depth differs from the first leaf's; empty if equalPaths
+    std::string firstOffendingPath;
+    int firstOffendingDepth;        // -1 if equalPaths
+
+    LeafDepthReport() :
+        nodes(0), leaves(0), height(0), minLeafDepth(-1), maxLeafDepth(-1),
+        equalPaths(true), firstOffendingDepth(-1)
+    {}
+};
+
+/**
+ * Node access for structs with public left/right members, such as the Node
+ * in equal-paths.h.
+ */
+template <typename N>
+struct FieldNodeAccess {
+    N* left(N* n) const { return n->left; }
+    N* right(N* n) const { return n->right; }
+};
+
+/**
+ * Node access through getLeft()/getRight(), for the Node/AVLNode classes of
+ * bst.h and avlbst.h (and the other trees built on them).
+ */
+template <typename N>
+struct GetterNodeAccess {
+    N* left(N* n) const { return n->getLeft(); }
+    N* right(N* n) const { return n->getRight(); }
+};
+
+/**
+ * Computes a LeafDepthReport in a single pass over the tree rooted at root.
+ * O(n) time, O(height) memory and no recursion: the scan goes left first
+ * and only keeps the pending right siblings (plus the current path).
+ * Access must provide left(n) and right(n), see the adaptors above.
+ */
+template <typename N, typename Access>
+LeafDepthReport analyzeLeafDepths(N* root, Access access)
+{
+    LeafDepthReport report;
+    if(root == nullptr){
+        return report;
+    }
+
+    std::vector<std::pair<N*, int> > pending;
+    std::string path;
+    pending.push_back(std::make_pair(root, 0));
+    while(!pending.empty()){
+        N* current = pending.back().first;
+        int depth = pending.back().second;
+        pending.pop_back();
+        if(depth > 0){
+            // pending nodes are always right children
+            path.resize(depth - 1);
+            path.push_back('R');
+        }
+
+        while(true){
+            report.nodes++;
+            N* left = access.left(current);
+            N* right = access.right(current);
+            if(left == nullptr && right == nullptr){
+                report.leaves++;
+                if(static_cast<size_t>(depth) >= report.histogram.size()){
+                    report.histogram.resize(depth + 1, 0);
+                }
+                report.histogram[depth]++;
+                if(report.minLeafDepth == -1){
+                    report.minLeafDepth = depth;
+                    report.maxLeafDepth = depth;
+                } else {
+                    if(report.equalPaths && depth != report.minLeafDepth){
+                        report.equalPaths = false;
+                        report.firstOffendingPath = path;
+                        report.firstOffendingDepth = depth;
+                    }
+                    if(depth < report.minLeafDepth) report.minLeafDepth = depth;
+                    if(depth > report.maxLeafDepth) report.maxLeafDepth = depth;
+                }
+                break;
+            }
+            depth++;
+            if(left == nullptr){
+                path.push_back('R');
+                current = right;
+            } else {
+                if(right != nullptr){
+                    pending.push_back(std::make_pair(right, depth));
+                }
+                path.push_back('L');
+                current = left;
+            }
+        }
+    }
+    report.height = report.maxLeafDepth + 1;
+    return report;
+}
+
+/**
+ * Analyzes the shape of a BinarySearchTree, AVLTree or any other tree
+ * derived from BinarySearchTree (a friend of BinarySearchTree, since it
+ * reads root_).
+ */
+template <typename Tree>
+LeafDepthReport analyzeTreeShape(const Tree& tree)
+{
+    typedef typename std::remove_pointer<decltype(tree.root_)>::type NodeType;
+    return analyzeLeafDepths(tree.root_, GetterNodeAccess<NodeType>());
+}
+
+/**
+ * Prints a report in a human readable form.
+ */
+inline void printLeafDepthReport(std::ostream& out, const LeafDepthReport& report)
+{
+    out << "nodes: " << report.nodes << ", leaves: " << report.leaves
+        << ", height: " << report.height
+        << ", leaf depth: " << report.minLeafDepth << ".." << report.maxLeafDepth << std::endl;
+    out << "leaf depth histogram:";
+    for(size_t d = 0; d < report.histogram.size(); d++){
+        if(report.histogram[d] != 0){
+            out << " " << d << ":" << report.histogram[d];
+        }
+    }
+    out << std::endl;
+    if(report.equalPaths){
+        out << "all leaves at the same depth" << std::endl;
+    } else {
+        out << "first offending leaf at depth " << report.firstOffendingDepth
+            << ", path " << report.firstOffendingPath << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "avlbst.h"
+#include "learned-index.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: learned-bench [keys] [lookups] [deltaPercent]
+//
+// Uniform random uint64_t keys in an AVLTree<uint64_t, uint64_t> (built
+// with buildFromSorted) and in LearnedIndex snapshots of it with epsilon
+// 8 to 512. Times lookups of present keys in each, then inserts
+// deltaPercent% new keys into each index's delta buffer and times lookups
+// again, now half of them of the new keys (which fall through to the
+// delta). Sizes: the tree's node bytes (memoryUsage) against the model
+// and against the model plus the sorted key and value arrays.
+
+static double nsPerOp(uint64_t start, size_t ops)
+{
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+template<typename Lookup>
+static double timeLookups(const vector<uint64_t>& probes, Lookup lookup)
+{
+    uint64_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < probes.size(); i++){
+        found += lookup(probes[i]);
+    }
+    double ns = nsPerOp(start, probes.size());
+    if(found != probes.size()){
+        cout << "lookup mismatch" << endl;
+    }
+    return ns;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 10000000);
+    size_t lookups = benchArg(argc, argv, 2, 2000000);
+    size_t deltaPercent = benchArg(argc, argv, 3, 1);
+
+    BenchRng rng(21);
+    vector<uint64_t> keys(n);
+    for(size_t i = 0; i < n; i++){
+        keys[i] = rng.next();
+    }
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    vector<pair<uint64_t, uint64_t> > items(keys.size());
+    for(size_t i = 0; i < keys.size(); i++){
+        items[i] = make_pair(keys[i], keys[i] / 2);
+    }
+    AVLTree<uint64_t, uint64_t> tree;
+    tree.buildFromSorted(items);
+    items.clear();
+    items.shrink_to_fit();
+
+    vector<uint64_t> probes(lookups);
+    for(size_t i = 0; i < lookups; i++){
+        probes[i] = keys[rng.below(keys.size())];
+    }
+    vector<uint64_t> fresh(keys.size() * deltaPercent / 100);
+    for(size_t i = 0; i < fresh.size(); i++){
+        fresh[i] = rng.next();
+    }
+    vector<uint64_t> mixed(probes);
+    for(size_t i = 0; i < mixed.size() && !fresh.empty(); i += 2){
+        mixed[i] = fresh[rng.below(fresh.size())];
+    }
+
+    double treeNs = timeLookups(probes, [&tree](uint64_t key){ return tree.find(key) != tree.end(); });
+    TreeMemoryUsage usage = tree.memoryUsage();
+    cout << keys.size() << " keys; AVLTree " << fixed << setprecision(1) << treeNs << " ns/lookup, "
+         << usage.allocatedBytes / 1048576.0 << " MB of nodes" << endl;
+    cout << setw(8) << "epsilon" << setw(10) << "segments" << setw(12) << "model KB"
+         << setw(12) << "total MB" << setw(12) << "ns/lookup" << setw(14) << "with delta" << endl;
+
+    const size_t epsilons[] = { 8, 32, 64, 128, 512 };
+    for(size_t e = 0; e < sizeof(epsilons) / sizeof(epsilons[0]); e++){
+        LearnedIndex<uint64_t, uint64_t> index(epsilons[e]);
+        index.build(tree);
+        uint64_t value;
+        double indexNs = timeLookups(probes, [&index, &value](uint64_t key){ return index.find(key, value); });
+        for(size_t i = 0; i < fresh.size(); i++){
+            index.insert(make_pair(fresh[i], fresh[i] / 2));
+        }
+        double deltaNs = fresh.empty() ? indexNs : timeLookups(mixed, [&index, &value](uint64_t key){ return index.find(key, value); });
+        double totalMb = (index.modelBytes() + index.size() * 2 * sizeof(uint64_t)) / 1048576.0;
+        cout << setw(8) << epsilons[e] << setw(10) << index.segments() << setw(12) << index.modelBytes() / 1024.0
+             << setw(12) << totalMb << setw(12) << indexNs << setw(14) << deltaNs << endl;
+    }
+    return 0;
+}
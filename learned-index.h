@@ -0,0 +1,360 @@
+#ifndef LEARNED_INDEX_H
+#define LEARNED_INDEX_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include "avlbst.h"
+
+/**
+* A read-optimized index for integer keys, built from a tree's sorted
+* contents, that predicts where a key is instead of descending to it:
+*
+*   LearnedIndex<uint64_t, Record> index;
+*   index.build(tree);                  // any BinarySearchTree
+*   index.insert(std::make_pair(key, record));
+*   Record r;
+*   if(index.find(key, r)) ...
+*   index.rebuild();                    // folds the inserts in
+*
+* The keys and values are copied into two sorted arrays, and the keys are
+* covered by a piecewise linear model in the style of the PGM index: each
+* segment maps a key to a position that is off by at most epsilon, so a
+* lookup computes that position and binary-searches the 2 * epsilon + 1
+* keys around it. The segments are found the same way, by a smaller model
+* over their first keys, and so on up to a single root segment. On near-
+* uniform keys a few segments cover millions of keys, so the model is a
+* tiny fraction of the tree's size.
+*
+* Keys that are not in the arrays yet go to a delta buffer (an AVLTree)
+* that lookups fall back to; insert overwrites in place when the key is
+* already in the arrays. rebuild merges the delta in and refits the model,
+* O(n); call it when deltaSize() is no longer small.
+*/
+template <class Key, class Value>
+class LearnedIndex
+{
+public:
+    static_assert(std::is_integral<Key>::value, "LearnedIndex keys must be integers");
+
+    // The error bound for the segments over the segments' first keys
+    static const size_t INNER_EPSILON = 4;
+
+    explicit LearnedIndex(size_t epsilon = 64);
+
+    void build(const BinarySearchTree<Key, Value>& tree);
+    void insert(const std::pair<const Key, Value>& item);
+    void rebuild();
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t size() const;
+    size_t deltaSize() const;
+    size_t segments() const;
+    size_t modelBytes() const;
+
+protected:
+    typedef typename std::make_unsigned<Key>::type Offset;
+
+    struct Segment {
+        double slope;
+        size_t start;   // position of the segment's first key
+    };
+
+    // One level of the model: its segments and their first keys, which
+    // the level above searches
+    struct Level {
+        std::vector<Segment> segments;
+        std::vector<Key> firsts;
+    };
+
+    void fit();
+    static void fitLevel(const std::vector<Key>& keys, size_t epsilon, Level& level);
+    static size_t locate(const std::vector<Key>& keys, size_t first, const Segment& segment, Key key, size_t epsilon);
+    size_t lowerBound(Key key) const;
+
+    size_t epsilon_;
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    std::vector<Level> levels_;     // levels_[0] covers keys_, the last one has one segment
+    AVLTree<Key, Value> delta_;
+    size_t deltaSize_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LearnedIndex class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LearnedIndex<Key, Value>::LearnedIndex(size_t epsilon) :
+    epsilon_(epsilon),
+    deltaSize_(0)
+{
+
+}
+
+/**
+* Replaces the contents with tree's, read through its in-order iterator,
+* and fits the model. O(n).
+*/
+template<class Key, class Value>
+void LearnedIndex<Key, Value>::build(const BinarySearchTree<Key, Value>& tree)
+{
+    keys_.clear();
+    values_.clear();
+    delta_.clear();
+    deltaSize_ = 0;
+    for(typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it){
+        keys_.push_back(it->first);
+        values_.push_back(it->second);
+    }
+    fit();
+}
+
+/**
+* Overwrites the value if key is in the arrays, else adds the item to the
+* delta buffer (overwriting there if it was inserted before).
+*/
+template<class Key, class Value>
+void LearnedIndex<Key, Value>::insert(const std::pair<const Key, Value>& item)
+{
+    size_t pos = lowerBound(item.first);
+    if(pos != keys_.size() && keys_[pos] == item.first){
+        values_[pos] = item.second;
+        return;
+    }
+    if(delta_.find(item.first) == delta_.end()){
+        deltaSize_++;
+    }
+    delta_.insert(item);
+}
+
+/**
+* Merges the delta buffer into the arrays and refits the model. O(n).
+*/
+template<class Key, class Value>
+void LearnedIndex<Key, Value>::rebuild()
+{
+    if(deltaSize_ == 0){
+        return;
+    }
+    std::vector<Key> keys;
+    std::vector<Value> values;
+    keys.reserve(keys_.size() + deltaSize_);
+    values.reserve(keys_.size() + deltaSize_);
+    size_t i = 0;
+    for(typename AVLTree<Key, Value>::iterator it = delta_.begin(); it != delta_.end(); ++it){
+        for(; i < keys_.size() && keys_[i] < it->first; i++){
+            keys.push_back(keys_[i]);
+            values.push_back(values_[i]);
+        }
+        keys.push_back(it->first);
+        values.push_back(it->second);
+    }
+    for(; i < keys_.size(); i++){
+        keys.push_back(keys_[i]);
+        values.push_back(values_[i]);
+    }
+    keys_.swap(keys);
+    values_.swap(values);
+    delta_.clear();
+    deltaSize_ = 0;
+    fit();
+}
+
+/**
+* Fits levels_[0] over keys_, then each next level over the previous
+* level's first keys, until a level has a single segment.
+*/
+template<class Key, class Value>
+void LearnedIndex<Key, Value>::fit()
+{
+    levels_.clear();
+    if(keys_.empty()){
+        return;
+    }
+    levels_.push_back(Level());
+    fitLevel(keys_, epsilon_, levels_.back());
+    while(levels_.back().segments.size() > 1){
+        Level above;
+        fitLevel(levels_.back().firsts, INNER_EPSILON, above);
+        levels_.push_back(above);
+    }
+}
+
+/**
+* Splits the sorted keys into as few segments as a greedy pass allows: a
+* segment starts at a key (predicted exactly) and takes keys as long as
+* some slope keeps every one of them within epsilon positions of the
+* prediction. The slopes that do form a range that only shrinks as keys
+* are added; once it is empty the key starts the next segment.
+*/
+template<class Key, class Value>
+void LearnedIndex<Key, Value>::fitLevel(const std::vector<Key>& keys, size_t epsilon, Level& level)
+{
+    size_t start = 0;
+    double lo = 0;
+    double hi = 0;
+    for(size_t i = 1; i <= keys.size(); i++){
+        bool split = i == keys.size();
+        double newLo = 0;
+        double newHi = 0;
+        if(!split){
+            double dx = static_cast<double>(static_cast<Offset>(keys[i]) - static_cast<Offset>(keys[start]));
+            double dp = static_cast<double>(i - start);
+            // a key equal to the segment's first (never the case for a
+            // tree's keys) leaves no slope to fit: it starts the next
+            // segment rather than divide by zero
+            split = dx == 0;
+            if(!split){
+                newLo = (dp - epsilon) / dx;
+                newHi = (dp + epsilon) / dx;
+                if(i - start > 1){
+                    newLo = std::max(lo, newLo);
+                    newHi = std::min(hi, newHi);
+                }
+                split = newLo > newHi;
+            }
+        }
+        if(split){
+            Segment segment;
+            segment.slope = i - start > 1 ? (lo + hi) / 2 : 0;
+            segment.start = start;
+            level.segments.push_back(segment);
+            level.firsts.push_back(keys[start]);
+            start = i;
+        } else {
+            lo = newLo;
+            hi = newHi;
+        }
+    }
+}
+
+/**
+* The lower bound of key in keys, given the segment (starting at position
+* first) that covers it. Binary-searches the window of epsilon positions
+* around the prediction; the window is checked and widened to the whole
+* side it missed should rounding have put the key outside it.
+*/
+template<class Key, class Value>
+size_t LearnedIndex<Key, Value>::locate(const std::vector<Key>& keys, size_t first, const Segment& segment, Key key, size_t epsilon)
+{
+    double offset = key < keys[first] ? 0 : static_cast<double>(static_cast<Offset>(key) - static_cast<Offset>(keys[first]));
+    double guess = segment.start + segment.slope * offset;
+    size_t predicted = guess < keys.size() ? static_cast<size_t>(guess) : keys.size();
+    size_t lo = predicted > epsilon + 1 ? predicted - epsilon - 1 : 0;
+    size_t hi = std::min(keys.size(), predicted + epsilon + 2);
+    lo = std::min(lo, hi);
+    if(lo > 0 && !(keys[lo - 1] < key)){
+        hi = lo;
+        lo = 0;
+    } else if(hi < keys.size() && keys[hi - 1] < key){
+        lo = hi;
+        hi = keys.size();
+    }
+    return std::lower_bound(keys.begin() + lo, keys.begin() + hi, key) - keys.begin();
+}
+
+/**
+* The position of the first key in keys_ not less than key (keys_.size()
+* if none): down the levels, each one locating the segment of the level
+* below that covers key, then the key itself in keys_.
+*/
+template<class Key, class Value>
+size_t LearnedIndex<Key, Value>::lowerBound(Key key) const
+{
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    if(keys_.empty()){
+        return 0;
+    }
+    size_t segment = 0;
+    for(size_t l = levels_.size() - 1; l > 0; l--){
+        const std::vector<Key>& firsts = levels_[l - 1].firsts;
+        const Level& level = levels_[l];
+        size_t pos = locate(firsts, level.segments[segment].start, level.segments[segment], key, INNER_EPSILON);
+        // the covering segment is the last one starting at or before key
+        segment = pos < firsts.size() && firsts[pos] == key ? pos : (pos > 0 ? pos - 1 : 0);
+    }
+    return locate(keys_, levels_[0].segments[segment].start, levels_[0].segments[segment], key, epsilon_);
+}
+
+/**
+* Copies the value stored under key to value and returns true, or returns
+* false if key is neither in the arrays nor in the delta buffer.
+*/
+template<class Key, class Value>
+bool LearnedIndex<Key, Value>::find(const Key& key, Value& value) const
+{
+    size_t pos = lowerBound(key);
+    if(pos != keys_.size() && keys_[pos] == key){
+        value = values_[pos];
+        return true;
+    }
+    if(deltaSize_ == 0){
+        return false;
+    }
+    typename AVLTree<Key, Value>::iterator it = delta_.find(key);
+    if(it == delta_.end()){
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+template<class Key, class Value>
+bool LearnedIndex<Key, Value>::contains(const Key& key) const
+{
+    size_t pos = lowerBound(key);
+    return (pos != keys_.size() && keys_[pos] == key) || (deltaSize_ != 0 && delta_.find(key) != delta_.end());
+}
+
+template<class Key, class Value>
+size_t LearnedIndex<Key, Value>::size() const
+{
+    return keys_.size() + deltaSize_;
+}
+
+/**
+* The number of keys inserted since the last build or rebuild that are
+* only in the delta buffer.
+*/
+template<class Key, class Value>
+size_t LearnedIndex<Key, Value>::deltaSize() const
+{
+    return deltaSize_;
+}
+
+/**
+* The number of segments over keys_ (the model's bottom level).
+*/
+template<class Key, class Value>
+size_t LearnedIndex<Key, Value>::segments() const
+{
+    return levels_.empty() ? 0 : levels_[0].segments.size();
+}
+
+/**
+* The size of the model, all levels: what the index adds on top of the
+* sorted key and value arrays.
+*/
+template<class Key, class Value>
+size_t LearnedIndex<Key, Value>::modelBytes() const
+{
+    size_t bytes = 0;
+    for(size_t l = 0; l < levels_.size(); l++){
+        bytes += levels_[l].segments.size() * (sizeof(Segment) + sizeof(Key));
+    }
+    return bytes;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LearnedIndex class.
+  ---------------------------------------------
+*/
+
+#endif
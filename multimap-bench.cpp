@@ -0,0 +1,178 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include "avlmulti.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: multimap-bench [items] [copies]
+//
+// Compares AVLMultiMap<uint64_t, uint64_t> with the workaround it replaces,
+// AVLTree<uint64_t, vector<uint64_t> >: items values spread over
+// items/copies random keys, so each key has about copies values. Times
+// inserting them all, count for every key, a scan of every key's values
+// (equalRange vs the vector) and removing the values one at a time, first
+// value of a key first. Also counts heap allocations per item inserted.
+
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = malloc(size);
+    if(p == nullptr){
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// the workaround's value; a struct rather than a bare vector so print()
+// finds its operator<<
+struct Values {
+    vector<uint64_t> v;
+
+    explicit Values(uint64_t first) : v(1, first) {}
+};
+
+static ostream& operator<<(ostream& out, const Values& values)
+{
+    return out << values.v.size() << " values";
+}
+
+struct Times {
+    double insertNs;
+    double countNs;
+    double scanNs;
+    double removeNs;
+    double allocsPerItem;
+};
+
+static double nsPerOp(uint64_t start, size_t ops)
+{
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+static Times runMulti(const vector<uint64_t>& keys, size_t distinct)
+{
+    Times t;
+    AVLMultiMap<uint64_t, uint64_t> tree;
+    size_t before = allocations;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(make_pair(keys[i], i));
+    }
+    t.insertNs = nsPerOp(start, keys.size());
+    t.allocsPerItem = static_cast<double>(allocations - before) / keys.size();
+
+    uint64_t sum = 0;
+    start = benchNowNs();
+    for(uint64_t k = 0; k < distinct; k++){
+        sum += tree.count(k);
+    }
+    t.countNs = nsPerOp(start, distinct);
+
+    start = benchNowNs();
+    for(uint64_t k = 0; k < distinct; k++){
+        pair<AVLMultiMap<uint64_t, uint64_t>::iterator, AVLMultiMap<uint64_t, uint64_t>::iterator> range = tree.equalRange(k);
+        for(; range.first != range.second; ++range.first){
+            sum += range.first->second;
+        }
+    }
+    t.scanNs = nsPerOp(start, distinct);
+
+    start = benchNowNs();
+    for(size_t i = 0; i < keys.size(); i++){
+        sum += tree.removeOne(keys[i]);
+    }
+    t.removeNs = nsPerOp(start, keys.size());
+    benchKeep(sum);
+    return t;
+}
+
+static Times runVector(const vector<uint64_t>& keys, size_t distinct)
+{
+    typedef AVLTree<uint64_t, Values> Tree;
+    Times t;
+    Tree tree;
+    size_t before = allocations;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < keys.size(); i++){
+        Tree::iterator it = tree.find(keys[i]);
+        if(it == tree.end()){
+            tree.insert(make_pair(keys[i], Values(i)));
+        } else {
+            it->second.v.push_back(i);
+        }
+    }
+    t.insertNs = nsPerOp(start, keys.size());
+    t.allocsPerItem = static_cast<double>(allocations - before) / keys.size();
+
+    uint64_t sum = 0;
+    start = benchNowNs();
+    for(uint64_t k = 0; k < distinct; k++){
+        Tree::iterator it = tree.find(k);
+        sum += it == tree.end() ? 0 : it->second.v.size();
+    }
+    t.countNs = nsPerOp(start, distinct);
+
+    start = benchNowNs();
+    for(uint64_t k = 0; k < distinct; k++){
+        Tree::iterator it = tree.find(k);
+        if(it != tree.end()){
+            for(size_t i = 0; i < it->second.v.size(); i++){
+                sum += it->second.v[i];
+            }
+        }
+    }
+    t.scanNs = nsPerOp(start, distinct);
+
+    start = benchNowNs();
+    for(size_t i = 0; i < keys.size(); i++){
+        Tree::iterator it = tree.find(keys[i]);
+        if(it->second.v.size() == 1){
+            tree.remove(keys[i]);
+        } else {
+            it->second.v.erase(it->second.v.begin());
+        }
+    }
+    t.removeNs = nsPerOp(start, keys.size());
+    benchKeep(sum);
+    return t;
+}
+
+static void print(const string& name, const Times& t)
+{
+    cout << left << setw(14) << name << right << fixed << setprecision(1)
+         << setw(10) << t.insertNs << setw(10) << t.countNs
+         << setw(10) << t.scanNs << setw(10) << t.removeNs
+         << setw(12) << setprecision(2) << t.allocsPerItem << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t copies = benchArg(argc, argv, 2, 8);
+    size_t distinct = max<size_t>(1, n / copies);
+    vector<uint64_t> keys(n);
+    BenchRng rng(5);
+    for(size_t i = 0; i < n; i++){
+        keys[i] = rng.below(distinct);
+    }
+
+    cout << left << setw(14) << "ns/op" << right
+         << setw(10) << "insert" << setw(10) << "count"
+         << setw(10) << "scan" << setw(10) << "removeOne"
+         << setw(12) << "allocs/item" << endl;
+    print("multimap", runMulti(keys, distinct));
+    print("tree+vector", runVector(keys, distinct));
+    return 0;
+}
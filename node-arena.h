@@ -0,0 +1,117 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <vector>
+#include <new>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+
+/**
+* Contiguous storage for the nodes of one tree, filled by
+* BinarySearchTree::compact. Each block is a single allocation that nodes
+* are copy-constructed into back to back (see placeAt), in the order
+* compact lays them out. A node in a block is destroyed in place (see
+* destroyNode), and the block is freed once its last node is gone; until
+* then the slots of removed nodes stay unused. Nodes that insert
+* allocated with new are not the arena's (owns is false for them).
+*/
+class NodeArena
+{
+public:
+    NodeArena() {}
+
+    ~NodeArena()
+    {
+        for(size_t i = 0; i < blocks_.size(); i++){
+            ::operator delete(blocks_[i].begin);
+        }
+    }
+
+    // Where a node of the given size goes in a block whose first free byte
+    // is at offset. The size of a type is a multiple of its alignment, so
+    // aligning to the size's lowest set bit (at most what new guarantees)
+    // is enough, and equal-sized nodes pack with no gaps.
+    static size_t placeAt(size_t offset, size_t bytes)
+    {
+        size_t align = std::min<size_t>(bytes & (~bytes + 1), alignof(std::max_align_t));
+        return (offset + align - 1) / align * align;
+    }
+
+    // Starts a new block of the given size; allocate carves from it.
+    void startBlock(size_t bytes)
+    {
+        Block block;
+        block.begin = static_cast<char*>(::operator new(bytes));
+        block.size = bytes;
+        block.used = 0;
+        block.live = 0;
+        blocks_.push_back(block);
+    }
+
+    // A slot for a node of the given size in the newest block, which must
+    // have room for it.
+    void* allocate(size_t bytes)
+    {
+        Block& block = blocks_.back();
+        size_t at = placeAt(block.used, bytes);
+        block.used = at + bytes;
+        block.live++;
+        return block.begin + at;
+    }
+
+    bool owns(const void* p) const
+    {
+        return find(p) != blocks_.size();
+    }
+
+    // Gives back the slot of a node already destroyed; frees its block if
+    // that was the block's last node.
+    void release(const void* p)
+    {
+        size_t i = find(p);
+        if(--blocks_[i].live == 0){
+            ::operator delete(blocks_[i].begin);
+            blocks_.erase(blocks_.begin() + i);
+        }
+    }
+
+    // Bytes held in blocks, live and dead slots alike.
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for(size_t i = 0; i < blocks_.size(); i++){
+            total += blocks_[i].size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        char* begin;
+        size_t size;
+        size_t used;
+        size_t live;
+    };
+
+    // The index of the block holding p, or blocks_.size() if none does.
+    // There are rarely more than two blocks (one per compact whose nodes
+    // are not all gone yet).
+    size_t find(const void* p) const
+    {
+        std::less<const void*> before;
+        for(size_t i = 0; i < blocks_.size(); i++){
+            if(!before(p, blocks_[i].begin) && before(p, blocks_[i].begin + blocks_[i].size)){
+                return i;
+            }
+        }
+        return blocks_.size();
+    }
+
+    NodeArena(const NodeArena&);
+    NodeArena& operator=(const NodeArena&);
+
+    std::vector<Block> blocks_;
+};
+
+#endif
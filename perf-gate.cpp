@@ -0,0 +1,411 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: perf-gate record <baseline> [trials] [filter]
+//        perf-gate check <baseline> [trials] [filter]
+//        perf-gate list
+//
+// A local performance regression gate for the trees. Every case times a
+// batch of OPS operations on a tree of n keys, for n = 2^10 .. 2^maxLog,
+// repeated for a number of trials (default 11) with different seeds.
+//
+// record runs all cases (or those whose name contains filter) and writes
+// them to the baseline file, keeping the cases already there that it did
+// not rerun. check reruns them and compares with the baseline:
+//   - at the largest size, the per-op times of the trials are compared with
+//     a two-sided Mann-Whitney U test and a bootstrap 95% CI of the ratio of
+//     medians (new / baseline). A case is SLOWER when p < ALPHA and the
+//     whole CI is above 1 + TOLERANCE (FASTER likewise below 1 - TOLERANCE).
+//   - the median per-op time at each size is fitted as t ~ n^slope. A slope
+//     under 0.65 is LOGARITHMIC (also covers O(1); cache misses push real
+//     O(log n) trees to ~0.3-0.4 at these sizes), under 1.5 LINEAR, else
+//     QUADRATIC. A class above the baseline's is a COMPLEXITY regression,
+//     e.g. an O(log n) insert that turned O(n).
+// check exits with 1 if any case regressed. The reference case
+// bst/insert_sorted is O(n) per op by design, to show what such a
+// regression looks like.
+
+static const size_t OPS = 2000;
+static const int MIN_LOG = 10;
+static const double ALPHA = 0.01;
+static const double TOLERANCE = 0.05;
+static const int BOOTSTRAP_ROUNDS = 2000;
+
+/*
+ * Cases: each returns the ns per operation for one trial.
+ */
+
+template<typename Tree>
+static void build(Tree& tree, const vector<uint64_t>& keys, size_t count)
+{
+    for(size_t i = 0; i < count; i++){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+}
+
+template<typename Tree>
+static double insertCase(size_t n, uint64_t seed)
+{
+    vector<uint64_t> keys = benchShuffledKeys(n + OPS, seed);
+    Tree tree;
+    build(tree, keys, n);
+    uint64_t start = benchNowNs();
+    for(size_t i = n; i < n + OPS; i++){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    return static_cast<double>(benchNowNs() - start) / OPS;
+}
+
+template<typename Tree>
+static double findCase(size_t n, uint64_t seed)
+{
+    vector<uint64_t> keys = benchShuffledKeys(n, seed);
+    Tree tree;
+    build(tree, keys, n);
+    BenchRng rng(seed + 1);
+    vector<uint64_t> probes(OPS);
+    for(size_t i = 0; i < OPS; i++){
+        probes[i] = rng.below(n);
+    }
+    size_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < OPS; i++){
+        found += tree.find(probes[i]) != tree.end();
+    }
+    double ns = static_cast<double>(benchNowNs() - start) / OPS;
+    benchKeep(found);
+    return ns;
+}
+
+template<typename Tree>
+static double removeCase(size_t n, uint64_t seed)
+{
+    vector<uint64_t> keys = benchShuffledKeys(n, seed);
+    Tree tree;
+    build(tree, keys, n);
+    vector<uint64_t> order = benchShuffledKeys(n, seed + 1);
+    size_t ops = min(OPS, n / 2);
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < ops; i++){
+        tree.remove(order[i]);
+    }
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+// Appends keys in increasing order to an unbalanced BST: O(n) per insert.
+// Only n/8 inserts are timed so the tree does not grow much meanwhile.
+static double sortedBstInsertCase(size_t n, uint64_t seed)
+{
+    BinarySearchTree<uint64_t, uint64_t> tree;
+    for(size_t i = 0; i < n; i++){
+        tree.insert(make_pair(i, seed));
+    }
+    size_t ops = n / 8;
+    uint64_t start = benchNowNs();
+    for(size_t i = n; i < n + ops; i++){
+        tree.insert(make_pair(i, seed));
+    }
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+struct GateCase {
+    const char* name;
+    int maxLog;
+    double (*run)(size_t n, uint64_t seed);
+};
+
+typedef BinarySearchTree<uint64_t, uint64_t> Bst;
+typedef AVLTree<uint64_t, uint64_t> Avl;
+typedef RedBlackTree<uint64_t, uint64_t> Rb;
+
+static const GateCase kCases[] = {
+    { "bst/insert", 17, insertCase<Bst> },
+    { "bst/find", 17, findCase<Bst> },
+    { "bst/remove", 17, removeCase<Bst> },
+    { "bst/insert_sorted", 13, sortedBstInsertCase },
+    { "avl/insert", 17, insertCase<Avl> },
+    { "avl/find", 17, findCase<Avl> },
+    { "avl/remove", 17, removeCase<Avl> },
+    { "rb/insert", 17, insertCase<Rb> },
+    { "rb/find", 17, findCase<Rb> },
+    { "rb/remove", 17, removeCase<Rb> },
+};
+
+/*
+ * Statistics.
+ */
+
+static double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/**
+* Two-sided p-value of the Mann-Whitney U test (normal approximation with
+* tie correction and continuity correction).
+*/
+static double mannWhitneyP(const vector<double>& a, const vector<double>& b)
+{
+    vector<pair<double, int> > all;
+    for(size_t i = 0; i < a.size(); i++) all.push_back(make_pair(a[i], 0));
+    for(size_t i = 0; i < b.size(); i++) all.push_back(make_pair(b[i], 1));
+    sort(all.begin(), all.end());
+
+    double n1 = a.size(), n2 = b.size(), n = n1 + n2;
+    double rankSumA = 0, tieTerm = 0;
+    for(size_t i = 0; i < all.size(); ){
+        size_t j = i;
+        while(j < all.size() && all[j].first == all[i].first) j++;
+        double rank = (i + 1 + j) / 2.0;
+        double ties = j - i;
+        tieTerm += ties * ties * ties - ties;
+        for(size_t k = i; k < j; k++){
+            if(all[k].second == 0) rankSumA += rank;
+        }
+        i = j;
+    }
+    double u = rankSumA - n1 * (n1 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tieTerm / (n * (n - 1)));
+    if(variance <= 0) return 1.0;
+    double diff = fabs(u - mean) - 0.5;
+    if(diff < 0) diff = 0;
+    return erfc(diff / sqrt(variance) / sqrt(2.0));
+}
+
+/**
+* Percentile bootstrap 95% CI of median(now) / median(base).
+*/
+static void bootstrapRatio(const vector<double>& base, const vector<double>& now, double& low, double& high)
+{
+    BenchRng rng(42);
+    vector<double> ratios(BOOTSTRAP_ROUNDS);
+    vector<double> sampleBase(base.size()), sampleNow(now.size());
+    for(int r = 0; r < BOOTSTRAP_ROUNDS; r++){
+        for(size_t i = 0; i < base.size(); i++) sampleBase[i] = base[rng.below(base.size())];
+        for(size_t i = 0; i < now.size(); i++) sampleNow[i] = now[rng.below(now.size())];
+        ratios[r] = median(sampleNow) / median(sampleBase);
+    }
+    sort(ratios.begin(), ratios.end());
+    low = ratios[BOOTSTRAP_ROUNDS * 25 / 1000];
+    high = ratios[BOOTSTRAP_ROUNDS * 975 / 1000 - 1];
+}
+
+/**
+* Least squares slope of log(t) over log(n).
+*/
+static double fitSlope(const vector<size_t>& sizes, const vector<double>& times)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, k = sizes.size();
+    for(size_t i = 0; i < sizes.size(); i++){
+        double x = log(static_cast<double>(sizes[i]));
+        double y = log(times[i]);
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    return (k * sxy - sx * sy) / (k * sxx - sx * sx);
+}
+
+static const char* kClasses[] = { "LOGARITHMIC", "LINEAR", "QUADRATIC" };
+
+static int complexityClass(double slope)
+{
+    return slope < 0.65 ? 0 : (slope < 1.5 ? 1 : 2);
+}
+
+static int classIndex(const string& name)
+{
+    for(int c = 0; c < 3; c++){
+        if(name == kClasses[c]) return c;
+    }
+    return -1;
+}
+
+/*
+ * Running and storing results.
+ */
+
+struct CaseResult {
+    string name;
+    int complexity;
+    double slope;
+    size_t gateSize;
+    vector<double> samples;   // ns/op per trial at gateSize
+};
+
+static CaseResult runCase(const GateCase& gateCase, int trials)
+{
+    CaseResult result;
+    result.name = gateCase.name;
+    vector<size_t> sizes;
+    vector<double> medians;
+    for(int lg = MIN_LOG; lg <= gateCase.maxLog; lg++){
+        size_t n = size_t(1) << lg;
+        vector<double> samples;
+        for(int t = 0; t < trials; t++){
+            samples.push_back(gateCase.run(n, 1000 * lg + t + 1));
+        }
+        sizes.push_back(n);
+        medians.push_back(median(samples));
+        result.samples = samples;
+        result.gateSize = n;
+    }
+    result.slope = fitSlope(sizes, medians);
+    result.complexity = complexityClass(result.slope);
+    return result;
+}
+
+static bool writeBaseline(const string& path, const map<string, CaseResult>& results)
+{
+    ofstream out(path.c_str());
+    if(!out) return false;
+    out << "# perf-gate baseline: name class slope size trials ns/op...\n";
+    for(map<string, CaseResult>::const_iterator it = results.begin(); it != results.end(); ++it){
+        const CaseResult& r = it->second;
+        out << r.name << " " << kClasses[r.complexity] << " " << r.slope << " " << r.gateSize << " " << r.samples.size();
+        for(size_t s = 0; s < r.samples.size(); s++){
+            out << " " << r.samples[s];
+        }
+        out << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+static bool readBaseline(const string& path, map<string, CaseResult>& results)
+{
+    ifstream in(path.c_str());
+    if(!in) return false;
+    string line;
+    while(getline(in, line)){
+        if(line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        CaseResult r;
+        string complexity;
+        size_t count = 0;
+        fields >> r.name >> complexity >> r.slope >> r.gateSize >> count;
+        r.complexity = classIndex(complexity);
+        r.samples.resize(count);
+        for(size_t s = 0; s < count; s++){
+            fields >> r.samples[s];
+        }
+        if(!fields || r.complexity < 0){
+            cerr << "perf-gate: bad baseline line: " << line << endl;
+            return false;
+        }
+        results[r.name] = r;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    string command = argc > 1 ? argv[1] : "";
+    const size_t caseCount = sizeof(kCases) / sizeof(kCases[0]);
+    if(command == "list"){
+        for(size_t c = 0; c < caseCount; c++){
+            cout << kCases[c].name << "  n=2^" << MIN_LOG << "..2^" << kCases[c].maxLog << endl;
+        }
+        return 0;
+    }
+    if((command != "record" && command != "check") || argc < 3){
+        cerr << "usage: perf-gate record|check <baseline> [trials] [filter]" << endl
+             << "       perf-gate list" << endl;
+        return 2;
+    }
+    string path = argv[2];
+    int trials = static_cast<int>(benchArg(argc, argv, 3, 11));
+    string filter = argc > 4 ? argv[4] : "";
+    if(trials < 3){
+        cerr << "perf-gate: need at least 3 trials" << endl;
+        return 2;
+    }
+
+    // record merges into an existing baseline, so it must read it too (a
+    // missing file is fine there, an unreadable one is not overwritten)
+    map<string, CaseResult> baseline;
+    if(!readBaseline(path, baseline) && (command == "check" || ifstream(path.c_str()))){
+        cerr << "perf-gate: cannot read baseline " << path << endl;
+        return 2;
+    }
+
+    cout << left << setw(20) << "case" << right << setw(10) << "base" << setw(10) << "now"
+         << setw(24) << "ratio [95% CI]" << setw(10) << "p" << "   complexity (slope)" << endl;
+
+    vector<CaseResult> results;
+    int regressions = 0;
+    for(size_t c = 0; c < caseCount; c++){
+        if(string(kCases[c].name).find(filter) == string::npos) continue;
+        CaseResult now = runCase(kCases[c], trials);
+        results.push_back(now);
+        cout << left << setw(20) << now.name << right << fixed << setprecision(1);
+
+        if(command == "record"){
+            cout << setw(10) << "" << setw(10) << median(now.samples) << setw(24) << "" << setw(10) << ""
+                 << "   " << kClasses[now.complexity] << " (" << setprecision(2) << now.slope << ")" << endl;
+            continue;
+        }
+
+        map<string, CaseResult>::const_iterator found = baseline.find(now.name);
+        if(found == baseline.end() || found->second.gateSize != now.gateSize){
+            cout << setw(10) << "-" << setw(10) << median(now.samples) << "   (no baseline)" << endl;
+            continue;
+        }
+        const CaseResult& base = found->second;
+        double low, high;
+        bootstrapRatio(base.samples, now.samples, low, high);
+        double p = mannWhitneyP(base.samples, now.samples);
+        double ratio = median(now.samples) / median(base.samples);
+
+        // a case that is both SLOWER and COMPLEXITY is one regression
+        string verdict = "ok";
+        bool regressed = false;
+        if(p < ALPHA && low > 1 + TOLERANCE){
+            verdict = "SLOWER";
+            regressed = true;
+        } else if(p < ALPHA && high < 1 - TOLERANCE){
+            verdict = "faster";
+        }
+        if(now.complexity > base.complexity){
+            verdict = verdict == "ok" ? "COMPLEXITY" : verdict + ", COMPLEXITY";
+            regressed = true;
+        }
+        if(regressed){
+            regressions++;
+        }
+
+        ostringstream ci;
+        ci << fixed << setprecision(3) << ratio << " [" << low << ", " << high << "]";
+        cout << setw(10) << median(base.samples) << setw(10) << median(now.samples)
+             << setw(24) << ci.str() << setw(10) << setprecision(4) << p
+             << "   " << kClasses[base.complexity] << " -> " << kClasses[now.complexity]
+             << " (" << setprecision(2) << now.slope << ")  " << verdict << endl;
+    }
+
+    if(command == "record"){
+        for(size_t i = 0; i < results.size(); i++){
+            baseline[results[i].name] = results[i];
+        }
+        if(!writeBaseline(path, baseline)){
+            cerr << "perf-gate: cannot write " << path << endl;
+            return 2;
+        }
+        cout << "wrote " << results.size() << " cases to " << path << " (" << baseline.size() << " in all)" << endl;
+        return 0;
+    }
+    cout << (regressions ? "FAIL: " : "PASS: ") << regressions << " regression(s)" << endl;
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "avlbst.h"
+#include "rbbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: rb-bench [keys] [ops]
+//
+// Preloads AVLTree and RedBlackTree with the same keys, then times the same
+// random operation stream for several insert/remove/lookup mixes.
+
+struct Mix {
+    const char* name;
+    int insertPct;
+    int removePct;   // the rest are lookups
+};
+
+static const Mix kMixes[] = {
+    { "ingest 90/10/0", 90, 10 },
+    { "churn 50/50/0", 50, 50 },
+    { "mixed 25/25/50", 25, 25 },
+    { "read 5/5/90", 5, 5 },
+};
+
+template<typename Tree>
+static double run(const vector<uint64_t>& preload, const vector<pair<int, uint64_t> >& ops)
+{
+    Tree tree;
+    for(size_t i = 0; i < preload.size(); i++){
+        tree.insert(make_pair(preload[i], preload[i]));
+    }
+    uint64_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < ops.size(); i++){
+        if(ops[i].first == 0){
+            tree.insert(make_pair(ops[i].second, ops[i].second));
+        } else if(ops[i].first == 1){
+            tree.remove(ops[i].second);
+        } else if(tree.find(ops[i].second) != tree.end()){
+            found++;
+        }
+    }
+    uint64_t ns = benchNowNs() - start;
+    benchKeep(found);
+    return static_cast<double>(ns) / ops.size();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t count = benchArg(argc, argv, 2, 1000000);
+    vector<uint64_t> preload = benchShuffledKeys(n, 7);
+
+    cout << left << setw(18) << "mix (ins/rem/find)" << right << setw(12) << "avl" << setw(12) << "rb"
+         << "   (ns/op, n=" << n << ")" << endl;
+    for(size_t m = 0; m < sizeof(kMixes) / sizeof(kMixes[0]); m++){
+        BenchRng rng(11 + m);
+        vector<pair<int, uint64_t> > ops(count);
+        for(size_t i = 0; i < count; i++){
+            int pick = static_cast<int>(rng.below(100));
+            int op = pick < kMixes[m].insertPct ? 0 : (pick < kMixes[m].insertPct + kMixes[m].removePct ? 1 : 2);
+            // keys over twice the preloaded range, so half the lookups miss
+            ops[i] = make_pair(op, rng.below(2 * n));
+        }
+        cout << left << setw(18) << kMixes[m].name << right << fixed << setprecision(1)
+             << setw(12) << run<AVLTree<uint64_t, uint64_t> >(preload, ops)
+             << setw(12) << run<RedBlackTree<uint64_t, uint64_t> >(preload, ops) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,378 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+
+/**
+* A node for a red-black tree. The color is a single byte, in the same spot
+* AVLNode keeps its balance. (Tagging the low bit of parent_ would save the
+* byte but breaks Node::setParent, which removal and the rotations use.)
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    enum Color { RED = 0, BLACK = 1 };
+
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    uint8_t getColor() const;
+    void setColor(uint8_t color);
+
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+    virtual size_t footprint() const override;
+    virtual Node<Key, Value>* cloneInto(void* where) const override;
+
+protected:
+    uint8_t color_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* New nodes are red.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent), color_(RED)
+{
+
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+template<class Key, class Value>
+uint8_t RBNode<Key, Value>::getColor() const
+{
+    return color_;
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(uint8_t color)
+{
+    color_ = color;
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+size_t RBNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* RBNode<Key, Value>::cloneInto(void* where) const
+{
+    return new (where) RBNode<Key, Value>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A red-black tree. Lookups may descend up to 2 log n levels (vs ~1.44 log n
+* for AVL), but every insert does at most 2 rotations and every remove at
+* most 3, with recoloring being O(1) amortized. Prefer it over AVLTree for
+* update-heavy workloads.
+*/
+template <class Key, class Value>
+class RedBlackTree : public BinarySearchTree<Key, Value>
+{
+public:
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key &key);
+
+protected:
+    virtual Node<Key, Value>* insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item);
+    virtual void eraseNode(Node<Key, Value>* node);
+    void remove_at(RBNode<Key, Value> *remove_node);
+    void insert_fix(RBNode<Key, Value> *current);
+    void remove_fix(RBNode<Key, Value> *current, RBNode<Key, Value> *parent);
+    static bool isBlack(RBNode<Key, Value> *current);
+};
+
+/**
+* NULL leaves count as black.
+*/
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isBlack(RBNode<Key, Value> *current)
+{
+    return current == nullptr || current->getColor() == RBNode<Key, Value>::BLACK;
+}
+
+/*
+ * If key is already in the tree, the value is overwritten.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    if(this->root_ == nullptr){
+        RBNode<Key, Value>* new_node = new RBNode<Key, Value>(new_item.first, new_item.second, nullptr);
+        new_node->setColor(RBNode<Key, Value>::BLACK);
+        this->setRoot(new_node);
+        return;
+    }
+
+    RBNode<Key, Value>* curr = static_cast<RBNode<Key, Value>*>(this->root_);
+    while(true){
+        RBNode<Key, Value>* next;
+        if(new_item.first < curr->getKey()){
+            next = curr->getLeft();
+        } else if(curr->getKey() < new_item.first){
+            next = curr->getRight();
+        } else {
+            break;
+        }
+        if(next == nullptr){
+            break;
+        }
+        curr = next;
+    }
+    RedBlackTree<Key, Value>::insertBelow(curr, new_item);
+}
+
+/**
+* Finishes an insert (or insertNear) whose search ended at at: overwrites
+* its value if the keys match, else links a new red leaf under it and
+* fixes the colors. Returns the node holding new_item.
+*/
+template<class Key, class Value>
+Node<Key, Value>* RedBlackTree<Key, Value>::insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item)
+{
+    if(at == nullptr){
+        RedBlackTree<Key, Value>::insert(new_item);
+        return this->root_;
+    }
+    RBNode<Key, Value>* curr = static_cast<RBNode<Key, Value>*>(at);
+    if(!(new_item.first < curr->getKey()) && !(curr->getKey() < new_item.first)){
+        curr->setValue(new_item.second);
+        return curr;
+    }
+    RBNode<Key, Value>* new_node = new RBNode<Key, Value>(new_item.first, new_item.second, curr);
+    if(new_item.first < curr->getKey()){
+        curr->setLeft(new_node);
+    } else {
+        curr->setRight(new_node);
+    }
+    insert_fix(new_node);
+    BST_CHECK_PATH(this, new_node);
+    return new_node;
+}
+
+/**
+* Restores the red-black properties after current (red) was linked in:
+* recolor while the uncle is red, then at most 2 rotations.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::insert_fix(RBNode<Key, Value> *current)
+{
+    const uint8_t RED = RBNode<Key, Value>::RED;
+    const uint8_t BLACK = RBNode<Key, Value>::BLACK;
+
+    RBNode<Key, Value>* parent = current->getParent();
+    while(parent != nullptr && parent->getColor() == RED){
+        RBNode<Key, Value>* grand_parent = parent->getParent();
+        if(grand_parent->getLeft() == parent){
+            RBNode<Key, Value>* uncle = grand_parent->getRight();
+            if(!isBlack(uncle)){
+                parent->setColor(BLACK);
+                uncle->setColor(BLACK);
+                grand_parent->setColor(RED);
+                current = grand_parent;
+            } else {
+                if(parent->getRight() == current){
+                    // zig zag
+                    this->rotate_left(parent);
+                    current = parent;
+                    parent = current->getParent();
+                }
+                this->rotate_right(grand_parent);
+                parent->setColor(BLACK);
+                grand_parent->setColor(RED);
+                break;
+            }
+        } else {
+            RBNode<Key, Value>* uncle = grand_parent->getLeft();
+            if(!isBlack(uncle)){
+                parent->setColor(BLACK);
+                uncle->setColor(BLACK);
+                grand_parent->setColor(RED);
+                current = grand_parent;
+            } else {
+                if(parent->getLeft() == current){
+                    // zig zag
+                    this->rotate_right(parent);
+                    current = parent;
+                    parent = current->getParent();
+                }
+                this->rotate_left(grand_parent);
+                parent->setColor(BLACK);
+                grand_parent->setColor(RED);
+                break;
+            }
+        }
+        parent = current->getParent();
+    }
+    static_cast<RBNode<Key, Value>*>(this->root_)->setColor(BLACK);
+}
+
+/*
+ * A node with 2 children is replaced by its predecessor, which takes over
+ * its color, so the coloring stays in place. Removing a red
+ * node needs no fixing; removing a black one leaves its replacement
+ * "doubly black", which remove_fix resolves.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::remove(const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    RBNode<Key, Value>* remove_node = static_cast<RBNode<Key, Value>*>(this->internalFind(key));
+    if(remove_node == nullptr){
+        return;
+    }
+    remove_at(remove_node);
+}
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    remove_at(static_cast<RBNode<Key, Value>*>(node));
+}
+
+/**
+* Unlinks and frees remove_node, then restores the colors.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::remove_at(RBNode<Key, Value>* remove_node)
+{
+    RBNode<Key, Value>* child;
+    RBNode<Key, Value>* parent;
+    bool was_black;
+    if(remove_node->getLeft() != nullptr && remove_node->getRight() != nullptr){
+        // the predecessor takes over the node's place and color, so the
+        // color that disappears is the predecessor's
+        RBNode<Key, Value>* pred_node = static_cast<RBNode<Key, Value>*>(this->predecessor(remove_node));
+        child = pred_node->getLeft();
+        was_black = pred_node->getColor() == RBNode<Key, Value>::BLACK;
+        pred_node->setColor(remove_node->getColor());
+        parent = static_cast<RBNode<Key, Value>*>(this->replaceWithPredecessor(remove_node, pred_node));
+        this->destroyNode(remove_node);
+    } else {
+        child = remove_node->getLeft() != nullptr ? remove_node->getLeft() : remove_node->getRight();
+        was_black = remove_node->getColor() == RBNode<Key, Value>::BLACK;
+        parent = static_cast<RBNode<Key, Value>*>(this->removeNode(remove_node));
+    }
+
+    if(was_black){
+        remove_fix(child, parent);
+    }
+    BST_CHECK_PATH(this, parent);
+}
+
+/**
+* Fixes a missing black on the path through current (possibly NULL), whose
+* parent is passed in since current may be a NULL leaf. At most 3 rotations.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::remove_fix(RBNode<Key, Value> *current, RBNode<Key, Value> *parent)
+{
+    const uint8_t RED = RBNode<Key, Value>::RED;
+    const uint8_t BLACK = RBNode<Key, Value>::BLACK;
+
+    while(parent != nullptr && isBlack(current)){
+        if(parent->getLeft() == current){
+            RBNode<Key, Value>* sibling = parent->getRight();
+            if(!isBlack(sibling)){
+                sibling->setColor(BLACK);
+                parent->setColor(RED);
+                this->rotate_left(parent);
+                sibling = parent->getRight();
+            }
+            if(isBlack(sibling->getLeft()) && isBlack(sibling->getRight())){
+                sibling->setColor(RED);
+                current = parent;
+                parent = current->getParent();
+            } else {
+                if(isBlack(sibling->getRight())){
+                    sibling->getLeft()->setColor(BLACK);
+                    sibling->setColor(RED);
+                    this->rotate_right(sibling);
+                    sibling = parent->getRight();
+                }
+                sibling->setColor(parent->getColor());
+                parent->setColor(BLACK);
+                sibling->getRight()->setColor(BLACK);
+                this->rotate_left(parent);
+                current = static_cast<RBNode<Key, Value>*>(this->root_);
+                parent = nullptr;
+            }
+        } else {
+            RBNode<Key, Value>* sibling = parent->getLeft();
+            if(!isBlack(sibling)){
+                sibling->setColor(BLACK);
+                parent->setColor(RED);
+                this->rotate_right(parent);
+                sibling = parent->getLeft();
+            }
+            if(isBlack(sibling->getLeft()) && isBlack(sibling->getRight())){
+                sibling->setColor(RED);
+                current = parent;
+                parent = current->getParent();
+            } else {
+                if(isBlack(sibling->getLeft())){
+                    sibling->getRight()->setColor(BLACK);
+                    sibling->setColor(RED);
+                    this->rotate_left(sibling);
+                    sibling = parent->getLeft();
+                }
+                sibling->setColor(parent->getColor());
+                parent->setColor(BLACK);
+                sibling->getLeft()->setColor(BLACK);
+                this->rotate_right(parent);
+                current = static_cast<RBNode<Key, Value>*>(this->root_);
+                parent = nullptr;
+            }
+        }
+    }
+    if(current != nullptr){
+        current->setColor(BLACK);
+    }
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "avlreadmostly.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: readmostly-bench [max readers] [keys] [ms per run]
+//
+// Read throughput with one concurrent writer, for 1 to max readers
+// (default 16) in powers of two. The writer loops inserting and removing
+// keys that are not in the prefilled set (keys, default 1M), the readers
+// look up uniform keys, half of them hits. Compares:
+//   mutex      AVLTree with one std::mutex taken by readers and writer
+//   readmostly ReadMostlyAVLTree: lock-free readers, epoch reclamation
+// Prints total reader Mops/s and writer Kops/s for each reader count.
+
+class MutexTree
+{
+public:
+    void insert(const pair<const uint64_t, uint64_t>& item)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.insert(item);
+    }
+
+    void remove(uint64_t key)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.remove(key);
+    }
+
+    bool find(uint64_t key, uint64_t& value)
+    {
+        lock_guard<mutex> guard(lock_);
+        AVLTree<uint64_t, uint64_t>::iterator it = tree_.find(key);
+        if(it == tree_.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+private:
+    mutex lock_;
+    AVLTree<uint64_t, uint64_t> tree_;
+};
+
+template<typename Tree>
+static void reader(Tree& tree, uint64_t keys, uint64_t seed, atomic<bool>& stop, uint64_t& ops)
+{
+    BenchRng rng(seed);
+    uint64_t found = 0;
+    uint64_t value;
+    uint64_t n = 0;
+    while(!stop.load(memory_order_relaxed)){
+        for(int i = 0; i < 64; i++){
+            found += tree.find(rng.below(2 * keys) * 2, value);
+        }
+        n += 64;
+    }
+    benchKeep(found);
+    ops = n;
+}
+
+template<typename Tree>
+static void writer(Tree& tree, uint64_t keys, atomic<bool>& stop, uint64_t& ops)
+{
+    BenchRng rng(1);
+    uint64_t n = 0;
+    while(!stop.load(memory_order_relaxed)){
+        // odd keys, never looked up and never in the prefill
+        uint64_t key = rng.below(keys) * 2 + 1;
+        if(n & 1){
+            tree.remove(key);
+        } else {
+            tree.insert(make_pair(key, key));
+        }
+        n++;
+    }
+    ops = n;
+}
+
+template<typename Tree>
+static void run(const string& name, size_t maxReaders, size_t keys, size_t ms)
+{
+    cout << left << setw(12) << name << right << fixed << setprecision(2);
+    for(size_t readers = 1; readers <= maxReaders; readers *= 2){
+        Tree tree;
+        vector<uint64_t> prefill = benchShuffledKeys(keys, 1);
+        for(size_t i = 0; i < prefill.size(); i++){
+            tree.insert(make_pair(prefill[i] * 4, prefill[i]));
+        }
+
+        atomic<bool> stop(false);
+        vector<uint64_t> ops(readers + 1);
+        vector<thread> threads;
+        uint64_t start = benchNowNs();
+        threads.push_back(thread(writer<Tree>, ref(tree), keys, ref(stop), ref(ops[0])));
+        for(size_t r = 0; r < readers; r++){
+            threads.push_back(thread(reader<Tree>, ref(tree), keys, r + 2, ref(stop), ref(ops[r + 1])));
+        }
+        this_thread::sleep_for(chrono::milliseconds(ms));
+        stop.store(true);
+        for(size_t t = 0; t < threads.size(); t++){
+            threads[t].join();
+        }
+        double seconds = (benchNowNs() - start) / 1e9;
+        uint64_t reads = 0;
+        for(size_t r = 1; r <= readers; r++){
+            reads += ops[r];
+        }
+        cout << setw(10) << reads / seconds / 1e6 << setw(9) << ops[0] / seconds / 1e3;
+    }
+    cout << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t maxReaders = benchArg(argc, argv, 1, 16);
+    size_t keys = benchArg(argc, argv, 2, 1000000);
+    size_t ms = benchArg(argc, argv, 3, 1000);
+
+    cout << "reader Mops/s / writer Kops/s, " << keys << " keys, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << left << setw(12) << "readers" << right;
+    for(size_t readers = 1; readers <= maxReaders; readers *= 2){
+        cout << setw(10) << readers << setw(9) << "write";
+    }
+    cout << endl;
+    run<MutexTree>("mutex", maxReaders, keys, ms);
+    run<ReadMostlyAVLTree<uint64_t, uint64_t> >("readmostly", maxReaders, keys, ms);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: remove-bench [keys]
+//
+// Fills each tree with the keys in random order and times removing all of
+// them in a different random order. Also reports cache misses and L1 data
+// cache read misses per remove when hardware counters are available.
+
+template<typename Tree>
+static void run(const string& name, const vector<uint64_t>& keys, const vector<uint64_t>& removeOrder)
+{
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    BenchPerfCounter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    BenchPerfCounter l1Misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    cacheMisses.start();
+    l1Misses.start();
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < removeOrder.size(); i++){
+        tree.remove(removeOrder[i]);
+    }
+    uint64_t ns = benchNowNs() - start;
+    uint64_t misses = cacheMisses.stop();
+    uint64_t l1 = l1Misses.stop();
+
+    double n = static_cast<double>(removeOrder.size());
+    cout << left << setw(8) << name << right << fixed << setprecision(1)
+         << setw(12) << ns / n
+         << setw(14) << setprecision(0) << n * 1e9 / ns;
+    if(cacheMisses.available()){
+        cout << setw(14) << setprecision(2) << misses / n << setw(14) << l1 / n;
+    } else {
+        cout << setw(14) << "n/a" << setw(14) << "n/a";
+    }
+    cout << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    vector<uint64_t> keys = benchShuffledKeys(n, 21);
+    vector<uint64_t> removeOrder = benchShuffledKeys(n, 22);
+
+    cout << left << setw(8) << "tree" << right << setw(12) << "ns/remove" << setw(14) << "removes/s"
+         << setw(14) << "miss/remove" << setw(14) << "L1d/remove" << endl;
+    run<BinarySearchTree<uint64_t, uint64_t> >("bst", keys, removeOrder);
+    run<AVLTree<uint64_t, uint64_t> >("avl", keys, removeOrder);
+    run<RedBlackTree<uint64_t, uint64_t> >("rb", keys, removeOrder);
+    return 0;
+}
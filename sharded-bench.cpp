@@ -0,0 +1,108 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "sharded-map.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: sharded-bench [max threads] [keys] [ops per thread]
+//
+// Scaling of ShardedAVLMap from 1 to max threads (default 64) in powers of
+// two, on a 90% find / 5% insert / 5% remove mix over uniform keys in
+// [0, 2 * keys) with keys (default 1M) prefilled. Compares:
+//   locked  one shard, i.e. a single AVLTree behind one lock
+//   hash    64 hash shards
+//   range   range shards, starting from 8 equal key ranges and splitting
+//           hot shards up to 64
+// Prints total Mops/s per thread count and the final number of shards.
+
+static const size_t kSplits = 8;
+
+template<typename Map>
+static void worker(Map& map, size_t ops, uint64_t seed, uint64_t keySpace, atomic<bool>& go)
+{
+    BenchRng rng(seed);
+    uint64_t found = 0;
+    uint64_t value;
+    while(!go.load(memory_order_acquire)){
+        this_thread::yield();
+    }
+    for(size_t i = 0; i < ops; i++){
+        uint64_t key = rng.below(keySpace);
+        uint64_t kind = rng.below(100);
+        if(kind < 90){
+            found += map.find(key, value);
+        } else if(kind < 95){
+            map.insert(make_pair(key, key));
+        } else {
+            map.remove(key);
+        }
+    }
+    benchKeep(found);
+}
+
+static ShardedAVLMap<uint64_t, uint64_t>* makeMap(const string& kind, size_t keys)
+{
+    if(kind == "locked"){
+        return new ShardedAVLMap<uint64_t, uint64_t>(SHARD_HASH, 1);
+    } else if(kind == "hash"){
+        return new ShardedAVLMap<uint64_t, uint64_t>(SHARD_HASH, 64);
+    }
+    vector<uint64_t> splitKeys;
+    for(size_t i = 1; i < kSplits; i++){
+        splitKeys.push_back(2 * keys * i / kSplits);
+    }
+    return new ShardedAVLMap<uint64_t, uint64_t>(splitKeys, 64);
+}
+
+static void run(const string& kind, size_t maxThreads, size_t keys, size_t ops)
+{
+    cout << left << setw(8) << kind << right << fixed << setprecision(2);
+    size_t shards = 0;
+    for(size_t threads = 1; threads <= maxThreads; threads *= 2){
+        ShardedAVLMap<uint64_t, uint64_t>* map = makeMap(kind, keys);
+        vector<uint64_t> prefill = benchShuffledKeys(keys, 1);
+        for(size_t i = 0; i < prefill.size(); i++){
+            map->insert(make_pair(prefill[i] * 2, prefill[i]));
+        }
+
+        atomic<bool> go(false);
+        vector<thread> workers;
+        for(size_t t = 0; t < threads; t++){
+            workers.push_back(thread(worker<ShardedAVLMap<uint64_t, uint64_t> >, ref(*map), ops, t + 2, 2 * keys, ref(go)));
+        }
+        uint64_t start = benchNowNs();
+        go.store(true, memory_order_release);
+        for(size_t t = 0; t < threads; t++){
+            workers[t].join();
+        }
+        double seconds = (benchNowNs() - start) / 1e9;
+        cout << setw(9) << threads * ops / seconds / 1e6;
+        shards = map->shardCount();
+        delete map;
+    }
+    cout << setw(9) << shards << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t maxThreads = benchArg(argc, argv, 1, 64);
+    size_t keys = benchArg(argc, argv, 2, 1000000);
+    size_t ops = benchArg(argc, argv, 3, 200000);
+
+    cout << "Mops/s, " << keys << " keys, " << ops << " ops per thread, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << left << setw(8) << "threads" << right;
+    for(size_t threads = 1; threads <= maxThreads; threads *= 2){
+        cout << setw(9) << threads;
+    }
+    cout << setw(9) << "shards" << endl;
+    run("locked", maxThreads, keys, ops);
+    run("hash", maxThreads, keys, ops);
+    run("range", maxThreads, keys, ops);
+    return 0;
+}
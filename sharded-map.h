@@ -0,0 +1,538 @@
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include "avlbst.h"
+
+/**
+* An ordered map split over several AVLTree shards, each behind its own
+* lock, so threads working on different shards do not contend.
+*
+* SHARD_HASH spreads keys over a fixed number of shards by hash; use it
+* for point lookups and updates. SHARD_RANGE gives each shard a contiguous
+* key range. It starts from the given split keys (or one shard) and splits
+* a shard at its median key when it gets hot, i.e. when more than
+* 1/HOT_CONTENDED of the lock acquisitions in its last HOT_WINDOW
+* operations had to wait, up to maxShards shards. The halves are built
+* without holding the shard's lock (see split), so a split does not stall
+* the shard's traffic for the O(n) copy.
+*
+* Key needs operator< and std::hash, and Value a default constructor.
+* insert, remove, find, contains and splitShardOf are thread-safe. Iteration (begin/end) k-way merges the shards'
+* iterators into one key-ordered sequence, and like the trees themselves
+* must not run concurrently with writers.
+*/
+
+enum ShardMode { SHARD_RANGE, SHARD_HASH };
+
+template <typename Key, typename Value>
+class ShardedAVLMap
+{
+public:
+    static const size_t HOT_WINDOW = 1 << 14;
+    static const size_t HOT_CONTENDED = 8;
+    static const size_t MIN_SPLIT_SIZE = 64;
+
+    explicit ShardedAVLMap(ShardMode mode = SHARD_RANGE, size_t shards = 64);
+    explicit ShardedAVLMap(const std::vector<Key>& splitKeys, size_t maxShards = 64);
+    ~ShardedAVLMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t shardCount() const;
+    bool splitShardOf(const Key& key);
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ShardedAVLMap<Key, Value>;
+        typedef typename AVLTree<Key, Value>::iterator TreeIterator;
+        typedef std::pair<TreeIterator, TreeIterator> Cursor;
+
+        static bool laterCursor(const Cursor& a, const Cursor& b);
+
+        // min-heap of (current, end) per non-exhausted shard
+        std::vector<Cursor> heap_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    // An update made while its shard's tree was frozen for a split
+    struct Change {
+        Value value;
+        bool removed;
+
+        // for the tree's print()
+        friend std::ostream& operator<<(std::ostream& out, const Change& change)
+        {
+            return change.removed ? out << "(removed)" : out << change.value;
+        }
+    };
+
+    struct Shard {
+        Shard() : ops(0), contended(0), frozen(false), retired(false) {}
+
+        std::mutex lock;
+        AVLTree<Key, Value> tree;
+        // while frozen, tree is read-only and updates go to changes, which
+        // lookups check first
+        AVLTree<Key, Change> changes;
+        size_t ops;
+        size_t contended;
+        bool frozen;
+        bool retired;
+        char pad[64];  // keep neighbouring shards' locks off each other's cache line
+    };
+
+    // shards[i] holds keys in [bounds[i-1], bounds[i]) in range mode
+    struct Table {
+        std::vector<Key> bounds;
+        std::vector<Shard*> shards;
+    };
+
+    ShardedAVLMap(const ShardedAVLMap&);
+    ShardedAVLMap& operator=(const ShardedAVLMap&);
+
+    Shard* newShard() const;
+    Shard* lockShard(const Key& key) const;
+    void unlockShard(Shard* shard) const;
+    bool split(Shard* shard) const;
+    static void put(Shard* shard, const std::pair<const Key, Value>& keyValuePair);
+    static void erase(Shard* shard, const Key& key);
+    static bool lookup(Shard* shard, const Key& key, Value* value);
+    static void applyChanges(const AVLTree<Key, Change>& changes, AVLTree<Key, Value>& tree);
+
+    ShardMode mode_;
+    size_t maxShards_;
+    mutable std::atomic<Table*> table_;
+    // tables and shards replaced by a split stay allocated until destruction,
+    // so a thread that loaded an old table never touches freed memory
+    mutable std::vector<Table*> tables_;
+    mutable std::vector<Shard*> allShards_;
+    mutable std::mutex splitLock_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ShardedAVLMap class.
+  ---------------------------------------------
+*/
+
+/**
+* In hash mode, a map with a fixed number of shards. In range mode, a map
+* that starts with one shard and splits up to shards.
+*/
+template<typename Key, typename Value>
+ShardedAVLMap<Key, Value>::ShardedAVLMap(ShardMode mode, size_t shards) :
+    mode_(mode),
+    maxShards_(std::max<size_t>(1, shards)),
+    table_(nullptr)
+{
+    Table* table = new Table();
+    size_t initial = mode_ == SHARD_HASH ? maxShards_ : 1;
+    for(size_t i = 0; i < initial; i++){
+        table->shards.push_back(newShard());
+    }
+    tables_.push_back(table);
+    table_.store(table);
+}
+
+/**
+* A range mode map with one shard per interval between the (sorted, distinct)
+* splitKeys.
+*/
+template<typename Key, typename Value>
+ShardedAVLMap<Key, Value>::ShardedAVLMap(const std::vector<Key>& splitKeys, size_t maxShards) :
+    mode_(SHARD_RANGE),
+    maxShards_(std::max(maxShards, splitKeys.size() + 1)),
+    table_(nullptr)
+{
+    Table* table = new Table();
+    table->bounds = splitKeys;
+    for(size_t i = 0; i <= splitKeys.size(); i++){
+        table->shards.push_back(newShard());
+    }
+    tables_.push_back(table);
+    table_.store(table);
+}
+
+template<typename Key, typename Value>
+ShardedAVLMap<Key, Value>::~ShardedAVLMap()
+{
+    for(size_t i = 0; i < allShards_.size(); i++){
+        delete allShards_[i];
+    }
+    for(size_t i = 0; i < tables_.size(); i++){
+        delete tables_[i];
+    }
+}
+
+template<typename Key, typename Value>
+typename ShardedAVLMap<Key, Value>::Shard* ShardedAVLMap<Key, Value>::newShard() const
+{
+    Shard* shard = new Shard();
+    allShards_.push_back(shard);
+    return shard;
+}
+
+/**
+* Finds and locks the shard that owns key, retrying if the shard was split
+* while we waited for it.
+*/
+template<typename Key, typename Value>
+typename ShardedAVLMap<Key, Value>::Shard* ShardedAVLMap<Key, Value>::lockShard(const Key& key) const
+{
+    while(true){
+        Table* table = table_.load(std::memory_order_acquire);
+        size_t index;
+        if(mode_ == SHARD_HASH){
+            uint64_t hash = static_cast<uint64_t>(std::hash<Key>()(key)) * 0x9E3779B97F4A7C15ULL;
+            index = static_cast<size_t>((hash >> 32) % table->shards.size());
+        } else {
+            index = std::upper_bound(table->bounds.begin(), table->bounds.end(), key) - table->bounds.begin();
+        }
+        Shard* shard = table->shards[index];
+        if(!shard->lock.try_lock()){
+            shard->lock.lock();
+            shard->contended++;
+        }
+        if(!shard->retired){
+            return shard;
+        }
+        shard->lock.unlock();
+    }
+}
+
+/**
+* Unlocks shard, then splits it if it has been hot over the last
+* HOT_WINDOW operations.
+*/
+template<typename Key, typename Value>
+void ShardedAVLMap<Key, Value>::unlockShard(Shard* shard) const
+{
+    bool hot = false;
+    if(++shard->ops >= HOT_WINDOW){
+        hot = mode_ == SHARD_RANGE && !shard->frozen && shard->contended * HOT_CONTENDED > shard->ops;
+        shard->ops = 0;
+        shard->contended = 0;
+    }
+    shard->lock.unlock();
+    if(hot){
+        split(shard);
+    }
+}
+
+/**
+* Replaces shard with two shards split at its median key and publishes a
+* new table. Returns false, leaving the shard alone, if another split is
+* running, the map has maxShards_ shards or the shard has fewer than
+* MIN_SPLIT_SIZE items. Only two short steps hold the shard's lock: freezing its
+* tree, after which updates go to its changes instead, and at the end
+* applying those changes to the halves and retiring the shard, so that
+* threads waiting on its lock retry against the new table. The halves are
+* built from the frozen tree in between, with the lock free. O(n) time,
+* O(changes) of it under the lock.
+*/
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::split(Shard* shard) const
+{
+    std::unique_lock<std::mutex> guard(splitLock_, std::try_to_lock);
+    if(!guard.owns_lock() || table_.load(std::memory_order_relaxed)->shards.size() >= maxShards_){
+        return false;
+    }
+    shard->lock.lock();
+    if(shard->retired || shard->frozen){
+        shard->lock.unlock();
+        return false;
+    }
+    shard->frozen = true;
+    shard->lock.unlock();
+
+    std::vector<std::pair<Key, Value> > items;
+    for(typename AVLTree<Key, Value>::iterator it = shard->tree.begin(); it != shard->tree.end(); ++it){
+        items.push_back(std::make_pair(it->first, it->second));
+    }
+    if(items.size() < MIN_SPLIT_SIZE){
+        shard->lock.lock();
+        applyChanges(shard->changes, shard->tree);
+        shard->changes.clear();
+        shard->frozen = false;
+        shard->lock.unlock();
+        return false;
+    }
+    size_t mid = items.size() / 2;
+    const Key bound = items[mid].first;
+    Shard* low = newShard();
+    Shard* high = newShard();
+    low->tree.buildFromSorted(std::vector<std::pair<Key, Value> >(items.begin(), items.begin() + mid));
+    high->tree.buildFromSorted(std::vector<std::pair<Key, Value> >(items.begin() + mid, items.end()));
+
+    shard->lock.lock();
+    for(typename AVLTree<Key, Change>::iterator it = shard->changes.begin(); it != shard->changes.end(); ++it){
+        AVLTree<Key, Value>& half = it->first < bound ? low->tree : high->tree;
+        if(it->second.removed){
+            half.remove(it->first);
+        } else {
+            half.insert(std::make_pair(it->first, it->second.value));
+        }
+    }
+    Table* next = new Table(*table_.load(std::memory_order_relaxed));
+    size_t index = std::find(next->shards.begin(), next->shards.end(), shard) - next->shards.begin();
+    next->shards[index] = low;
+    next->shards.insert(next->shards.begin() + index + 1, high);
+    next->bounds.insert(next->bounds.begin() + index, bound);
+    tables_.push_back(next);
+    table_.store(next, std::memory_order_release);
+    shard->retired = true;
+    shard->lock.unlock();
+
+    // nobody reads a retired shard's trees
+    shard->tree.clear();
+    shard->changes.clear();
+    return true;
+}
+
+/**
+* Replays changes, in key order, on tree.
+*/
+template<typename Key, typename Value>
+void ShardedAVLMap<Key, Value>::applyChanges(const AVLTree<Key, Change>& changes, AVLTree<Key, Value>& tree)
+{
+    for(typename AVLTree<Key, Change>::iterator it = changes.begin(); it != changes.end(); ++it){
+        if(it->second.removed){
+            tree.remove(it->first);
+        } else {
+            tree.insert(std::make_pair(it->first, it->second.value));
+        }
+    }
+}
+
+/**
+* The updates and lookups on a locked shard, which go through its changes
+* while its tree is frozen.
+*/
+template<typename Key, typename Value>
+void ShardedAVLMap<Key, Value>::put(Shard* shard, const std::pair<const Key, Value>& keyValuePair)
+{
+    if(shard->frozen){
+        Change change = { keyValuePair.second, false };
+        shard->changes.insert(std::make_pair(keyValuePair.first, change));
+    } else {
+        shard->tree.insert(keyValuePair);
+    }
+}
+
+template<typename Key, typename Value>
+void ShardedAVLMap<Key, Value>::erase(Shard* shard, const Key& key)
+{
+    if(shard->frozen){
+        Change change = { Value(), true };
+        shard->changes.insert(std::make_pair(key, change));
+    } else {
+        shard->tree.remove(key);
+    }
+}
+
+/**
+* Whether key is in the locked shard; if so and value is not NULL, copies
+* its value there.
+*/
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::lookup(Shard* shard, const Key& key, Value* value)
+{
+    if(shard->frozen){
+        typename AVLTree<Key, Change>::iterator change = shard->changes.find(key);
+        if(change != shard->changes.end()){
+            if(!change->second.removed && value != nullptr){
+                *value = change->second.value;
+            }
+            return !change->second.removed;
+        }
+    }
+    typename AVLTree<Key, Value>::iterator it = shard->tree.find(key);
+    if(it == shard->tree.end()){
+        return false;
+    }
+    if(value != nullptr){
+        *value = it->second;
+    }
+    return true;
+}
+
+template<typename Key, typename Value>
+void ShardedAVLMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Shard* shard = lockShard(keyValuePair.first);
+    put(shard, keyValuePair);
+    unlockShard(shard);
+}
+
+template<typename Key, typename Value>
+void ShardedAVLMap<Key, Value>::remove(const Key& key)
+{
+    Shard* shard = lockShard(key);
+    erase(shard, key);
+    unlockShard(shard);
+}
+
+/**
+* Copies the value for key into value. Returns false (leaving value
+* alone) if key is not in the map.
+*/
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::find(const Key& key, Value& value) const
+{
+    Shard* shard = lockShard(key);
+    bool found = lookup(shard, key, &value);
+    unlockShard(shard);
+    return found;
+}
+
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::contains(const Key& key) const
+{
+    Shard* shard = lockShard(key);
+    bool found = lookup(shard, key, nullptr);
+    unlockShard(shard);
+    return found;
+}
+
+template<typename Key, typename Value>
+size_t ShardedAVLMap<Key, Value>::shardCount() const
+{
+    return table_.load(std::memory_order_acquire)->shards.size();
+}
+
+/**
+* Splits the shard that owns key now, as if it had got hot (range mode
+* only). Returns whether it was split; see split for when it is not.
+*/
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::splitShardOf(const Key& key)
+{
+    if(mode_ != SHARD_RANGE){
+        return false;
+    }
+    Shard* shard = lockShard(key);
+    shard->lock.unlock();
+    return split(shard);
+}
+
+template<typename Key, typename Value>
+typename ShardedAVLMap<Key, Value>::iterator ShardedAVLMap<Key, Value>::begin() const
+{
+    iterator it;
+    Table* table = table_.load(std::memory_order_acquire);
+    for(size_t i = 0; i < table->shards.size(); i++){
+        const AVLTree<Key, Value>& tree = table->shards[i]->tree;
+        if(tree.begin() != tree.end()){
+            it.heap_.push_back(std::make_pair(tree.begin(), tree.end()));
+        }
+    }
+    std::make_heap(it.heap_.begin(), it.heap_.end(), iterator::laterCursor);
+    return it;
+}
+
+template<typename Key, typename Value>
+typename ShardedAVLMap<Key, Value>::iterator ShardedAVLMap<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShardedAVLMap class.
+  ---------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the ShardedAVLMap::iterator class.
+  -----------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+ShardedAVLMap<Key, Value>::iterator::iterator()
+{
+
+}
+
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::iterator::laterCursor(const Cursor& a, const Cursor& b)
+{
+    return b.first->first < a.first->first;
+}
+
+template<typename Key, typename Value>
+const std::pair<const Key, Value>& ShardedAVLMap<Key, Value>::iterator::operator*() const
+{
+    return *heap_.front().first;
+}
+
+template<typename Key, typename Value>
+const std::pair<const Key, Value>* ShardedAVLMap<Key, Value>::iterator::operator->() const
+{
+    return &*heap_.front().first;
+}
+
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    if(heap_.empty() || rhs.heap_.empty()){
+        return heap_.empty() && rhs.heap_.empty();
+    }
+    return heap_.front().first == rhs.heap_.front().first;
+}
+
+template<typename Key, typename Value>
+bool ShardedAVLMap<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the shard holding the current item and restores the heap, so
+* each step costs O(log shards).
+*/
+template<typename Key, typename Value>
+typename ShardedAVLMap<Key, Value>::iterator& ShardedAVLMap<Key, Value>::iterator::operator++()
+{
+    std::pop_heap(heap_.begin(), heap_.end(), laterCursor);
+    Cursor& cursor = heap_.back();
+    ++cursor.first;
+    if(cursor.first == cursor.second){
+        heap_.pop_back();
+    } else {
+        std::push_heap(heap_.begin(), heap_.end(), laterCursor);
+    }
+    return *this;
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the ShardedAVLMap::iterator class.
+  -----------------------------------------------------
+*/
+
+#endif
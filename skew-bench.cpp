@@ -0,0 +1,74 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "avlbst.h"
+#include "splaybst.h"
+#include "treapbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: skew-bench [keys] [lookups]
+//
+// Builds each tree from the same shuffled keys, then times lookups whose
+// keys follow a Zipf distribution of increasing skew. Hot ranks are mapped
+// to random keys so they are not clustered in key order.
+
+template<typename Tree>
+static double timeLookups(Tree& tree, const vector<uint64_t>& probes)
+{
+    uint64_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < probes.size(); i++){
+        if(tree.find(probes[i]) != tree.end()){
+            found++;
+        }
+    }
+    uint64_t ns = benchNowNs() - start;
+    benchKeep(found);
+    return static_cast<double>(ns) / probes.size();
+}
+
+template<typename Tree>
+static double timeBuild(Tree& tree, const vector<uint64_t>& keys)
+{
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    return static_cast<double>(benchNowNs() - start) / keys.size();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t lookups = benchArg(argc, argv, 2, 2000000);
+    vector<uint64_t> keys = benchShuffledKeys(n, 1);
+    vector<uint64_t> rankToKey = benchShuffledKeys(n, 2);
+
+    AVLTree<uint64_t, uint64_t> avl;
+    SplayTree<uint64_t, uint64_t> splay;
+    Treap<uint64_t, uint64_t> treap;
+
+    cout << "insert ns/op (n=" << n << "): "
+         << fixed << setprecision(1)
+         << "avl " << timeBuild(avl, keys)
+         << "  splay " << timeBuild(splay, keys)
+         << "  treap " << timeBuild(treap, keys) << endl;
+
+    const double skews[] = { 0.0, 0.8, 0.99, 1.2 };
+    cout << setw(8) << "zipf-s" << setw(12) << "avl" << setw(12) << "splay" << setw(12) << "treap"
+         << "   (lookup ns/op)" << endl;
+    for(size_t s = 0; s < sizeof(skews) / sizeof(skews[0]); s++){
+        BenchZipf zipf(n, skews[s], 3 + s);
+        vector<uint64_t> probes(lookups);
+        for(size_t i = 0; i < lookups; i++){
+            probes[i] = rankToKey[zipf.next()];
+        }
+        cout << setw(8) << setprecision(2) << skews[s] << setprecision(1)
+             << setw(12) << timeLookups(avl, probes)
+             << setw(12) << timeLookups(splay, probes)
+             << setw(12) << timeLookups(treap, probes) << endl;
+    }
+    return 0;
+}
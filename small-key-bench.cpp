@@ -0,0 +1,72 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "avlbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: small-key-bench [keys] [lookups]
+//
+// Compares AVLTree<uint64_t, uint64_t>, which takes the small-key search
+// path (see BstSmallType in bst.h), with the same tree keyed by
+// GenericKey: a uint64_t with a user-provided copy constructor, so it is
+// not trivially copyable and takes the generic path. Same keys, same
+// nodes, only the search code differs.
+
+struct GenericKey {
+    uint64_t v;
+
+    GenericKey(uint64_t value) : v(value) {}
+    GenericKey(const GenericKey& other) : v(other.v) {}
+
+    bool operator==(const GenericKey& rhs) const { return v == rhs.v; }
+    bool operator<(const GenericKey& rhs) const { return v < rhs.v; }
+    bool operator>(const GenericKey& rhs) const { return v > rhs.v; }
+};
+
+// print() needs it
+static ostream& operator<<(ostream& out, const GenericKey& key)
+{
+    return out << key.v;
+}
+
+template<typename Key>
+static void run(const string& name, const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    AVLTree<Key, uint64_t> tree;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(make_pair(Key(keys[i]), keys[i]));
+    }
+    double insertNs = static_cast<double>(benchNowNs() - start) / keys.size();
+
+    uint64_t found = 0;
+    start = benchNowNs();
+    for(size_t i = 0; i < probes.size(); i++){
+        found += tree.find(Key(probes[i])) != tree.end();
+    }
+    double findNs = static_cast<double>(benchNowNs() - start) / probes.size();
+    benchKeep(found);
+
+    cout << left << setw(12) << name << right << fixed << setprecision(1)
+         << setw(12) << insertNs << setw(12) << findNs << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = benchArg(argc, argv, 1, 1000000);
+    size_t lookups = benchArg(argc, argv, 2, 2000000);
+    vector<uint64_t> keys = benchShuffledKeys(n, 1);
+    vector<uint64_t> probes(lookups);
+    BenchRng rng(2);
+    for(size_t i = 0; i < lookups; i++){
+        // half hits, half misses
+        probes[i] = rng.below(2 * n);
+    }
+
+    cout << left << setw(12) << "ns/op" << right << setw(12) << "insert" << setw(12) << "find" << endl;
+    run<uint64_t>("small", keys, probes);
+    run<GenericKey>("generic", keys, probes);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include "bst.h"
+
+/**
+* A self-adjusting (splay) tree. Every access moves the accessed node to the
+* root with zig / zig-zig / zig-zag rotations, so frequently used keys stay
+* near the top and all operations run in amortized O(log n).
+*
+* find() and operator[] splay, so unlike in BinarySearchTree they are not
+* const. The const versions inherited from BinarySearchTree are still
+* available on a const tree and leave the shape unchanged.
+*/
+template <class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value>
+{
+public:
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key &key);
+
+    using BinarySearchTree<Key, Value>::find;
+    using BinarySearchTree<Key, Value>::operator[];
+    typename BinarySearchTree<Key, Value>::iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+protected:
+    virtual Node<Key, Value>* insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item);
+    virtual void eraseNode(Node<Key, Value>* node);
+    void splay(Node<Key, Value> *current);
+    Node<Key, Value> *access(const Key& key);
+};
+
+/**
+* Descends to key and splays the last node visited, so misses also
+* restructure the tree. Returns the node holding key, or NULL.
+*/
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::access(const Key& key)
+{
+    Node<Key, Value>* curr = this->root_;
+    Node<Key, Value>* last = nullptr;
+    while(curr != nullptr){
+        last = curr;
+        if(key < curr->getKey()){
+            curr = curr->getLeft();
+        } else if(curr->getKey() < key){
+            curr = curr->getRight();
+        } else {
+            break;
+        }
+    }
+    if(last != nullptr){
+        splay(last);
+    }
+    return curr;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator SplayTree<Key, Value>::find(const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    Node<Key, Value>* found = access(key);
+    if(found == nullptr){
+        return this->end();
+    }
+    // found is now the root, so this lookup stops right away
+    return BinarySearchTree<Key, Value>::find(key);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& SplayTree<Key, Value>::operator[](const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    Node<Key, Value>* found = access(key);
+    if(found == nullptr) throw std::out_of_range("Invalid key");
+    return found->getValue();
+}
+
+/*
+ * If key is already in the tree, the value is overwritten. Either way
+ * the node holding key ends up at the root.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    if(this->root_ == nullptr){
+        this->setRoot(new Node<Key, Value>(new_item.first, new_item.second, nullptr));
+        return;
+    }
+
+    Node<Key, Value>* curr = this->root_;
+    while(true){
+        if(new_item.first < curr->getKey()){
+            if(curr->getLeft() == nullptr){
+                Node<Key, Value>* new_node = new Node<Key, Value>(new_item.first, new_item.second, curr);
+                curr->setLeft(new_node);
+                curr = new_node;
+                break;
+            }
+            curr = curr->getLeft();
+        } else if(curr->getKey() < new_item.first){
+            if(curr->getRight() == nullptr){
+                Node<Key, Value>* new_node = new Node<Key, Value>(new_item.first, new_item.second, curr);
+                curr->setRight(new_node);
+                curr = new_node;
+                break;
+            }
+            curr = curr->getRight();
+        } else {
+            curr->setValue(new_item.second);
+            break;
+        }
+    }
+    splay(curr);
+    BST_CHECK_PATH(this, curr);
+}
+
+/*
+ * Splays the node to the root, then removes it the usual way (swapping with
+ * the predecessor, which joins the two subtrees under it).
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::remove(const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    Node<Key, Value>* remove_node = access(key);
+    if(remove_node == nullptr){
+        return;
+    }
+    this->removeNode(remove_node);
+}
+
+/**
+* insertNear and removeAt splay the node they touch, like insert and
+* remove. (findNear does not: it is const.)
+*/
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item)
+{
+    Node<Key, Value>* node = BinarySearchTree<Key, Value>::insertBelow(at, new_item);
+    splay(node);
+    BST_CHECK_PATH(this, node);
+    return node;
+}
+
+template<class Key, class Value>
+void SplayTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    splay(node);
+    this->removeNode(node);
+}
+
+template<class Key, class Value>
+void SplayTree<Key, Value>::splay(Node<Key, Value> *current)
+{
+    while(current->getParent() != nullptr){
+        Node<Key, Value>* parent = current->getParent();
+        Node<Key, Value>* grand_parent = parent->getParent();
+        bool is_left = parent->getLeft() == current;
+
+        if(grand_parent == nullptr){
+            // zig
+            if(is_left) this->rotate_right(parent);
+            else this->rotate_left(parent);
+        } else if(is_left == (grand_parent->getLeft() == parent)){
+            // zig zig
+            if(is_left){
+                this->rotate_right(grand_parent);
+                this->rotate_right(parent);
+            } else {
+                this->rotate_left(grand_parent);
+                this->rotate_left(parent);
+            }
+        } else {
+            // zig zag
+            if(is_left){
+                this->rotate_right(parent);
+                this->rotate_left(grand_parent);
+            } else {
+                this->rotate_left(parent);
+                this->rotate_right(grand_parent);
+            }
+        }
+    }
+}
+
+#endif
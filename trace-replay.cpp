@@ -0,0 +1,248 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include "bst.h"
+#include "avlbst.h"
+#include "avltopdown.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "treapbst.h"
+#include "trace.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: trace-replay <trace> [backend] [threads] [timed]
+//        trace-replay record <trace> [ops] [keys]
+//
+// Replays a trace (see trace.h) against one backend: bst, avl (default),
+// avl-td, rb, splay, treap or map (std::map). Inserted values are strings
+// of the recorded value size. Prints throughput and latency percentiles
+// per operation type.
+//
+// The trees are not thread-safe, so with N threads the trace is split by
+// key hash into N independent trees, one per thread, like a sharded
+// deployment; a scan only covers the shard of its start key.
+//
+// By default records are issued back to back. With "timed" each one is
+// issued at its recorded time; latency is then measured from that time
+// rather than from when the record was actually issued, so a backend that
+// falls behind is charged for the delay (no coordinated omission).
+//
+// "record" writes a synthetic trace through RecordingTree: ops operations
+// (default 1M; 50% find, 25% insert, 10% remove, 15% scan) on Zipf(0.99)
+// distributed keys out of keys (default 100K), with 16..1024 byte values.
+
+static const char* kOpNames[] = { "insert", "remove", "find", "scan" };
+
+template<typename Tree>
+static void replayInsert(Tree& tree, uint64_t key, const string& value)
+{
+    tree.insert(make_pair(key, value));
+}
+
+static void replayInsert(map<uint64_t, string>& tree, uint64_t key, const string& value)
+{
+    tree[key] = value;
+}
+
+template<typename Tree>
+static void replayRemove(Tree& tree, uint64_t key)
+{
+    tree.remove(key);
+}
+
+static void replayRemove(map<uint64_t, string>& tree, uint64_t key)
+{
+    tree.erase(key);
+}
+
+template<typename Tree>
+static typename Tree::iterator replayLowerBound(Tree& tree, uint64_t key)
+{
+    return tree.lowerBound(key);
+}
+
+static map<uint64_t, string>::iterator replayLowerBound(map<uint64_t, string>& tree, uint64_t key)
+{
+    return tree.lower_bound(key);
+}
+
+static unsigned int shardOf(uint64_t key, unsigned int threads)
+{
+    return static_cast<unsigned int>(((key * 0x9E3779B97F4A7C15ULL) >> 32) % threads);
+}
+
+struct ReplayThread {
+    vector<uint32_t> latencies[4];
+    uint64_t scanned;
+};
+
+template<typename Tree>
+static void replayShard(const vector<TraceRecord>& records, unsigned int shard, unsigned int threads,
+                        bool timed, uint64_t start, ReplayThread& out)
+{
+    Tree tree;
+    string filler;
+    uint64_t found = 0;
+    out.scanned = 0;
+    for(size_t i = 0; i < records.size(); i++){
+        const TraceRecord& record = records[i];
+        if(threads > 1 && shardOf(record.key, threads) != shard) continue;
+
+        uint64_t issued;
+        if(timed){
+            issued = start + record.time;
+            uint64_t now = benchNowNs();
+            if(issued > now + 100000){
+                this_thread::sleep_for(chrono::nanoseconds(issued - now - 50000));
+            }
+            while(benchNowNs() < issued){
+                this_thread::yield();
+            }
+        } else {
+            issued = benchNowNs();
+        }
+
+        switch(record.op){
+        case TRACE_INSERT:
+            if(filler.size() < record.arg) filler.resize(record.arg, 'v');
+            replayInsert(tree, record.key, string(filler.data(), record.arg));
+            break;
+        case TRACE_REMOVE:
+            replayRemove(tree, record.key);
+            break;
+        case TRACE_FIND:
+            found += tree.find(record.key) != tree.end();
+            break;
+        case TRACE_SCAN: {
+            uint32_t visited = 0;
+            for(typename Tree::iterator it = replayLowerBound(tree, record.key); it != tree.end() && visited < record.arg; ++it){
+                found += it->second.size();
+                visited++;
+            }
+            out.scanned += visited;
+            break;
+        }
+        default:
+            continue;
+        }
+        uint64_t latency = benchNowNs() - issued;
+        out.latencies[record.op].push_back(static_cast<uint32_t>(min<uint64_t>(latency, UINT32_MAX)));
+    }
+    benchKeep(found);
+}
+
+template<typename Tree>
+static void replay(const vector<TraceRecord>& records, unsigned int threads, bool timed)
+{
+    vector<ReplayThread> results(threads);
+    vector<thread> workers;
+    uint64_t start = benchNowNs();
+    for(unsigned int t = 1; t < threads; t++){
+        workers.push_back(thread(replayShard<Tree>, cref(records), t, threads, timed, start, ref(results[t])));
+    }
+    replayShard<Tree>(records, 0, threads, timed, start, results[0]);
+    for(size_t t = 0; t < workers.size(); t++){
+        workers[t].join();
+    }
+    double seconds = (benchNowNs() - start) / 1e9;
+
+    uint64_t scanned = 0;
+    for(unsigned int t = 0; t < threads; t++){
+        scanned += results[t].scanned;
+    }
+    cout << records.size() << " ops in " << fixed << setprecision(3) << seconds << " s: "
+         << setprecision(0) << records.size() / seconds << " ops/s, " << scanned << " items scanned" << endl;
+    cout << left << setw(8) << "op" << right << setw(12) << "count" << setw(10) << "p50"
+         << setw(10) << "p90" << setw(10) << "p99" << setw(10) << "p99.9" << setw(12) << "max" << "   (ns)" << endl;
+    for(int op = 0; op < 4; op++){
+        vector<uint32_t> all;
+        for(unsigned int t = 0; t < threads; t++){
+            all.insert(all.end(), results[t].latencies[op].begin(), results[t].latencies[op].end());
+        }
+        if(all.empty()) continue;
+        sort(all.begin(), all.end());
+        size_t n = all.size();
+        cout << left << setw(8) << kOpNames[op] << right << setw(12) << n
+             << setw(10) << all[n / 2] << setw(10) << all[n * 90 / 100]
+             << setw(10) << all[n * 99 / 100] << setw(10) << all[n * 999 / 1000]
+             << setw(12) << all[n - 1] << endl;
+    }
+}
+
+static void recordSynthetic(const string& path, size_t ops, size_t keys)
+{
+    TraceWriter writer(path);
+    RecordingTree<uint64_t, string> tree(writer);
+    BenchZipf zipf(keys, 0.99, 7);
+    vector<uint64_t> rankToKey = benchShuffledKeys(keys, 8);
+    BenchRng rng(9);
+    size_t visited = 0;
+    for(size_t i = 0; i < ops; i++){
+        uint64_t key = rankToKey[zipf.next()];
+        uint64_t kind = rng.below(100);
+        if(kind < 50){
+            tree.find(key);
+        } else if(kind < 75){
+            tree.insert(make_pair(key, string(16 + rng.below(1009), 'v')));
+        } else if(kind < 85){
+            tree.remove(key);
+        } else {
+            visited += tree.scan(key, 1 + rng.below(100), [](const pair<const uint64_t, string>&){});
+        }
+    }
+    writer.flush();
+    cout << "recorded " << ops << " ops (" << visited << " items scanned) to " << path << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2){
+        cerr << "usage: trace-replay <trace> [bst|avl|avl-td|rb|splay|treap|map] [threads] [timed]" << endl
+             << "       trace-replay record <trace> [ops] [keys]" << endl;
+        return 2;
+    }
+    try {
+        if(string(argv[1]) == "record"){
+            if(argc < 3){
+                cerr << "usage: trace-replay record <trace> [ops] [keys]" << endl;
+                return 2;
+            }
+            recordSynthetic(argv[2], benchArg(argc, argv, 3, 1000000), benchArg(argc, argv, 4, 100000));
+            return 0;
+        }
+
+        vector<TraceRecord> records = readTrace(argv[1]);
+        string backend = argc > 2 ? argv[2] : "avl";
+        unsigned int threads = static_cast<unsigned int>(max<size_t>(1, benchArg(argc, argv, 3, 1)));
+        bool timed = argc > 4 && string(argv[4]) == "timed";
+
+        if(backend == "bst"){
+            replay<BinarySearchTree<uint64_t, string> >(records, threads, timed);
+        } else if(backend == "avl"){
+            replay<AVLTree<uint64_t, string> >(records, threads, timed);
+        } else if(backend == "avl-td"){
+            replay<TopDownAVLTree<uint64_t, string> >(records, threads, timed);
+        } else if(backend == "rb"){
+            replay<RedBlackTree<uint64_t, string> >(records, threads, timed);
+        } else if(backend == "splay"){
+            replay<SplayTree<uint64_t, string> >(records, threads, timed);
+        } else if(backend == "treap"){
+            replay<Treap<uint64_t, string> >(records, threads, timed);
+        } else if(backend == "map"){
+            replay<map<uint64_t, string> >(records, threads, timed);
+        } else {
+            cerr << "trace-replay: unknown backend " << backend << endl;
+            return 2;
+        }
+    } catch(const exception& e) {
+        cerr << "trace-replay: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "avlbst.h"
+
+/**
+* Operation traces for replaying real workloads (see trace-replay.cpp).
+*
+* A trace file is an 8 byte magic ("TRTRACE1") followed by fixed size
+* 24 byte records in host byte order:
+*   time   uint64  ns since the recording started
+*   key    uint64
+*   arg    uint32  insert: value size in bytes, scan: number of items
+*   op     uint8   TRACE_INSERT, TRACE_REMOVE, TRACE_FIND or TRACE_SCAN
+*   (3 bytes padding)
+* Fixed size records can be read with a single fread and indexed directly.
+*/
+
+enum TraceOp { TRACE_INSERT = 0, TRACE_REMOVE = 1, TRACE_FIND = 2, TRACE_SCAN = 3 };
+
+struct TraceRecord {
+    uint64_t time;
+    uint64_t key;
+    uint32_t arg;
+    uint8_t op;
+    uint8_t pad[3];
+};
+
+static const char TRACE_MAGIC[8] = { 'T', 'R', 'T', 'R', 'A', 'C', 'E', '1' };
+
+/**
+* Appends records to a trace file. Thread-safe; records are buffered by
+* stdio and flushed by flush() or the destructor.
+*/
+class TraceWriter
+{
+public:
+    explicit TraceWriter(const std::string& path) :
+        file_(std::fopen(path.c_str(), "wb")),
+        start_(std::chrono::steady_clock::now())
+    {
+        if(file_ == nullptr){
+            throw std::runtime_error("Unable to create trace " + path);
+        }
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 16);
+        if(std::fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, file_) != 1){
+            std::fclose(file_);
+            throw std::runtime_error("Unable to write trace " + path);
+        }
+    }
+
+    ~TraceWriter()
+    {
+        std::fclose(file_);
+    }
+
+    void append(TraceOp op, uint64_t key, uint32_t arg)
+    {
+        TraceRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        record.key = key;
+        record.arg = arg;
+        record.op = static_cast<uint8_t>(op);
+        std::lock_guard<std::mutex> guard(lock_);
+        if(std::fwrite(&record, sizeof(record), 1, file_) != 1){
+            throw std::runtime_error("Unable to write trace record");
+        }
+    }
+
+    void flush()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::fflush(file_);
+    }
+
+private:
+    TraceWriter(const TraceWriter&);
+    TraceWriter& operator=(const TraceWriter&);
+
+    std::FILE* file_;
+    std::chrono::steady_clock::time_point start_;
+    std::mutex lock_;
+};
+
+/**
+* Reads a whole trace. A partial record at the end (a recorder that was
+* killed mid-write) is dropped.
+*/
+inline std::vector<TraceRecord> readTrace(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if(file == nullptr){
+        throw std::runtime_error("Unable to open trace " + path);
+    }
+    char magic[sizeof(TRACE_MAGIC)];
+    if(std::fread(magic, sizeof(magic), 1, file) != 1 || std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0){
+        std::fclose(file);
+        throw std::runtime_error("Not a trace file: " + path);
+    }
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, sizeof(TRACE_MAGIC), SEEK_SET);
+    std::vector<TraceRecord> records((size - sizeof(TRACE_MAGIC)) / sizeof(TraceRecord));
+    size_t got = records.empty() ? 0 : std::fread(&records[0], sizeof(TraceRecord), records.size(), file);
+    std::fclose(file);
+    records.resize(got);
+    return records;
+}
+
+/**
+* Bytes recorded as the value size of an insert: the object size, or the
+* contents for strings.
+*/
+template <typename Value>
+uint32_t traceValueSize(const Value&)
+{
+    return sizeof(Value);
+}
+
+inline uint32_t traceValueSize(const std::string& value)
+{
+    return static_cast<uint32_t>(value.size());
+}
+
+/**
+* A search tree that records every insert, remove, find and scan to a
+* TraceWriter (which may be shared by several trees) before doing it.
+* Keys are recorded as uint64_t, so Key must convert to it.
+*
+* Recorded: insert, remove, insertNear and removeAt as TRACE_INSERT and
+* TRACE_REMOVE; find, findNear and operator[] (which looks up through
+* find) as TRACE_FIND; scan as TRACE_SCAN. These are all virtual in
+* BinarySearchTree, so calls through a base class reference are recorded
+* too. Not recorded: lowerBound, begin and walking iterators, and lookups
+* by a Tree's own non-virtual methods (AVLMultiMap's operator[], say).
+*/
+template <typename Key, typename Value, typename Tree = AVLTree<Key, Value> >
+class RecordingTree : public Tree
+{
+public:
+    explicit RecordingTree(TraceWriter& writer);
+
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void remove(const Key& key);
+    virtual typename Tree::iterator insertNear(const typename Tree::iterator& hint, const std::pair<const Key, Value>& keyValuePair);
+    virtual typename Tree::iterator removeAt(const typename Tree::iterator& pos);
+    virtual typename Tree::iterator find(const Key& key) const;
+    virtual typename Tree::iterator findNear(const typename Tree::iterator& hint, const Key& key) const;
+
+    template <typename Visitor>
+    size_t scan(const Key& from, size_t count, Visitor visit) const;
+
+private:
+    TraceWriter& writer_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the RecordingTree class.
+  ---------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Tree>
+RecordingTree<Key, Value, Tree>::RecordingTree(TraceWriter& writer) :
+    Tree(),
+    writer_(writer)
+{
+
+}
+
+template<typename Key, typename Value, typename Tree>
+void RecordingTree<Key, Value, Tree>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    writer_.append(TRACE_INSERT, static_cast<uint64_t>(keyValuePair.first), traceValueSize(keyValuePair.second));
+    Tree::insert(keyValuePair);
+}
+
+template<typename Key, typename Value, typename Tree>
+void RecordingTree<Key, Value, Tree>::remove(const Key& key)
+{
+    writer_.append(TRACE_REMOVE, static_cast<uint64_t>(key), 0);
+    Tree::remove(key);
+}
+
+template<typename Key, typename Value, typename Tree>
+typename Tree::iterator RecordingTree<Key, Value, Tree>::find(const Key& key) const
+{
+    writer_.append(TRACE_FIND, static_cast<uint64_t>(key), 0);
+    return Tree::find(key);
+}
+
+/**
+* The cursor-relative operations are recorded as the plain ones, so a
+* replay runs them from the root.
+*/
+template<typename Key, typename Value, typename Tree>
+typename Tree::iterator RecordingTree<Key, Value, Tree>::findNear(const typename Tree::iterator& hint, const Key& key) const
+{
+    writer_.append(TRACE_FIND, static_cast<uint64_t>(key), 0);
+    return Tree::findNear(hint, key);
+}
+
+template<typename Key, typename Value, typename Tree>
+typename Tree::iterator RecordingTree<Key, Value, Tree>::insertNear(const typename Tree::iterator& hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    writer_.append(TRACE_INSERT, static_cast<uint64_t>(keyValuePair.first), traceValueSize(keyValuePair.second));
+    return Tree::insertNear(hint, keyValuePair);
+}
+
+template<typename Key, typename Value, typename Tree>
+typename Tree::iterator RecordingTree<Key, Value, Tree>::removeAt(const typename Tree::iterator& pos)
+{
+    if(pos != this->end()){
+        writer_.append(TRACE_REMOVE, static_cast<uint64_t>(pos->first), 0);
+    }
+    return Tree::removeAt(pos);
+}
+
+/**
+* Calls visit(item) on up to count items in key order, starting at the
+* first key not less than from. Returns the number of items visited.
+*/
+template<typename Key, typename Value, typename Tree>
+template<typename Visitor>
+size_t RecordingTree<Key, Value, Tree>::scan(const Key& from, size_t count, Visitor visit) const
+{
+    writer_.append(TRACE_SCAN, static_cast<uint64_t>(from), static_cast<uint32_t>(count));
+    size_t visited = 0;
+    for(typename Tree::iterator it = this->lowerBound(from); it != this->end() && visited < count; ++it){
+        visit(*it);
+        visited++;
+    }
+    return visited;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the RecordingTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef TREAPBST_H
+#define TREAPBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+
+/**
+* A node for a treap, which adds a random heap priority to the plain Node.
+*/
+template <typename Key, typename Value>
+class TreapNode : public Node<Key, Value>
+{
+public:
+    TreapNode(const Key& key, const Value& value, TreapNode<Key, Value>* parent, uint32_t priority);
+    virtual ~TreapNode();
+
+    uint32_t getPriority() const;
+
+    virtual TreapNode<Key, Value>* getParent() const override;
+    virtual TreapNode<Key, Value>* getLeft() const override;
+    virtual TreapNode<Key, Value>* getRight() const override;
+    virtual size_t footprint() const override;
+    virtual Node<Key, Value>* cloneInto(void* where) const override;
+
+protected:
+    uint32_t priority_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the TreapNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+TreapNode<Key, Value>::TreapNode(const Key& key, const Value& value, TreapNode<Key, Value> *parent, uint32_t priority) :
+    Node<Key, Value>(key, value, parent), priority_(priority)
+{
+
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value>::~TreapNode()
+{
+
+}
+
+template<class Key, class Value>
+uint32_t TreapNode<Key, Value>::getPriority() const
+{
+    return priority_;
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *TreapNode<Key, Value>::getParent() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *TreapNode<Key, Value>::getLeft() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *TreapNode<Key, Value>::getRight() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+size_t TreapNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* TreapNode<Key, Value>::cloneInto(void* where) const
+{
+    return new (where) TreapNode<Key, Value>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the TreapNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A randomized search tree: ordered by key, and a max-heap on random node
+* priorities. The expected depth of every node is O(log n) regardless of
+* insertion order.
+*/
+template <class Key, class Value>
+class Treap : public BinarySearchTree<Key, Value>
+{
+public:
+    explicit Treap(uint64_t seed = 0x2545F4914F6CDD1DULL);
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key &key);
+
+protected:
+    virtual Node<Key, Value>* insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item);
+    virtual void eraseNode(Node<Key, Value>* node);
+    void remove_at(TreapNode<Key, Value> *remove_node);
+    uint32_t nextPriority();
+
+    uint64_t seed_;
+};
+
+template<class Key, class Value>
+Treap<Key, Value>::Treap(uint64_t seed) :
+    BinarySearchTree<Key, Value>(), seed_(seed ? seed : 1)
+{
+
+}
+
+/**
+* xorshift64; the treap only needs priorities that are independent of the keys.
+*/
+template<class Key, class Value>
+uint32_t Treap<Key, Value>::nextPriority()
+{
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 7;
+    seed_ ^= seed_ << 17;
+    return static_cast<uint32_t>(seed_ >> 32);
+}
+
+/*
+ * Inserts as a leaf, then rotates the new node up while its priority is
+ * larger than its parent's. If the key exists, its value is overwritten.
+ */
+template<class Key, class Value>
+void Treap<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    TREE_PERF_SCOPE(TREE_PERF_INSERT);
+    if(this->root_ == nullptr){
+        this->setRoot(new TreapNode<Key, Value>(new_item.first, new_item.second, nullptr, nextPriority()));
+        return;
+    }
+
+    TreapNode<Key, Value>* curr = static_cast<TreapNode<Key, Value>*>(this->root_);
+    while(true){
+        TreapNode<Key, Value>* next;
+        if(new_item.first < curr->getKey()){
+            next = curr->getLeft();
+        } else if(curr->getKey() < new_item.first){
+            next = curr->getRight();
+        } else {
+            break;
+        }
+        if(next == nullptr){
+            break;
+        }
+        curr = next;
+    }
+    Treap<Key, Value>::insertBelow(curr, new_item);
+}
+
+/**
+* Finishes an insert (or insertNear) whose search ended at at: overwrites
+* its value if the keys match, else links a new leaf under it and rotates
+* it up. Returns the node holding new_item.
+*/
+template<class Key, class Value>
+Node<Key, Value>* Treap<Key, Value>::insertBelow(Node<Key, Value>* at, const std::pair<const Key, Value>& new_item)
+{
+    if(at == nullptr){
+        Treap<Key, Value>::insert(new_item);
+        return this->root_;
+    }
+    TreapNode<Key, Value>* curr = static_cast<TreapNode<Key, Value>*>(at);
+    if(!(new_item.first < curr->getKey()) && !(curr->getKey() < new_item.first)){
+        curr->setValue(new_item.second);
+        return curr;
+    }
+    TreapNode<Key, Value>* new_node = new TreapNode<Key, Value>(new_item.first, new_item.second, curr, nextPriority());
+    if(new_item.first < curr->getKey()){
+        curr->setLeft(new_node);
+    } else {
+        curr->setRight(new_node);
+    }
+
+    TreapNode<Key, Value>* parent = new_node->getParent();
+    while(parent != nullptr && parent->getPriority() < new_node->getPriority()){
+        if(parent->getLeft() == new_node){
+            this->rotate_right(parent);
+        } else {
+            this->rotate_left(parent);
+        }
+        parent = new_node->getParent();
+    }
+    BST_CHECK_PATH(this, new_node);
+    return new_node;
+}
+
+/*
+ * Rotates the node down (lifting its higher priority child each time) until
+ * it has at most one child, then unlinks it.
+ */
+template<class Key, class Value>
+void Treap<Key, Value>::remove(const Key& key)
+{
+    TREE_PERF_SCOPE(TREE_PERF_REMOVE);
+    TreapNode<Key, Value>* remove_node = static_cast<TreapNode<Key, Value>*>(this->internalFind(key));
+    if(remove_node == nullptr){
+        return;
+    }
+    remove_at(remove_node);
+}
+
+template<class Key, class Value>
+void Treap<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    remove_at(static_cast<TreapNode<Key, Value>*>(node));
+}
+
+template<class Key, class Value>
+void Treap<Key, Value>::remove_at(TreapNode<Key, Value>* remove_node)
+{
+    while(remove_node->getLeft() != nullptr && remove_node->getRight() != nullptr){
+        if(remove_node->getLeft()->getPriority() > remove_node->getRight()->getPriority()){
+            this->rotate_right(remove_node);
+        } else {
+            this->rotate_left(remove_node);
+        }
+    }
+    this->removeNode(remove_node);
+}
+
+#endif
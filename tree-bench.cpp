@@ -0,0 +1,347 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <map>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: tree-bench [csv|json] [bst] [avl] [map] [sizes...]
+//
+// Runs every workload for each tree (default: all three) and size (default
+// 1K, 10K, 100K, 1M; e.g. 100000000 for 100M, which needs ~10GB for the
+// trees and ~3GB of key arrays). Each (tree, size) runs in a forked child,
+// so the peak RSS is that run's own. Keys and probes are generated from
+// fixed seeds before timing, so runs are reproducible.
+//
+// Workloads (each repeated until it has done at least MIN_OPS operations):
+//   insert_sorted  insert keys 0..n-1 in order (for bst, which degenerates
+//                  into a list, done once and skipped above BST_SORTED_MAX)
+//   insert_random  insert keys 0..n-1 shuffled
+//   insert_zipf    n inserts of Zipf(0.99) distributed keys (mostly overwrites)
+//   find_hit       look up existing keys in random order
+//   find_miss      look up absent keys (odd keys in a tree of even keys)
+//   remove         remove every key in random order
+//   iterate        full in-order traversal
+//   clear          clear() of a tree of n keys
+//   mixed          50% find, 25% insert, 25% remove over keys in [0, 2n)
+//
+// Output: one row per (tree, workload, n) with ns/op, ops/s and the peak RSS
+// of the run up to that workload (KB), as CSV (default) or a JSON array.
+// Built with -DTREE_PERF, each run also prints its per-operation counter
+// histograms (see tree-perf.h) to stderr.
+
+static const size_t MIN_OPS = 1000000;
+static const size_t BST_SORTED_MAX = 20000;
+
+struct BenchResult {
+    char tree[8];
+    char workload[16];
+    uint64_t n;
+    uint64_t ops;
+    uint64_t ns;
+    long peak_rss_kb;
+};
+
+/**
+* The three trees are driven through the same calls; std::map gets
+* overwrite-on-insert semantics like the library's trees.
+*/
+template<typename Tree>
+static void treeInsert(Tree& tree, uint64_t key, uint64_t value)
+{
+    tree.insert(make_pair(key, value));
+}
+
+static void treeInsert(map<uint64_t, uint64_t>& tree, uint64_t key, uint64_t value)
+{
+    tree[key] = value;
+}
+
+template<typename Tree>
+static void treeRemove(Tree& tree, uint64_t key)
+{
+    tree.remove(key);
+}
+
+static void treeRemove(map<uint64_t, uint64_t>& tree, uint64_t key)
+{
+    tree.erase(key);
+}
+
+template<typename Tree>
+static void fill(Tree& tree, const vector<uint64_t>& keys)
+{
+    for(size_t i = 0; i < keys.size(); i++){
+        treeInsert(tree, keys[i], i);
+    }
+}
+
+class Runner
+{
+public:
+    Runner(const string& tree, size_t n, int out) : tree_(tree), n_(n), reps_(max<size_t>(1, MIN_OPS / n)), out_(out) {}
+
+    template<typename Tree>
+    void runAll()
+    {
+        // keys are 2i so that odd keys are misses
+        vector<uint64_t> sorted(n_);
+        for(size_t i = 0; i < n_; i++){
+            sorted[i] = 2 * i;
+        }
+        vector<uint64_t> shuffled = benchShuffledKeys(n_, 1);
+        for(size_t i = 0; i < n_; i++){
+            shuffled[i] *= 2;
+        }
+
+        if(tree_ != "bst"){
+            timeInserts<Tree>("insert_sorted", sorted, reps_);
+        } else if(n_ <= BST_SORTED_MAX){
+            timeInserts<Tree>("insert_sorted", sorted, 1);
+        }
+        timeInserts<Tree>("insert_random", shuffled, reps_);
+        {
+            vector<uint64_t> zipfKeys(n_);
+            BenchZipf zipf(n_, 0.99, 2);
+            for(size_t i = 0; i < n_; i++){
+                zipfKeys[i] = shuffled[zipf.next()];
+            }
+            timeInserts<Tree>("insert_zipf", zipfKeys, reps_);
+        }
+
+        {
+            Tree tree;
+            fill(tree, shuffled);
+            vector<uint64_t> probes = benchShuffledKeys(n_, 3);
+            for(size_t i = 0; i < n_; i++){
+                probes[i] *= 2;
+            }
+            timeFinds(tree, "find_hit", probes);
+            for(size_t i = 0; i < n_; i++){
+                probes[i]++;
+            }
+            timeFinds(tree, "find_miss", probes);
+
+            uint64_t sum = 0;
+            uint64_t start = benchNowNs();
+            for(size_t r = 0; r < reps_; r++){
+                for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+                    sum += it->second;
+                }
+            }
+            report("iterate", reps_ * n_, benchNowNs() - start);
+            benchKeep(sum);
+        }
+
+        {
+            vector<uint64_t> order = benchShuffledKeys(n_, 4);
+            for(size_t i = 0; i < n_; i++){
+                order[i] *= 2;
+            }
+            uint64_t removeNs = 0, clearNs = 0;
+            for(size_t r = 0; r < reps_; r++){
+                Tree tree;
+                fill(tree, shuffled);
+                uint64_t start = benchNowNs();
+                for(size_t i = 0; i < n_; i++){
+                    treeRemove(tree, order[i]);
+                }
+                removeNs += benchNowNs() - start;
+
+                fill(tree, shuffled);
+                start = benchNowNs();
+                tree.clear();
+                clearNs += benchNowNs() - start;
+            }
+            report("remove", reps_ * n_, removeNs);
+            report("clear", reps_ * n_, clearNs);
+        }
+
+        {
+            size_t ops = max(n_, MIN_OPS);
+            vector<uint64_t> opKeys(ops);
+            vector<uint8_t> opKinds(ops);
+            BenchRng rng(5);
+            for(size_t i = 0; i < ops; i++){
+                opKeys[i] = rng.below(2 * n_);
+                opKinds[i] = static_cast<uint8_t>(rng.below(4));
+            }
+            Tree tree;
+            fill(tree, shuffled);
+            uint64_t found = 0;
+            uint64_t start = benchNowNs();
+            for(size_t i = 0; i < ops; i++){
+                if(opKinds[i] < 2){
+                    found += tree.find(opKeys[i]) != tree.end();
+                } else if(opKinds[i] == 2){
+                    treeInsert(tree, opKeys[i], i);
+                } else {
+                    treeRemove(tree, opKeys[i]);
+                }
+            }
+            report("mixed", ops, benchNowNs() - start);
+            benchKeep(found);
+        }
+    }
+
+private:
+    template<typename Tree>
+    void timeInserts(const char* workload, const vector<uint64_t>& keys, size_t reps)
+    {
+        uint64_t ns = 0;
+        for(size_t r = 0; r < reps; r++){
+            Tree tree;
+            uint64_t start = benchNowNs();
+            fill(tree, keys);
+            ns += benchNowNs() - start;
+        }
+        report(workload, reps * keys.size(), ns);
+    }
+
+    template<typename Tree>
+    void timeFinds(Tree& tree, const char* workload, const vector<uint64_t>& probes)
+    {
+        uint64_t found = 0;
+        uint64_t start = benchNowNs();
+        for(size_t r = 0; r < reps_; r++){
+            for(size_t i = 0; i < probes.size(); i++){
+                found += tree.find(probes[i]) != tree.end();
+            }
+        }
+        report(workload, reps_ * probes.size(), benchNowNs() - start);
+        benchKeep(found);
+    }
+
+    void report(const char* workload, uint64_t ops, uint64_t ns)
+    {
+        BenchResult result;
+        memset(&result, 0, sizeof(result));
+        strncpy(result.tree, tree_.c_str(), sizeof(result.tree) - 1);
+        strncpy(result.workload, workload, sizeof(result.workload) - 1);
+        result.n = n_;
+        result.ops = ops;
+        result.ns = ns;
+        result.peak_rss_kb = benchPeakRssKb();
+        if(write(out_, &result, sizeof(result)) != sizeof(result)){
+            _exit(1);
+        }
+    }
+
+    string tree_;
+    size_t n_;
+    size_t reps_;
+    int out_;
+};
+
+/**
+* Runs one (tree, size) in a child process and prints its rows as they arrive.
+*/
+static bool runChild(const string& tree, size_t n, bool json, bool& first)
+{
+    int fds[2];
+    if(pipe(fds) != 0){
+        return false;
+    }
+    pid_t pid = fork();
+    if(pid == 0){
+        close(fds[0]);
+        Runner runner(tree, n, fds[1]);
+        if(tree == "bst"){
+            runner.runAll<BinarySearchTree<uint64_t, uint64_t> >();
+        } else if(tree == "avl"){
+            runner.runAll<AVLTree<uint64_t, uint64_t> >();
+        } else {
+            runner.runAll<map<uint64_t, uint64_t> >();
+        }
+#ifdef TREE_PERF
+        cerr << tree << " n=" << n << endl;
+        treePerfReport(cerr);
+#endif
+        _exit(0);
+    }
+    close(fds[1]);
+    if(pid < 0){
+        close(fds[0]);
+        return false;
+    }
+
+    BenchResult result;
+    while(read(fds[0], &result, sizeof(result)) == sizeof(result)){
+        double nsPerOp = static_cast<double>(result.ns) / result.ops;
+        double opsPerSec = result.ns ? result.ops * 1e9 / result.ns : 0;
+        if(json){
+            cout << (first ? "\n" : ",\n")
+                 << "  {\"tree\": \"" << result.tree << "\", \"workload\": \"" << result.workload
+                 << "\", \"n\": " << result.n << ", \"ops\": " << result.ops
+                 << ", \"ns_per_op\": " << fixed << setprecision(2) << nsPerOp
+                 << ", \"ops_per_sec\": " << setprecision(0) << opsPerSec
+                 << ", \"peak_rss_kb\": " << result.peak_rss_kb << "}";
+        } else {
+            cout << result.tree << "," << result.workload << "," << result.n << "," << result.ops << ","
+                 << fixed << setprecision(2) << nsPerOp << "," << setprecision(0) << opsPerSec << ","
+                 << result.peak_rss_kb << "\n";
+        }
+        first = false;
+        cout.flush();
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    vector<string> trees;
+    vector<size_t> sizes;
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if(arg == "json" || arg == "csv"){
+            json = arg == "json";
+        } else if(arg == "bst" || arg == "avl" || arg == "map"){
+            trees.push_back(arg);
+        } else {
+            size_t n = benchArg(argc, argv, i, 0);
+            if(n == 0){
+                cerr << "usage: tree-bench [csv|json] [bst] [avl] [map] [sizes...]" << endl;
+                return 1;
+            }
+            sizes.push_back(n);
+        }
+    }
+    if(trees.empty()){
+        trees.push_back("bst");
+        trees.push_back("avl");
+        trees.push_back("map");
+    }
+    if(sizes.empty()){
+        for(size_t n = 1000; n <= 1000000; n *= 10){
+            sizes.push_back(n);
+        }
+    }
+
+    cout << (json ? "[" : "tree,workload,n,ops,ns_per_op,ops_per_sec,peak_rss_kb\n");
+    cout.flush();
+    bool first = true;
+    int failed = 0;
+    for(size_t s = 0; s < sizes.size(); s++){
+        for(size_t t = 0; t < trees.size(); t++){
+            if(!runChild(trees[t], sizes[s], json, first)){
+                cerr << "tree-bench: " << trees[t] << " n=" << sizes[s] << " did not finish" << endl;
+                failed++;
+            }
+        }
+    }
+    if(json){
+        cout << "\n]\n";
+    }
+    return failed ? 1 : 0;
+}
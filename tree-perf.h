@@ -0,0 +1,291 @@
+#ifndef TREE_PERF_H
+#define TREE_PERF_H
+
+/**
+* Per-operation hardware counters for the trees, compiled in with
+* -DTREE_PERF (see the Makefile). Each find/insert/remove on any of the
+* trees is measured with TREE_PERF_SCOPE: wall-clock ns plus cycles,
+* instructions, L1D read misses, LLC misses and branch misses of the
+* calling thread, read as one perf_event_open group (2 read() calls per
+* operation, so expect roughly a microsecond of overhead per operation,
+* mostly spent in the kernel and not counted). Values go into per-thread
+* log2 histograms; treePerfReport() merges and prints them.
+*
+* Events the kernel refuses (no PMU in a VM, perf_event_paranoid too high)
+* are reported as n/a; the ns histogram is always there.
+*
+* Without TREE_PERF the macro expands to nothing.
+*/
+
+enum TreePerfOp { TREE_PERF_FIND, TREE_PERF_INSERT, TREE_PERF_REMOVE, TREE_PERF_OPS };
+
+#ifdef TREE_PERF
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define TREE_PERF_SCOPE(op) TreePerfScope tree_perf_scope_(op)
+
+enum TreePerfMetric {
+    TREE_PERF_NS, TREE_PERF_CYCLES, TREE_PERF_INSTRUCTIONS,
+    TREE_PERF_L1D_MISSES, TREE_PERF_LLC_MISSES, TREE_PERF_BRANCH_MISSES,
+    TREE_PERF_METRICS
+};
+
+/**
+* Count, sum, max and log2 buckets (bucket b holds values in [2^(b-1), 2^b),
+* bucket 0 holds 0) of one metric of one operation.
+*/
+struct TreePerfHistogram {
+    static const int BUCKETS = 65;
+
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+
+    TreePerfHistogram() : count(0), sum(0), max(0)
+    {
+        std::memset(buckets, 0, sizeof(buckets));
+    }
+
+    void record(uint64_t value)
+    {
+        count++;
+        sum += value;
+        if(value > max) max = value;
+        buckets[value == 0 ? 0 : 64 - __builtin_clzll(value)]++;
+    }
+
+    void merge(const TreePerfHistogram& other)
+    {
+        count += other.count;
+        sum += other.sum;
+        if(other.max > max) max = other.max;
+        for(int b = 0; b < BUCKETS; b++){
+            buckets[b] += other.buckets[b];
+        }
+    }
+
+    // Upper bound of the bucket holding the q-quantile
+    uint64_t quantile(double q) const
+    {
+        uint64_t rank = static_cast<uint64_t>(q * count);
+        uint64_t seen = 0;
+        for(int b = 0; b < BUCKETS; b++){
+            seen += buckets[b];
+            if(seen > rank){
+                return b == 0 ? 0 : (b == 64 ? max : (uint64_t(1) << b) - 1);
+            }
+        }
+        return max;
+    }
+};
+
+/**
+* The counters and histograms of one thread. Threads register theirs once
+* and they are never freed, so a report still sees threads that exited.
+*/
+class TreePerfThread
+{
+public:
+    TreePerfThread() : nested_(0), leader_(-1)
+    {
+        static const uint32_t types[TREE_PERF_METRICS] = {
+            0, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+            PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+        };
+        static const uint64_t configs[TREE_PERF_METRICS] = {
+            0, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for(int m = 0; m < TREE_PERF_METRICS; m++){
+            slot_[m] = -1;
+        }
+        int slots = 0;
+        for(int m = TREE_PERF_CYCLES; m < TREE_PERF_METRICS; m++){
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[m];
+            attr.config = configs[m];
+            attr.disabled = leader_ < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0));
+            if(fd < 0) continue;
+            if(leader_ < 0) leader_ = fd;
+            fds_.push_back(fd);
+            slot_[m] = slots++;
+        }
+        if(leader_ >= 0){
+            ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    bool available(int metric) const
+    {
+        return metric == TREE_PERF_NS || slot_[metric] >= 0;
+    }
+
+    // values[m] for every metric, 0 for unavailable ones
+    void read(uint64_t values[TREE_PERF_METRICS]) const
+    {
+        uint64_t group[1 + TREE_PERF_METRICS];
+        std::memset(values, 0, sizeof(uint64_t) * TREE_PERF_METRICS);
+        if(leader_ >= 0 && ::read(leader_, group, sizeof(group)) > 0){
+            for(int m = TREE_PERF_CYCLES; m < TREE_PERF_METRICS; m++){
+                if(slot_[m] >= 0) values[m] = group[1 + slot_[m]];
+            }
+        }
+        values[TREE_PERF_NS] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TreePerfHistogram histograms[TREE_PERF_OPS][TREE_PERF_METRICS];
+
+    // Only the outermost operation is measured (e.g. LoggedTree::insert
+    // calling AVLTree::insert)
+    int nested_;
+
+private:
+    int leader_;
+    int slot_[TREE_PERF_METRICS];
+    std::vector<int> fds_;
+};
+
+struct TreePerfRegistry {
+    std::mutex lock;
+    std::vector<TreePerfThread*> threads;
+};
+
+inline TreePerfRegistry& treePerfRegistry()
+{
+    static TreePerfRegistry registry;
+    return registry;
+}
+
+inline TreePerfThread& treePerfThread()
+{
+    static thread_local TreePerfThread* self = nullptr;
+    if(self == nullptr){
+        self = new TreePerfThread();
+        TreePerfRegistry& registry = treePerfRegistry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.threads.push_back(self);
+    }
+    return *self;
+}
+
+/**
+* Measures the enclosing block as one operation.
+*/
+class TreePerfScope
+{
+public:
+    explicit TreePerfScope(TreePerfOp op) : thread_(treePerfThread()), op_(op)
+    {
+        if(thread_.nested_++ == 0){
+            thread_.read(start_);
+        }
+    }
+
+    ~TreePerfScope()
+    {
+        if(--thread_.nested_ == 0){
+            uint64_t end[TREE_PERF_METRICS];
+            thread_.read(end);
+            for(int m = 0; m < TREE_PERF_METRICS; m++){
+                thread_.histograms[op_][m].record(end[m] - start_[m]);
+            }
+        }
+    }
+
+private:
+    TreePerfScope(const TreePerfScope&);
+    TreePerfScope& operator=(const TreePerfScope&);
+
+    TreePerfThread& thread_;
+    TreePerfOp op_;
+    uint64_t start_[TREE_PERF_METRICS];
+};
+
+/**
+* Clears the histograms of all threads. Not synchronized with threads that
+* are running tree operations.
+*/
+inline void treePerfReset()
+{
+    TreePerfRegistry& registry = treePerfRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for(size_t t = 0; t < registry.threads.size(); t++){
+        for(int op = 0; op < TREE_PERF_OPS; op++){
+            for(int m = 0; m < TREE_PERF_METRICS; m++){
+                registry.threads[t]->histograms[op][m] = TreePerfHistogram();
+            }
+        }
+    }
+}
+
+/**
+* Prints mean, p50, p99 and max of every metric per operation, merged over
+* all threads. Quantiles are bucket upper bounds (within a factor of 2).
+*/
+inline void treePerfReport(std::ostream& out)
+{
+    static const char* opNames[TREE_PERF_OPS] = { "find", "insert", "remove" };
+    static const char* metricNames[TREE_PERF_METRICS] = {
+        "ns", "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses"
+    };
+
+    TreePerfHistogram merged[TREE_PERF_OPS][TREE_PERF_METRICS];
+    TreePerfRegistry& registry = treePerfRegistry();
+    {
+        std::lock_guard<std::mutex> guard(registry.lock);
+        for(size_t t = 0; t < registry.threads.size(); t++){
+            for(int op = 0; op < TREE_PERF_OPS; op++){
+                for(int m = 0; m < TREE_PERF_METRICS; m++){
+                    merged[op][m].merge(registry.threads[t]->histograms[op][m]);
+                }
+            }
+        }
+    }
+    const TreePerfThread& self = treePerfThread();
+
+    out << std::left << std::setw(8) << "op" << std::setw(15) << "metric" << std::right
+        << std::setw(12) << "count" << std::setw(12) << "mean" << std::setw(12) << "p50"
+        << std::setw(12) << "p99" << std::setw(14) << "max" << std::endl;
+    for(int op = 0; op < TREE_PERF_OPS; op++){
+        if(merged[op][TREE_PERF_NS].count == 0) continue;
+        for(int m = 0; m < TREE_PERF_METRICS; m++){
+            const TreePerfHistogram& h = merged[op][m];
+            out << std::left << std::setw(8) << opNames[op] << std::setw(15) << metricNames[m] << std::right;
+            if(!self.available(m)){
+                out << std::setw(12) << "n/a" << std::endl;
+                continue;
+            }
+            out << std::setw(12) << h.count << std::setw(12) << std::fixed << std::setprecision(1)
+                << static_cast<double>(h.sum) / h.count << std::setw(12) << h.quantile(0.5)
+                << std::setw(12) << h.quantile(0.99) << std::setw(14) << h.max << std::endl;
+        }
+    }
+}
+
+#else
+
+#define TREE_PERF_SCOPE(op) ((void)0)
+
+#endif
+
+#endif
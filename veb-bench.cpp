@@ -0,0 +1,117 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "avlbst.h"
+#include "veb-layout.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: veb-bench [maxKeys] [lookups]
+//
+// Lookups of random present keys (uint64_t keys and values) in a
+// VebLayoutTree snapshot of an AVLTree, in an Eytzinger (breadth-first)
+// array and with std::lower_bound on a sorted array, for sizes from 4K
+// keys (32KB, fits in L1) growing 8x at a time up to maxKeys (the default
+// 16M keys is 128MB of keys, beyond a 105MB L3). The AVLTree itself is
+// timed as well. Each lookup is a lower bound followed by an equality
+// check; none of them prefetch.
+
+static double nsPerOp(uint64_t start, size_t ops)
+{
+    return static_cast<double>(benchNowNs() - start) / ops;
+}
+
+// Eytzinger layout: the node with breadth-first number i (root 1) is at
+// e[i], its children at e[2i] and e[2i + 1]
+static void eytzingerFill(const vector<uint64_t>& sorted, vector<uint64_t>& e, size_t& next, size_t i)
+{
+    if(i < e.size()){
+        eytzingerFill(sorted, e, next, 2 * i);
+        e[i] = sorted[next++];
+        eytzingerFill(sorted, e, next, 2 * i + 1);
+    }
+}
+
+static bool eytzingerContains(const vector<uint64_t>& e, uint64_t key)
+{
+    size_t n = e.size() - 1;
+    size_t i = 1;
+    while(i <= n){
+        i = 2 * i + (e[i] < key);
+    }
+    // drop the trailing right turns and the last left one
+    i >>= __builtin_ffsll(~i);
+    return i != 0 && e[i] == key;
+}
+
+static void run(size_t n, size_t lookups)
+{
+    vector<pair<uint64_t, uint64_t> > items(n);
+    vector<uint64_t> sorted(n);
+    for(size_t i = 0; i < n; i++){
+        sorted[i] = 2 * i + 1;
+        items[i] = make_pair(sorted[i], i);
+    }
+    AVLTree<uint64_t, uint64_t> tree;
+    tree.buildFromSorted(items);
+    items.clear();
+    items.shrink_to_fit();
+
+    BenchRng rng(n);
+    vector<uint64_t> probes(lookups);
+    for(size_t i = 0; i < lookups; i++){
+        probes[i] = 2 * rng.below(n) + 1;
+    }
+
+    uint64_t found = 0;
+    uint64_t start = benchNowNs();
+    for(size_t i = 0; i < lookups; i++){
+        found += tree.find(probes[i]) != tree.end();
+    }
+    double treeNs = nsPerOp(start, lookups);
+
+    VebLayoutTree<uint64_t, uint64_t> veb(tree);
+    tree.clear();
+    start = benchNowNs();
+    for(size_t i = 0; i < lookups; i++){
+        found += veb.contains(probes[i]);
+    }
+    double vebNs = nsPerOp(start, lookups);
+
+    vector<uint64_t> e(n + 1);
+    size_t next = 0;
+    eytzingerFill(sorted, e, next, 1);
+    start = benchNowNs();
+    for(size_t i = 0; i < lookups; i++){
+        found += eytzingerContains(e, probes[i]);
+    }
+    double eytzingerNs = nsPerOp(start, lookups);
+
+    start = benchNowNs();
+    for(size_t i = 0; i < lookups; i++){
+        vector<uint64_t>::const_iterator it = lower_bound(sorted.begin(), sorted.end(), probes[i]);
+        found += it != sorted.end() && *it == probes[i];
+    }
+    double sortedNs = nsPerOp(start, lookups);
+    if(found != 4 * lookups){
+        cout << "lookup mismatch" << endl;
+    }
+
+    cout << setw(10) << n << fixed << setprecision(1) << setw(10) << treeNs << setw(10) << vebNs
+         << setw(11) << eytzingerNs << setw(10) << sortedNs << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t maxKeys = benchArg(argc, argv, 1, 16 << 20);
+    size_t lookups = benchArg(argc, argv, 2, 2000000);
+    cout << "ns/lookup" << endl << setw(10) << "keys" << setw(10) << "AVLTree" << setw(10) << "vEB"
+         << setw(11) << "Eytzinger" << setw(10) << "sorted" << endl;
+    for(size_t n = 4096; n <= maxKeys; n *= 8){
+        run(n, lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+#ifndef VEB_LAYOUT_H
+#define VEB_LAYOUT_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <stdexcept>
+#include "bst.h"
+
+/**
+* A read-only snapshot of a tree as a pointer-free search tree in van Emde
+* Boas layout, for lookups on data that no longer changes:
+*
+*   VebLayoutTree<uint64_t, Record> snapshot(tree);   // any BinarySearchTree
+*   Record r;
+*   if(snapshot.find(key, r)) ...
+*   size_t rank = snapshot.lowerBound(key);           // then snapshot.at(rank)
+*
+* The keys form a perfect binary search tree (padded at the end with
+* copies of the largest key) stored in one array, in van Emde Boas order:
+* the top half of the levels first, recursively laid out the same way,
+* then each subtree hanging below them. Every subtree of about sqrt(n)
+* nodes is contiguous at every scale, so a search touches O(log_B n)
+* cache lines for any cache line size B, without knowing B. There are no
+* child pointers; the search computes the next position from its own
+* path with a table of three numbers per depth (see layoutLevels).
+*
+* The items themselves are kept in key order in a separate array, which
+* find reads once at the end (for the value) and at indexes by rank.
+*/
+template <class Key, class Value>
+class VebLayoutTree
+{
+public:
+    VebLayoutTree();
+    explicit VebLayoutTree(const BinarySearchTree<Key, Value>& tree);
+
+    void build(const BinarySearchTree<Key, Value>& tree);
+    size_t size() const;
+    bool empty() const;
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t lowerBound(const Key& key) const;
+    const std::pair<Key, Value>& at(size_t rank) const;
+
+protected:
+    static const int MAX_HEIGHT = 64;
+
+    void layoutLevels(int depth, int height);
+    void fill(size_t index, int depth, size_t* path);
+    size_t rankOf(size_t index, int depth) const;
+    size_t search(const Key& key, size_t& found) const;
+    size_t childPos(size_t index, int depth, const size_t* path) const;
+
+    std::vector<Key> keys_;
+    std::vector<std::pair<Key, Value> > items_;
+    int height_;
+    // For a step down to depth d: the position of the child is that of
+    // its ancestor at depth levels_[d].top, plus the size of that
+    // ancestor's top tree, plus the child's index among the subtrees below
+    // it (the low bits of its breadth-first number, masked by the same
+    // size) times the size of one of them, 2^bottom - 1.
+    struct Level {
+        size_t topSize;
+        int top;
+        int bottom;
+    };
+    Level levels_[MAX_HEIGHT];
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the VebLayoutTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+VebLayoutTree<Key, Value>::VebLayoutTree() :
+    height_(0)
+{
+
+}
+
+template<class Key, class Value>
+VebLayoutTree<Key, Value>::VebLayoutTree(const BinarySearchTree<Key, Value>& tree) :
+    height_(0)
+{
+    build(tree);
+}
+
+/**
+* Replaces the snapshot with the contents of tree, read through its
+* in-order iterator. O(n).
+*/
+template<class Key, class Value>
+void VebLayoutTree<Key, Value>::build(const BinarySearchTree<Key, Value>& tree)
+{
+    items_.clear();
+    keys_.clear();
+    height_ = 0;
+    for(typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it){
+        items_.push_back(std::make_pair(it->first, it->second));
+    }
+    if(items_.empty()){
+        return;
+    }
+    while((size_t(1) << height_) - 1 < items_.size()){
+        height_++;
+    }
+    keys_.resize((size_t(1) << height_) - 1, items_.back().first);
+    layoutLevels(0, height_);
+    size_t path[MAX_HEIGHT];
+    fill(1, 0, path);
+}
+
+/**
+* Fills levels_ for the subtree of the given height
+* whose root is at depth: the split between its top half and its bottom
+* subtrees, then (recursively) the splits inside the top half and inside
+* the bottom subtrees, which all share theirs.
+*/
+template<class Key, class Value>
+void VebLayoutTree<Key, Value>::layoutLevels(int depth, int height)
+{
+    if(height <= 1){
+        return;
+    }
+    int top = height / 2;
+    Level& level = levels_[depth + top];
+    level.topSize = (size_t(1) << top) - 1;
+    level.top = depth;
+    level.bottom = height - top;
+    layoutLevels(depth, top);
+    layoutLevels(depth + top, height - top);
+}
+
+/**
+* Stores the key of the node with breadth-first number index (the root is
+* 1, the children of i are 2i and 2i + 1) at its van Emde Boas position,
+* then does the same for its subtree. path holds the positions of its
+* ancestors by depth.
+*/
+template<class Key, class Value>
+void VebLayoutTree<Key, Value>::fill(size_t index, int depth, size_t* path)
+{
+    path[depth] = depth == 0 ? 0 : childPos(index, depth, path);
+    size_t pos = path[depth];
+    size_t rank = rankOf(index, depth);
+    if(rank < items_.size()){
+        keys_[pos] = items_[rank].first;
+    }
+    if(depth + 1 < height_){
+        fill(2 * index, depth + 1, path);
+        fill(2 * index + 1, depth + 1, path);
+    }
+}
+
+/**
+* The position in keys_ of the node with breadth-first number index at
+* depth (> 0), given the positions of its ancestors in path.
+*/
+template<class Key, class Value>
+size_t VebLayoutTree<Key, Value>::childPos(size_t index, int depth, const size_t* path) const
+{
+    const Level& level = levels_[depth];
+    size_t subtree = index & level.topSize;
+    return path[level.top] + level.topSize + (subtree << level.bottom) - subtree;
+}
+
+/**
+* The in-order rank of the node with breadth-first number index at depth.
+*/
+template<class Key, class Value>
+size_t VebLayoutTree<Key, Value>::rankOf(size_t index, int depth) const
+{
+    return ((2 * (index - (size_t(1) << depth)) + 1) << (height_ - 1 - depth)) - 1;
+}
+
+template<class Key, class Value>
+size_t VebLayoutTree<Key, Value>::size() const
+{
+    return items_.size();
+}
+
+template<class Key, class Value>
+bool VebLayoutTree<Key, Value>::empty() const
+{
+    return items_.empty();
+}
+
+/**
+* The rank (position in key order) of the first item whose key is not
+* less than key, or size() if there is none.
+*/
+template<class Key, class Value>
+size_t VebLayoutTree<Key, Value>::lowerBound(const Key& key) const
+{
+    size_t found;
+    return search(key, found);
+}
+
+/**
+* Copies the value stored under key to value and returns true, or returns
+* false if key is not in the snapshot.
+*/
+template<class Key, class Value>
+bool VebLayoutTree<Key, Value>::find(const Key& key, Value& value) const
+{
+    size_t found;
+    size_t rank = search(key, found);
+    if(rank == items_.size() || key < keys_[found]){
+        return false;
+    }
+    value = items_[rank].second;
+    return true;
+}
+
+template<class Key, class Value>
+bool VebLayoutTree<Key, Value>::contains(const Key& key) const
+{
+    size_t found;
+    size_t rank = search(key, found);
+    return rank != items_.size() && !(key < keys_[found]);
+}
+
+/**
+* lowerBound, which also sets found to the position in keys_ of the key
+* at the returned rank (when that rank is < size()), so that find and
+* contains can check for a match without touching items_. Goes right past
+* every key less than key, so after height levels the breadth-first
+* number, less the 2^height of its level, counts the keys less than key.
+*/
+template<class Key, class Value>
+size_t VebLayoutTree<Key, Value>::search(const Key& key, size_t& found) const
+{
+    TREE_PERF_SCOPE(TREE_PERF_FIND);
+    found = 0;
+    if(height_ == 0){
+        return 0;
+    }
+    typename BstParam<Key>::type k = key;
+    size_t path[MAX_HEIGHT];
+    size_t index = 1;
+    size_t pos = 0;
+    for(int depth = 0; ; ){
+        path[depth] = pos;
+        bool right = keys_[pos] < k;
+        found = right ? found : pos;
+        index = 2 * index + right;
+        if(++depth == height_){
+            break;
+        }
+        pos = childPos(index, depth, path);
+    }
+    size_t rank = index - (size_t(1) << height_);
+    return rank < items_.size() ? rank : items_.size();
+}
+
+/**
+* The item of the given rank, i.e. the rank + 1st smallest key.
+*/
+template<class Key, class Value>
+const std::pair<Key, Value>& VebLayoutTree<Key, Value>::at(size_t rank) const
+{
+    if(rank >= items_.size()){
+        throw std::out_of_range("Invalid rank");
+    }
+    return items_[rank];
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the VebLayoutTree class.
+  ---------------------------------------------
+*/
+
+#endif
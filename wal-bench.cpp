@@ -0,0 +1,89 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdio>
+#include "avlbst.h"
+#include "wal.h"
+#include "bench-util.h"
+
+using namespace std;
+
+// Usage: wal-bench [ops] [directory]
+//
+// Measures insert/remove throughput of an AVLTree without a log and with
+// a write-ahead log at several group commit sizes, then the time to
+// recover the tree from snapshot + log.
+
+static const size_t kGroups[] = { 1, 8, 64, 512, 4096 };
+
+static void runOps(AVLTree<uint64_t, uint64_t>& tree, const vector<uint64_t>& keys)
+{
+    for(size_t i = 0; i < keys.size(); i++){
+        // 3 inserts for every remove
+        if(i % 4 == 3){
+            tree.remove(keys[i - 1]);
+        } else {
+            tree.insert(make_pair(keys[i], static_cast<uint64_t>(i)));
+        }
+    }
+}
+
+static void report(const string& name, size_t ops, uint64_t ns)
+{
+    cout << left << setw(16) << name << right << setw(12) << ops
+         << setw(16) << fixed << setprecision(0) << ops * 1e9 / ns << " ops/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t ops = benchArg(argc, argv, 1, 200000);
+    string dir = argc > 2 ? argv[2] : "/tmp";
+    string prefix = dir + "/wal-bench";
+    vector<uint64_t> keys = benchShuffledKeys(ops, 42);
+
+    cout << left << setw(16) << "config" << right << setw(12) << "ops" << setw(16) << "throughput" << endl;
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        uint64_t start = benchNowNs();
+        runOps(tree, keys);
+        report("no-wal", ops, benchNowNs() - start);
+    }
+
+    for(size_t g = 0; g < sizeof(kGroups) / sizeof(kGroups[0]); g++){
+        std::remove((prefix + ".wal").c_str());
+        std::remove((prefix + ".snap").c_str());
+        // fsync per operation is slow; keep that run short
+        size_t n = kGroups[g] == 1 ? min(ops, static_cast<size_t>(20000)) : ops;
+        vector<uint64_t> subset(keys.begin(), keys.begin() + n);
+
+        LoggedTree<uint64_t, uint64_t> tree(prefix, kGroups[g]);
+        uint64_t start = benchNowNs();
+        runOps(tree, subset);
+        tree.sync();
+        report("wal-group-" + to_string(kGroups[g]), n, benchNowNs() - start);
+    }
+
+    // recovery: snapshot half the operations, log the rest
+    std::remove((prefix + ".wal").c_str());
+    std::remove((prefix + ".snap").c_str());
+    {
+        LoggedTree<uint64_t, uint64_t> tree(prefix, 4096);
+        vector<uint64_t> first(keys.begin(), keys.begin() + ops / 2);
+        vector<uint64_t> second(keys.begin() + ops / 2, keys.end());
+        runOps(tree, first);
+        tree.snapshot();
+        runOps(tree, second);
+        tree.sync();
+    }
+    LoggedTree<uint64_t, uint64_t> recovered(prefix, 4096);
+    uint64_t start = benchNowNs();
+    recovered.recover();
+    uint64_t ns = benchNowNs() - start;
+    cout << "recover (snapshot + " << ops - ops / 2 << " log records): "
+         << fixed << setprecision(2) << ns / 1e6 << " ms, balanced="
+         << recovered.isBalanced() << endl;
+
+    std::remove((prefix + ".wal").c_str());
+    std::remove((prefix + ".snap").c_str());
+    return 0;
+}
@@ -0,0 +1,519 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+/**
+* fsyncs the directory holding path, so that a file just created in it or
+* renamed into it is still there after a crash; fsyncing the file itself
+* only covers its contents.
+*/
+inline void walSyncDirectory(const std::string& path)
+{
+    std::string::size_type slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0){
+        throw std::runtime_error("Unable to open directory " + dir);
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    if(!ok){
+        throw std::runtime_error("fsync of directory " + dir + " failed");
+    }
+}
+
+/**
+* An append-only write-ahead log of insert/remove records.
+*
+* Each record is [op][key][value (inserts only)][checksum], with the key and
+* value stored as raw bytes, so both must be trivially copyable. Records are
+* buffered and written + fsync'ed once every groupCommit records (group
+* commit). A groupCommit of 1 makes every operation durable before it
+* returns; larger groups trade the last (groupCommit - 1) operations on a
+* crash for far fewer fsyncs. A groupCommit of 0 never syncs on its own,
+* only when sync() is called.
+*/
+template <typename Key, typename Value>
+class WriteAheadLog
+{
+public:
+    static_assert(std::is_trivially_copyable<Key>::value, "WAL keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "WAL values must be trivially copyable");
+
+    enum OpCode { WAL_INSERT = 1, WAL_REMOVE = 2 };
+
+    struct Record {
+        uint8_t op;
+        Key key;
+        Value value;
+    };
+
+    WriteAheadLog(const std::string& path, size_t groupCommit);
+    ~WriteAheadLog();
+
+    void appendInsert(const Key& key, const Value& value);
+    void appendRemove(const Key& key);
+    void sync();
+    void truncate();
+    size_t pending() const;
+
+    std::vector<Record> readAll();
+
+private:
+    WriteAheadLog(const WriteAheadLog&);
+    WriteAheadLog& operator=(const WriteAheadLog&);
+
+    void append(uint8_t op, const Key& key, const Value* value);
+    static uint32_t checksum(const char* data, size_t len);
+
+    std::string path_;
+    int fd_;
+    size_t groupCommit_;
+    size_t pendingOps_;
+    std::vector<char> buffer_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the WriteAheadLog class.
+  ---------------------------------------------
+*/
+
+/**
+* Opens (creating if needed) the log file at path for appending. The
+* directory is synced too, so that a newly created log survives a crash
+* along with the records later synced into it.
+*/
+template<typename Key, typename Value>
+WriteAheadLog<Key, Value>::WriteAheadLog(const std::string& path, size_t groupCommit) :
+    path_(path),
+    fd_(-1),
+    groupCommit_(groupCommit),
+    pendingOps_(0)
+{
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd_ < 0){
+        throw std::runtime_error("Unable to open write-ahead log " + path);
+    }
+    try {
+        walSyncDirectory(path);
+    } catch(...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+/**
+* Flushes any buffered records before closing the file.
+*/
+template<typename Key, typename Value>
+WriteAheadLog<Key, Value>::~WriteAheadLog()
+{
+    try {
+        sync();
+    } catch(const std::exception&) {
+        // nothing sensible to do in a destructor
+    }
+    ::close(fd_);
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::appendInsert(const Key& key, const Value& value)
+{
+    append(WAL_INSERT, key, &value);
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::appendRemove(const Key& key)
+{
+    append(WAL_REMOVE, key, nullptr);
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::append(uint8_t op, const Key& key, const Value* value)
+{
+    size_t start = buffer_.size();
+    size_t len = 1 + sizeof(Key) + (value != nullptr ? sizeof(Value) : 0);
+    buffer_.resize(start + len + sizeof(uint32_t));
+    char* out = &buffer_[start];
+    out[0] = static_cast<char>(op);
+    std::memcpy(out + 1, &key, sizeof(Key));
+    if(value != nullptr){
+        std::memcpy(out + 1 + sizeof(Key), value, sizeof(Value));
+    }
+    uint32_t sum = checksum(out, len);
+    std::memcpy(out + len, &sum, sizeof(uint32_t));
+
+    pendingOps_++;
+    if(groupCommit_ != 0 && pendingOps_ >= groupCommit_){
+        sync();
+    }
+}
+
+/**
+* Writes all buffered records and forces them to stable storage.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::sync()
+{
+    if(pendingOps_ == 0){
+        return;
+    }
+    size_t written = 0;
+    while(written < buffer_.size()){
+        ssize_t n = ::write(fd_, &buffer_[written], buffer_.size() - written);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            throw std::runtime_error("Write to write-ahead log " + path_ + " failed");
+        }
+        written += static_cast<size_t>(n);
+    }
+    if(::fdatasync(fd_) != 0){
+        throw std::runtime_error("fsync of write-ahead log " + path_ + " failed");
+    }
+    buffer_.clear();
+    pendingOps_ = 0;
+}
+
+/**
+* Discards the whole log, e.g. after its contents were captured in a snapshot.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::truncate()
+{
+    buffer_.clear();
+    pendingOps_ = 0;
+    if(::ftruncate(fd_, 0) != 0 || ::fdatasync(fd_) != 0){
+        throw std::runtime_error("Unable to truncate write-ahead log " + path_);
+    }
+}
+
+/**
+* Returns the number of records not yet synced to disk.
+*/
+template<typename Key, typename Value>
+size_t WriteAheadLog<Key, Value>::pending() const
+{
+    return pendingOps_;
+}
+
+/**
+* Reads back every complete record in the log. A torn or corrupt tail
+* (from a crash in the middle of a write) ends the log; it is cut off
+* so that new records are appended right after the last good one.
+*/
+template<typename Key, typename Value>
+std::vector<typename WriteAheadLog<Key, Value>::Record> WriteAheadLog<Key, Value>::readAll()
+{
+    sync();
+    std::vector<Record> records;
+    FILE* in = std::fopen(path_.c_str(), "rb");
+    if(in == nullptr){
+        return records;
+    }
+    std::vector<char> data;
+    char chunk[65536];
+    size_t n;
+    while((n = std::fread(chunk, 1, sizeof(chunk), in)) > 0){
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    std::fclose(in);
+
+    size_t pos = 0;
+    while(pos < data.size()){
+        uint8_t op = static_cast<uint8_t>(data[pos]);
+        if(op != WAL_INSERT && op != WAL_REMOVE){
+            break;
+        }
+        size_t len = 1 + sizeof(Key) + (op == WAL_INSERT ? sizeof(Value) : 0);
+        if(pos + len + sizeof(uint32_t) > data.size()){
+            break;
+        }
+        uint32_t sum;
+        std::memcpy(&sum, &data[pos + len], sizeof(uint32_t));
+        if(sum != checksum(&data[pos], len)){
+            break;
+        }
+        Record record;
+        std::memset(&record, 0, sizeof(record));
+        record.op = op;
+        std::memcpy(&record.key, &data[pos + 1], sizeof(Key));
+        if(op == WAL_INSERT){
+            std::memcpy(&record.value, &data[pos + 1 + sizeof(Key)], sizeof(Value));
+        }
+        records.push_back(record);
+        pos += len + sizeof(uint32_t);
+    }
+    if(pos < data.size()){
+        if(::ftruncate(fd_, static_cast<off_t>(pos)) != 0){
+            throw std::runtime_error("Unable to cut torn tail of write-ahead log " + path_);
+        }
+    }
+    return records;
+}
+
+/**
+* 32-bit FNV-1a, enough to detect torn writes.
+*/
+template<typename Key, typename Value>
+uint32_t WriteAheadLog<Key, Value>::checksum(const char* data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < len; i++){
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the WriteAheadLog class.
+  -------------------------------------------
+*/
+
+/**
+* A search tree whose insert/remove calls are recorded in a write-ahead log
+* before they are applied. snapshot() writes the full contents to
+* <prefix>.snap and empties the log, so the log only ever holds the changes
+* made since the latest snapshot. clear and buildFromSorted replace the
+* whole contents, so rather than log every key they take a snapshot of
+* the result. recover() rebuilds the tree from the
+* snapshot plus the log with a single bulk build instead of replaying
+* each operation as an insert.
+*/
+template <typename Key, typename Value, typename Tree = AVLTree<Key, Value> >
+class LoggedTree : public Tree
+{
+public:
+    LoggedTree(const std::string& prefix, size_t groupCommit = 1);
+
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void remove(const Key& key);
+    virtual typename Tree::iterator insertNear(const typename Tree::iterator& hint, const std::pair<const Key, Value>& keyValuePair);
+    virtual typename Tree::iterator removeAt(const typename Tree::iterator& pos);
+    virtual void clear();
+    virtual void buildFromSorted(const std::vector<std::pair<Key, Value> >& items);
+
+    void recover();
+    void snapshot();
+    void sync();
+
+private:
+    typedef typename WriteAheadLog<Key, Value>::Record Record;
+
+    static bool recordLess(const Record& a, const Record& b);
+    std::vector<std::pair<Key, Value> > readSnapshot() const;
+
+    std::string snapPath_;
+    WriteAheadLog<Key, Value> log_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LoggedTree class.
+  ---------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Tree>
+LoggedTree<Key, Value, Tree>::LoggedTree(const std::string& prefix, size_t groupCommit) :
+    Tree(),
+    snapPath_(prefix + ".snap"),
+    log_(prefix + ".wal", groupCommit)
+{
+
+}
+
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    log_.appendInsert(keyValuePair.first, keyValuePair.second);
+    Tree::insert(keyValuePair);
+}
+
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::remove(const Key& key)
+{
+    log_.appendRemove(key);
+    Tree::remove(key);
+}
+
+template<typename Key, typename Value, typename Tree>
+typename Tree::iterator LoggedTree<Key, Value, Tree>::insertNear(const typename Tree::iterator& hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    log_.appendInsert(keyValuePair.first, keyValuePair.second);
+    return Tree::insertNear(hint, keyValuePair);
+}
+
+template<typename Key, typename Value, typename Tree>
+typename Tree::iterator LoggedTree<Key, Value, Tree>::removeAt(const typename Tree::iterator& pos)
+{
+    if(pos != this->end()){
+        log_.appendRemove(pos->first);
+    }
+    return Tree::removeAt(pos);
+}
+
+/**
+* Empties the tree and writes an (empty) snapshot, which also empties the
+* log. A crash before the snapshot is in place recovers the contents from
+* before the clear.
+*/
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::clear()
+{
+    Tree::clear();
+    snapshot();
+}
+
+/**
+* Builds the tree from items, as Tree does, and snapshots the result.
+*/
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::buildFromSorted(const std::vector<std::pair<Key, Value> >& items)
+{
+    Tree::buildFromSorted(items);
+    snapshot();
+}
+
+/**
+* Forces all logged operations to disk.
+*/
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::sync()
+{
+    log_.sync();
+}
+
+template<typename Key, typename Value, typename Tree>
+bool LoggedTree<Key, Value, Tree>::recordLess(const Record& a, const Record& b)
+{
+    return a.key < b.key;
+}
+
+/**
+* Replaces the contents of the tree with the latest snapshot plus the
+* changes in the log. The log is reduced to the last operation per key,
+* merged with the (sorted) snapshot and bulk-built in O(n + m log m).
+*/
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::recover()
+{
+    std::vector<std::pair<Key, Value> > base = readSnapshot();
+    std::vector<Record> records = log_.readAll();
+
+    // keep the last record for each key (stable sort preserves log order)
+    std::stable_sort(records.begin(), records.end(), recordLess);
+    std::vector<Record> delta;
+    for(size_t i = 0; i < records.size(); i++){
+        if(i + 1 < records.size() && !(records[i].key < records[i + 1].key)){
+            continue;
+        }
+        delta.push_back(records[i]);
+    }
+
+    std::vector<std::pair<Key, Value> > merged;
+    merged.reserve(base.size() + delta.size());
+    size_t i = 0;
+    size_t j = 0;
+    while(i < base.size() || j < delta.size()){
+        if(j == delta.size() || (i < base.size() && base[i].first < delta[j].key)){
+            merged.push_back(base[i]);
+            i++;
+            continue;
+        }
+        if(i < base.size() && !(delta[j].key < base[i].first)){
+            i++;  // overridden by the log
+        }
+        if(delta[j].op == WriteAheadLog<Key, Value>::WAL_INSERT){
+            merged.push_back(std::make_pair(delta[j].key, delta[j].value));
+        }
+        j++;
+    }
+    // the contents are already on disk, so this is not a new snapshot
+    Tree::buildFromSorted(merged);
+}
+
+/**
+* Writes the current contents to the snapshot file and empties the log.
+* The snapshot is written to a temporary file and renamed into place, so a
+* crash leaves either the old or the new snapshot. If we crash after the
+* rename but before the log is emptied, replaying the old log on top of the
+* new snapshot yields the same contents, since only the last operation per
+* key matters. The directory is synced after the rename: until then the
+* rename may not survive a crash, and emptying the log first could lose
+* operations that are in neither file.
+*/
+template<typename Key, typename Value, typename Tree>
+void LoggedTree<Key, Value, Tree>::snapshot()
+{
+    log_.sync();
+    std::string tmpPath = snapPath_ + ".tmp";
+    FILE* out = std::fopen(tmpPath.c_str(), "wb");
+    if(out == nullptr){
+        throw std::runtime_error("Unable to write snapshot " + tmpPath);
+    }
+    uint64_t count = 0;
+    std::fwrite(&count, sizeof(count), 1, out);
+    for(typename Tree::iterator it = this->begin(); it != this->end(); ++it){
+        std::fwrite(&it->first, sizeof(Key), 1, out);
+        std::fwrite(&it->second, sizeof(Value), 1, out);
+        count++;
+    }
+    std::fseek(out, 0, SEEK_SET);
+    std::fwrite(&count, sizeof(count), 1, out);
+    bool ok = (std::fflush(out) == 0) && (::fsync(fileno(out)) == 0) && !std::ferror(out);
+    std::fclose(out);
+    if(!ok || std::rename(tmpPath.c_str(), snapPath_.c_str()) != 0){
+        throw std::runtime_error("Unable to write snapshot " + snapPath_);
+    }
+    walSyncDirectory(snapPath_);
+    log_.truncate();
+}
+
+template<typename Key, typename Value, typename Tree>
+std::vector<std::pair<Key, Value> > LoggedTree<Key, Value, Tree>::readSnapshot() const
+{
+    std::vector<std::pair<Key, Value> > items;
+    FILE* in = std::fopen(snapPath_.c_str(), "rb");
+    if(in == nullptr){
+        return items;
+    }
+    uint64_t count = 0;
+    if(std::fread(&count, sizeof(count), 1, in) != 1){
+        std::fclose(in);
+        throw std::runtime_error("Corrupt snapshot " + snapPath_);
+    }
+    items.reserve(count);
+    for(uint64_t i = 0; i < count; i++){
+        Key key;
+        Value value;
+        if(std::fread(&key, sizeof(Key), 1, in) != 1 || std::fread(&value, sizeof(Value), 1, in) != 1){
+            std::fclose(in);
+            throw std::runtime_error("Corrupt snapshot " + snapPath_);
+        }
+        items.push_back(std::make_pair(key, value));
+    }
+    std::fclose(in);
+    return items;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the LoggedTree class.
+  -------------------------------------------
+*/
+
+#endif